@@ -0,0 +1,309 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace RayClient
+{
+    /**
+     * A bounded multi-producer multi-consumer queue. Pushing and popping take no
+     * lock: every cell of the ring carries a sequence number telling whether it
+     * is free for the push of a given turn, or full for the pop of that turn, and
+     * producers and consumers claim their turn with a compare-and-swap on their
+     * own position (Vyukov's bounded queue).
+     *
+     * Push() and Pop() block, without spinning, while the queue is full or empty;
+     * the lock and condition variables they sleep on are only touched when some
+     * thread actually waits. Once Close()d, pushing fails and Pop() returns what
+     * is left, then fails too, so the threads blocked on the queue all return;
+     */
+    template<typename T>
+    class BoundedQueue
+    {
+    public:
+        // The capacity is rounded up to a power of 2, of at least 2
+        explicit BoundedQueue(std::size_t capacity);
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        // Moves 'value' in unless the queue is full or closed
+        bool TryPush(T& value);
+
+        // Moves the oldest element out into 'value' unless the queue is empty
+        bool TryPop(T& value);
+
+        // Waits for room while the queue is full; false, and nothing pushed, once closed
+        bool Push(T value);
+
+        // Waits for an element while the queue is empty; false once closed and empty
+        bool Pop(T& value);
+
+        void Close();
+
+        std::size_t GetCapacity() const;
+
+    private:
+        struct Cell
+        {
+            std::atomic<std::size_t> sequence;
+            T value;
+        };
+
+        bool Enqueue(T& value);
+        bool Dequeue(T& value);
+
+        // Wakes a thread waiting on 'condition', if any is counted in 'waiters'
+        void Wake(const std::atomic<unsigned int>& waiters, std::condition_variable& condition);
+
+        static std::size_t RoundUpCapacity(std::size_t capacity);
+
+        const std::size_t m_Mask;
+        std::unique_ptr<Cell[]> m_Cells;
+
+        // Producers and consumers each hammer their own position; keep them off each other's cache line
+        char m_PadBefore[64];
+        std::atomic<std::size_t> m_EnqueuePosition;
+        char m_PadBetween[64];
+        std::atomic<std::size_t> m_DequeuePosition;
+        char m_PadAfter[64];
+
+        std::atomic<bool> m_Closed;
+
+        std::mutex m_WaitMutex;
+        std::condition_variable m_NotFull;
+        std::condition_variable m_NotEmpty;
+        std::atomic<unsigned int> m_PushWaiters;
+        std::atomic<unsigned int> m_PopWaiters;
+    };
+
+    template<typename T>
+    BoundedQueue<T>::BoundedQueue(std::size_t capacity) :
+        m_Mask(RoundUpCapacity(capacity) - 1),
+        m_Cells(new Cell[m_Mask + 1]),
+        m_EnqueuePosition(0),
+        m_DequeuePosition(0),
+        m_Closed(false),
+        m_PushWaiters(0),
+        m_PopWaiters(0)
+    {
+        for (std::size_t cell = 0; cell <= m_Mask; ++cell)
+        {
+            m_Cells[cell].sequence.store(cell, std::memory_order_relaxed);
+        }
+    }
+
+    template<typename T>
+    std::size_t BoundedQueue<T>::RoundUpCapacity(std::size_t capacity)
+    {
+        std::size_t roundedCapacity = 2;
+        while (roundedCapacity < capacity)
+        {
+            roundedCapacity *= 2;
+        }
+
+        return roundedCapacity;
+    }
+
+    template<typename T>
+    std::size_t BoundedQueue<T>::GetCapacity() const
+    {
+        return m_Mask + 1;
+    }
+
+    template<typename T>
+    bool BoundedQueue<T>::Enqueue(T& value)
+    {
+        std::size_t position = m_EnqueuePosition.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell& cell = m_Cells[position & m_Mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::intptr_t turn = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+
+            if (turn == 0)
+            {
+                // The cell is free for this turn: claim it, or retry from wherever another producer left the position
+                if (m_EnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+
+                    // Full for the consumer of this turn
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (turn < 0)
+            {
+                // The cell still holds the element of the previous lap
+                return false;
+            }
+            else
+            {
+                position = m_EnqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    template<typename T>
+    bool BoundedQueue<T>::Dequeue(T& value)
+    {
+        std::size_t position = m_DequeuePosition.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell& cell = m_Cells[position & m_Mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::intptr_t turn = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position + 1);
+
+            if (turn == 0)
+            {
+                if (m_DequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.value);
+
+                    // Free for the producer of the next lap
+                    cell.sequence.store(position + m_Mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (turn < 0)
+            {
+                // Nothing pushed in this cell yet
+                return false;
+            }
+            else
+            {
+                position = m_DequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * A waiter counts itself in before it checks the queue one last time, under the
+     * lock; we change the queue before we look at the count. With a full fence on
+     * both sides, either the waiter sees our change or we see the waiter, and then
+     * taking the lock makes sure it is asleep before we notify it;
+     */
+    template<typename T>
+    void BoundedQueue<T>::Wake(const std::atomic<unsigned int>& waiters, std::condition_variable& condition)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (waiters.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> waitLock(m_WaitMutex);
+            condition.notify_one();
+        }
+    }
+
+    template<typename T>
+    bool BoundedQueue<T>::TryPush(T& value)
+    {
+        if (m_Closed.load(std::memory_order_relaxed) || !Enqueue(value))
+        {
+            return false;
+        }
+
+        Wake(m_PopWaiters, m_NotEmpty);
+        return true;
+    }
+
+    template<typename T>
+    bool BoundedQueue<T>::TryPop(T& value)
+    {
+        if (!Dequeue(value))
+        {
+            return false;
+        }
+
+        Wake(m_PushWaiters, m_NotFull);
+        return true;
+    }
+
+    template<typename T>
+    bool BoundedQueue<T>::Push(T value)
+    {
+        if (TryPush(value))
+        {
+            return true;
+        }
+
+        bool pushed(false);
+        {
+            std::unique_lock<std::mutex> waitLock(m_WaitMutex);
+
+            m_PushWaiters.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            m_NotFull.wait(waitLock, [&]
+            {
+                if (m_Closed.load(std::memory_order_relaxed))
+                {
+                    return true;
+                }
+
+                pushed = Enqueue(value);
+                return pushed;
+            });
+
+            m_PushWaiters.fetch_sub(1);
+        }
+
+        if (pushed)
+        {
+            Wake(m_PopWaiters, m_NotEmpty);
+        }
+
+        return pushed;
+    }
+
+    template<typename T>
+    bool BoundedQueue<T>::Pop(T& value)
+    {
+        if (TryPop(value))
+        {
+            return true;
+        }
+
+        bool popped(false);
+        {
+            std::unique_lock<std::mutex> waitLock(m_WaitMutex);
+
+            m_PopWaiters.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            // What was pushed before the queue was closed is still handed out
+            m_NotEmpty.wait(waitLock, [&]
+            {
+                popped = Dequeue(value);
+                return popped || m_Closed.load(std::memory_order_relaxed);
+            });
+
+            m_PopWaiters.fetch_sub(1);
+        }
+
+        if (popped)
+        {
+            Wake(m_PushWaiters, m_NotFull);
+        }
+
+        return popped;
+    }
+
+    template<typename T>
+    void BoundedQueue<T>::Close()
+    {
+        m_Closed = true;
+
+        std::lock_guard<std::mutex> waitLock(m_WaitMutex);
+        m_NotFull.notify_all();
+        m_NotEmpty.notify_all();
+    }
+}
@@ -5,6 +5,7 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <cstdint>
 #include <deque>
 #include <utility>
 
@@ -13,6 +14,9 @@
 // RayTracer includes
 #include "Serialization.h"
 #include "RayTracer.h"
+#include "RenderThreadPool.h"
+
+#include "BoundedQueue.h"
 
 namespace RayClient
 {
@@ -23,7 +27,8 @@ namespace RayClient
     public:
         ~ChunksManager();
 
-        ChunksManager(boost::asio::io_service& ioService, std::string onServer, unsigned int pixelsWide, unsigned int  pixelsHigh, double zoom, unsigned int  antiAliasFactor);
+        // A renderThreads of 0 renders with one thread per hardware thread.
+        ChunksManager(boost::asio::io_service& ioService, std::string onServer, unsigned int pixelsWide, unsigned int  pixelsHigh, double zoom, unsigned int  antiAliasFactor, unsigned int renderThreads = 0);
 
         boost::asio::io_service & m_IoService;
         std::string m_OnServer;
@@ -35,30 +40,57 @@ namespace RayClient
         double m_Zoom;
         unsigned int m_AntiAliasFactor;
 
+        // Renders received chunks against the shared scene; network I/O stays on the io_service.
+        RayTracer::RenderThreadPool m_RenderThreadPool;
+
+        // The number of chunks this worker buffers, granted to the server as credits once the scene is in
+        const unsigned int m_ChunkCredits;
+
+        // Chunks received whose results have not been handed to the session yet
+        std::atomic<unsigned int> m_ChunksHeld;
+
+        unsigned int GetFreeChunkCredits() const;
+
         std::atomic<bool> m_SceneReceived;
         std::atomic<bool> m_PixelsProcessDone;
         std::atomic<bool> m_FinishedNetworkOperations;
 
-        void SaveScene(const std::string& serializedScene);
-        void QueueInputPixels(const std::vector<int>& pixelsChunk);
-        void QueueOutputPixels(const std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>>& pixelsChunk);
-        
-        std::deque<std::vector<int>> m_InputQueue;
-        std::deque<std::vector<int>> m_InputBufferQueue;
-        std::deque<std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>>> m_OutputQueue;
-        std::deque<std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>>> m_OutputBufferQueue;
+        // A chunk received and how it is to be rendered; the mode comes with every chunk, from the type of the message that carried it
+        struct InputChunk
+        {
+            std::uint32_t chunkID;
+            RayTracer::PixelTile tile;
+
+            // A rectangle of final pixels to be anti-aliased here, rather than one of oversampled pixels
+            bool antiAlias;
+        };
+
+        void SaveScene(const std::vector<char>& serializedScene);
+        void QueueInputPixels(std::uint32_t chunkID, const RayTracer::PixelTile& pixelsChunk, bool antiAlias);
+
+        // Blocks the render threads while m_ChunkCredits results already wait to be sent
+        void QueueOutputPixels(std::uint32_t chunkID, RayTracer::PixelRect pixelsChunk);
+
+        // Called on the bye message: closes both queues, so the processors return once they are done with what they hold
+        void StopProcessing();
+
+        /**
+         * Chunks travel with the chunk id the server gave them, so the results can be sent back under the same id. Both
+         * queues hold m_ChunkCredits entries at most: the server never sends more chunks than it has credits for, and
+         * results past that many wait in the render threads rather than pile up here.
+         */
+        BoundedQueue<InputChunk> m_InputQueue;
+        BoundedQueue<std::pair<std::uint32_t, RayTracer::PixelRect>> m_OutputQueue;
         
+        // Throws if the chunk does not lie inside an image of the given size
+        static void CheckChunkFits(const RayTracer::PixelTile& chunk, size_t imagePixelsWide, size_t imagePixelsHigh);
+
+        // Hands a chunk that does not fit back to the server, so that it neither reaches the render threads nor ends the worker
+        bool AcceptChunk(std::uint32_t chunkID, const RayTracer::PixelTile& chunk, size_t imagePixelsWide, size_t imagePixelsHigh);
+
         void AsyncInputProcessor();
         void AsyncOutputProcessor();
         
-        std::condition_variable m_WaitOnInputDataQueue;
-        std::condition_variable m_WaitOnOutputDataQueue;
-    
-        std::mutex m_OutputQueueMutex;
-        std::mutex m_OutputBufferQueueMutex;
-        std::mutex m_InputQueueMutex;
-        std::mutex m_InputBufferQueueMutex;
-        
         std::deque<std::shared_ptr<Client>> m_AsyncRequests;
         
         std::mutex m_EventNetworkMutex;
@@ -66,6 +98,18 @@ namespace RayClient
         std::mutex m_SceneMutex;
 
         const std::shared_ptr<Client> FinishNetworkWorkers();
-        const std::shared_ptr<Client> TryToAcquireNetworkWorker();
+
+        /**
+         * Once the scene is in, replaces a failed session every HEARTBEAT_MILLISECONDS, even with no result waiting to
+         * be sent, so that the new session grants the credits of a worker that holds no chunks. Stops after the bye message.
+         */
+        boost::asio::steady_timer m_ReconnectTimer;
+        std::atomic<bool> m_ReconnectStarted;
+
+        void StartReconnectTimer();
+        void HandleReconnectTimer(const boost::system::error_code &);
+
+        // A session to send on, replacing the failed ones; never waits for one
+        const std::shared_ptr<Client> AcquireNetworkWorker();
     };
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "Requirements.h"
 #include "ChunksManager.h"
+#include "Message.h"
 
 #include <atomic>
 #include <condition_variable>
@@ -15,7 +16,9 @@ namespace RayTracer
 
 namespace RayClient
 {
-    class Client : boost::noncopyable
+    class Client :
+        public std::enable_shared_from_this <Client>,
+        boost::noncopyable
     {
         friend class CunksManager;
         // Pubs
@@ -40,38 +43,70 @@ namespace RayClient
 
         // The only possible constructor
         Client(ChunksManager & chunksManager);
-        void AsyncRequest(const std::string &, const std::string & = std::string());
+
+        // Queues one message for this worker's session, opening the session first if it is not connected yet. Safe to call from any thread
+        void AsyncRequest(Message::Types, const std::string & = std::string(), std::uint32_t chunkID = 0);
         ~Client();
 
         Statuses GetStatus();
     private:
+        struct PendingRequest
+        {
+            Message::Types type;
+            std::uint32_t chunkID;
+            std::string body;
+        };
+
         // Methods
+        void QueueRequest(std::shared_ptr<PendingRequest>);
+        void StartSession();
+        void WriteRequest();
+        void StartRead();
+        bool RetryOnNewSession();
         void HandleResolve(const boost::system::error_code &, asio::ip::tcp::resolver::iterator);
         void HandleConnect(const boost::system::error_code &);
         void HandleWriteRequest(const boost::system::error_code &);
+        void HandleReadHeader(const boost::system::error_code &);
         void HandleRead(const boost::system::error_code &);
         void HandleReadContent(const boost::system::error_code &);
         void HandleStop();
+        void StartHeartbeat();
+        void HandleHeartbeat(const boost::system::error_code &);
 
         // Pre-determined
         const std::string k_OnServer;
 
-        std::string m_WithStatus;
-        std::string m_WithData;
+        // Sent front to back, one write at a time; the front is the request being written
+        std::deque<PendingRequest> m_WriteQueue;
         std::string m_RootPath;
 
         // Integrity atomics and/or mutexes
         std::atomic<Statuses> m_CurrentStatus;
         std::atomic<bool> m_WorkerStopped;
 
+        // Keep-alive: the session stays open between requests and is only reopened after a failure
+        std::atomic<bool> m_SessionConnected;
+        bool m_SessionStarting;
+        bool m_SessionCarriedMessages;
+        bool m_RequestRetried;
+
+        // Renews the leases on the chunks this worker holds, while the session has nothing else to send
+        bool m_HeartbeatStarted;
+
         // Asio
         asio::io_service & m_IoService;
         asio::ip::tcp::resolver m_DnsResolver;
         asio::ip::tcp::socket m_TcpSocket;
-        asio::streambuf m_RequestBuffer;
-        asio::streambuf m_ResponseBuffer;
+        asio::steady_timer m_HeartbeatTimer;
+
+        // Reads, writes and queued requests are handled one at a time, whichever thread runs the io_service
+        asio::io_service::strand m_Strand;
+
+        // Reused for every message of the session
+        Message m_ReadMessage;
+        Message m_WriteMessage;
 
-        std::vector<int> m_ReceivedChunk;
+        RayTracer::PixelTile m_ReceivedChunk;
 
         ChunksManager & m_ChunksManager;
     };
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Requirements.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace RayClient
+{
+    /**
+     * One message of the wire protocol spoken with the server. Every message is
+     * a fixed size header followed by a body of exactly the length the header
+     * announces, so a message is read with two exact reads and the body may hold
+     * any bytes at all. The header is:
+     *
+     *     magic (4 bytes) | type (4 bytes) | chunk id (4 bytes) | body size (4 bytes)
+     *
+     * with every field little endian, whatever the byte order of the machine.
+     * The same object is reused for every message of a session, so the body
+     * buffer is only reallocated when a larger message comes in;
+     */
+    class Message
+    {
+    public:
+
+        enum Types : std::uint32_t
+        {
+            NO_MESSAGE = 0,
+            SEND_SCENE = 1,
+            RECEIVED_SCENE = 2,
+            PIXELS_TO_PROCESS = 3,
+            COMPUTED_PIXELS = 4,
+            BYE_BYE = 5,
+            // Like PIXELS_TO_PROCESS, but the chunk is a rectangle of final pixels, to be answered with final pixels
+            PIXELS_TO_DOWNSAMPLE = 6,
+            // Worker to server: room for this many more chunks, carried in the chunk id field; the body is empty
+            CREDITS = 7,
+            // Worker to server, every HEARTBEAT_MILLISECONDS while nothing else is sent: the worker is alive, its chunks stay its own; the body is empty
+            HEARTBEAT = 8,
+            // Worker to server: the chunk of the chunk id cannot be rendered there, and goes back with its credit; the body is empty
+            REFUSED_CHUNK = 9
+        };
+
+        static const std::size_t HEADER_SIZE = 16;
+
+        Message();
+
+        // Fills in the header of an outgoing message; the body is sent from wherever the caller keeps it
+        void SetHeader(Types type, std::uint32_t chunkID, std::size_t bodySize);
+
+        // Decodes the header just read into HeaderBuffer(); false if it is not a header of this protocol
+        bool DecodeHeader();
+
+        Types GetType() const;
+        std::uint32_t GetChunkID() const;
+        std::size_t GetBodySize() const;
+
+        // The number of chunks granted by a CREDITS message
+        std::uint32_t GetCredits() const;
+
+        asio::mutable_buffers_1 HeaderBuffer();
+
+        // The body of an incoming message, sized by the last DecodeHeader()
+        asio::mutable_buffers_1 BodyBuffer();
+        const std::vector<char>& GetBody() const;
+
+        // The header followed by 'body', ready for a single gathering write
+        std::array<asio::const_buffer, 2> ToBuffers(const std::string& body) const;
+
+        static std::string GetTypeName(Types type);
+
+    private:
+        std::array<unsigned char, HEADER_SIZE> m_Header;
+
+        Types m_Type;
+        std::uint32_t m_ChunkID;
+        std::uint32_t m_BodySize;
+
+        std::vector<char> m_Body;
+    };
+}
\ No newline at end of file
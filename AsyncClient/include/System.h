@@ -7,18 +7,20 @@ namespace RayClient
     namespace system
     {
         extern const std::string LOG_FILE_PATH;
+        extern const unsigned int LOG_LEVEL;
+        extern const unsigned int LOG_RING_LINES;
+        extern const unsigned int LOG_FLUSH_MILLISECONDS;
+        extern const unsigned int LOG_LINES_PER_SECOND;
         extern const unsigned int WRITE_BUFFER_SIZE;
         extern const std::string NIX_EOL;
         extern const std::string CR;
         extern const std::string BACKSLASH;
         extern const std::string HASHTAG;
         extern const std::string ALL_DIGITS;
-        extern const std::string SEPARATOR;
-        extern const std::string PIXEL_TO_PROCESS;
-        extern const std::string SEND_SCENE;
-        extern const std::string COMPUTED_PIXELS;
-        extern const std::string RECEIVED_SCENE;
-        extern const std::string BYE_BYE;
-        extern const unsigned int ASYNC_CLIENTS_MAX;
+        extern const unsigned int MESSAGE_MAGIC;
+        extern const unsigned int MAX_MESSAGE_BODY_SIZE;
+        extern const unsigned int CHUNK_CREDITS_PER_RENDER_THREAD;
+        extern const unsigned int HEARTBEAT_MILLISECONDS;
+        extern const bool FLOAT_PIXEL_COLORS;
     }
 }
\ No newline at end of file
@@ -25,12 +25,10 @@ namespace RayClient
         static std::string GetUTCAsString();
         static bool TryParseStringToUInt(const std::string& stringIn, unsigned int& uIntOut);
         static std::vector<char> ToVectorChar(const std::stringstream&);
-        static std::string GetUntilSeparator(std::string& input);
 
         template<class T>
         static inline std::string ToString(T objVar)
         {
-            std::lock_guard<std::mutex> guardLock(s_ToStringMutex);
             return boost::lexical_cast<std::string> (objVar);
         }
 
@@ -40,7 +38,6 @@ namespace RayClient
         static boost::uuids::basic_random_generator<boost::random::mt19937> s_OneUuidGenerator;
         static const boost::posix_time::ptime s_ObjEpoch;
         static std::mutex s_GetUUIDMutex;
-        static std::mutex s_ToStringMutex;
         static std::string s_TimeFormat;
     };
 }
\ No newline at end of file
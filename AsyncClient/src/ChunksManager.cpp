@@ -2,19 +2,30 @@
 #include "Client.h"
 #include "Logger.h"
 
+#include <algorithm>
+#include <functional>
 #include <sstream>
 
+#include "ArchiveFormat.h"
+
 namespace RayClient
 {
-    ChunksManager::ChunksManager(boost::asio::io_service & ioService, std::string onServer, unsigned int pixelsWide, unsigned int  pixelsHigh, double zoom, unsigned int antiAliasFactor) :
+    ChunksManager::ChunksManager(boost::asio::io_service & ioService, std::string onServer, unsigned int pixelsWide, unsigned int  pixelsHigh, double zoom, unsigned int antiAliasFactor, unsigned int renderThreads) :
         m_IoService(ioService),
         m_OnServer(onServer),
         m_PixelsWide(pixelsWide),
         m_PixelsHigh(pixelsHigh),
         m_Zoom(zoom),
         m_AntiAliasFactor(antiAliasFactor),
+        m_RenderThreadPool(renderThreads),
+        m_ChunkCredits(system::CHUNK_CREDITS_PER_RENDER_THREAD * static_cast<unsigned int>(m_RenderThreadPool.GetThreadCount())),
+        m_ChunksHeld(0),
         m_SceneReceived(false),
-        m_PixelsProcessDone(false)
+        m_PixelsProcessDone(false),
+        m_InputQueue(m_ChunkCredits),
+        m_OutputQueue(m_ChunkCredits),
+        m_ReconnectTimer(ioService),
+        m_ReconnectStarted(false)
     {
         m_Scene = std::shared_ptr<RayTracer::Scene>(new RayTracer::Scene(RayTracer::Color(0.196078, 0.8, 0.196078, 7.0e-6)));
     }
@@ -24,138 +35,249 @@ namespace RayClient
         m_IoService.stop();
     }
 
-    void ChunksManager::SaveScene(const std::string& serializedScene)
+    void ChunksManager::SaveScene(const std::vector<char>& serializedScene)
     {
         // deserialize
-        {
-            std::stringstream objectBuffer(serializedScene);
-            boost::archive::text_iarchive inArchive(objectBuffer);
-            inArchive >> *m_Scene;
-        }
+        RayTracer::LoadArchive(serializedScene.data(), serializedScene.size(), *m_Scene);
 
         m_SceneReceived = true;
 
-        auto networkWorker = TryToAcquireNetworkWorker();
+        auto networkWorker = AcquireNetworkWorker();
 
-        if (networkWorker)
+        networkWorker->AsyncRequest(Message::RECEIVED_SCENE);
+
+        // From now on the server keeps this many chunks coming, one more for every result
+        networkWorker->AsyncRequest(Message::CREDITS, std::string(), m_ChunkCredits);
+
+        if (!m_ReconnectStarted.exchange(true))
         {
-            networkWorker->AsyncRequest(system::RECEIVED_SCENE);
+            StartReconnectTimer();
         }
     }
 
-    void ChunksManager::QueueInputPixels(const std::vector<int>& pixelChunk)
+    void ChunksManager::StartReconnectTimer()
     {
-        std::unique_lock<std::mutex> guardLock(m_InputQueueMutex, std::defer_lock);
+        m_ReconnectTimer.expires_from_now(std::chrono::milliseconds(system::HEARTBEAT_MILLISECONDS));
+        m_ReconnectTimer.async_wait(std::bind(&ChunksManager::HandleReconnectTimer, this, std::placeholders::_1));
+    }
 
-        if (guardLock.try_lock())
+    /**
+    * A session dropped while reading is only replaced when something asks for
+    * a network worker; a worker that holds no chunks has no result to ask with,
+    * so the timer asks instead. The fresh Client opens its session with a
+    * heartbeat, and the credits go out first on it;
+    */
+    void ChunksManager::HandleReconnectTimer(const boost::system::error_code &errorCode)
+    {
+        if (errorCode || m_PixelsProcessDone)
         {
-            std::lock_guard<std::mutex> buffer(m_InputBufferQueueMutex);
-
-            m_InputQueue.insert(m_InputQueue.end(), m_InputBufferQueue.begin(), m_InputBufferQueue.end());
-            m_InputBufferQueue.clear();
-
-            m_InputQueue.push_back(pixelChunk);
-
-            m_WaitOnInputDataQueue.notify_one();
+            return;
         }
-        else
+
+        const std::shared_ptr<Client> networkWorker = FinishNetworkWorkers();
+        if (networkWorker && networkWorker->GetStatus() == Client::AWAITING_WORK)
         {
-            std::lock_guard<std::mutex> buffer(m_InputBufferQueueMutex);
-            m_InputBufferQueue.push_back(pixelChunk);
+            networkWorker->AsyncRequest(Message::HEARTBEAT);
         }
+
+        StartReconnectTimer();
     }
 
-    void ChunksManager::QueueOutputPixels(const std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>>& pixelChunk)
+    unsigned int ChunksManager::GetFreeChunkCredits() const
     {
-        std::unique_lock<std::mutex> guardLock(m_OutputQueueMutex, std::defer_lock);
+        const unsigned int chunksHeld = m_ChunksHeld.load();
+        return (chunksHeld < m_ChunkCredits) ? (m_ChunkCredits - chunksHeld) : 0;
+    }
 
-        if (guardLock.try_lock())
-        {
-            std::lock_guard<std::mutex> buffer(m_OutputBufferQueueMutex);
+    /**
+    * Runs on the session's strand. The credits keep the chunks held under the
+    * capacity of the input queue, so this never waits and the session goes on
+    * reading;
+    */
+    void ChunksManager::QueueInputPixels(std::uint32_t chunkID, const RayTracer::PixelTile& pixelChunk, bool antiAlias)
+    {
+        ++m_ChunksHeld;
 
-            // Insert
-            m_OutputQueue.insert(m_OutputQueue.end(), m_OutputBufferQueue.begin(), m_OutputBufferQueue.end());
-            m_OutputBufferQueue.clear();
+        InputChunk inputChunk;
+        inputChunk.chunkID = chunkID;
+        inputChunk.tile = pixelChunk;
+        inputChunk.antiAlias = antiAlias;
 
-            m_OutputQueue.push_back(pixelChunk);
+        m_InputQueue.Push(std::move(inputChunk));
+    }
 
-            m_WaitOnOutputDataQueue.notify_one();
+    void ChunksManager::QueueOutputPixels(std::uint32_t chunkID, RayTracer::PixelRect pixelChunk)
+    {
+        m_OutputQueue.Push(std::make_pair(chunkID, std::move(pixelChunk)));
+    }
+
+    void ChunksManager::StopProcessing()
+    {
+        // The reconnect timer sees this on its next tick and stops, letting the io_service run out of work
+        m_PixelsProcessDone = true;
+
+        m_InputQueue.Close();
+        m_OutputQueue.Close();
+    }
+
+    void ChunksManager::CheckChunkFits(const RayTracer::PixelTile& chunk, size_t imagePixelsWide, size_t imagePixelsHigh)
+    {
+        if ((chunk.GetLeft() + chunk.GetWidth() > imagePixelsWide) || (chunk.GetTop() + chunk.GetHeight() > imagePixelsHigh) || chunk.GetTileSize() == 0)
+        {
+            throw ImagerException("Received a chunk that does not fit in the image.");
         }
-        else
+    }
+
+    /**
+    * A chunk that does not fit is not rendered: it would write past the buffers.
+    * It is handed back to the server instead, which takes back its lease and
+    * returns its credit, so that another worker renders it and this one is not
+    * left a credit short;
+    */
+    bool ChunksManager::AcceptChunk(std::uint32_t chunkID, const RayTracer::PixelTile& chunk, size_t imagePixelsWide, size_t imagePixelsHigh)
+    {
+        try
         {
-            std::lock_guard<std::mutex> buffer(m_OutputBufferQueueMutex);
-            m_OutputBufferQueue.push_back(pixelChunk);
+            CheckChunkFits(chunk, imagePixelsWide, imagePixelsHigh);
+        }
+        catch (const ImagerException& exception)
+        {
+            AcquireNetworkWorker()->AsyncRequest(Message::REFUSED_CHUNK, std::string(), chunkID);
+
+            --m_ChunksHeld;
+
+            Logger::WriteLog("Handed back chunk " + Utils::ToString(chunkID) + ": " + exception.GetMessage(), Logger::LEVEL_ERROR);
+
+            return false;
         }
+
+        return true;
     }
 
     void ChunksManager::AsyncInputProcessor()
     {
-        std::unique_lock<std::mutex> guardLock(m_InputQueueMutex);
-
         const size_t largePixelsWide = m_AntiAliasFactor * m_PixelsWide;
         const size_t largePixelsHigh = m_AntiAliasFactor * m_PixelsHigh;
-        std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>> computedChunk;
 
-        while (m_PixelsProcessDone.load(std::memory_order_relaxed) == false)
-        {
-            m_WaitOnInputDataQueue.wait(guardLock); 
+        // Scratch memory for the rays traced by each render thread; the scene itself is only read.
+        std::vector<RayTracer::TraceContext> traceContexts(m_RenderThreadPool.GetThreadCount());
 
-            while (!m_InputQueue.empty())
-            {
-                auto matrixLines = m_InputQueue.front();
+        InputChunk nextChunk;
+        std::vector<InputChunk> inputChunks;
+        std::vector<std::unique_ptr<RayTracer::ImageBuffer>> computedChunks;
+        std::vector<RayTracer::PixelData> computedPixels;
+
+        // (chunk, top left corner of the tile within the chunk) for every tile of every chunk in the current batch
+        std::vector<std::pair<size_t, std::pair<size_t, size_t>>> batchTiles;
+        std::vector<std::pair<size_t, size_t>> chunkTiles;
 
-                m_InputQueue.pop_front();
+        // Sleeps while there is nothing to render; returns once the queue is closed
+        while (m_InputQueue.Pop(nextChunk))
+        {
+            /**
+             * Take up to one chunk per render thread, so that even small chunks give all render threads something to do,
+             * while the chunks the credits keep coming in wait for the next batch instead of holding back these results.
+             */
+            inputChunks.clear();
+            inputChunks.push_back(std::move(nextChunk));
+
+            while (inputChunks.size() < m_RenderThreadPool.GetThreadCount() && m_InputQueue.TryPop(nextChunk))
+            {
+                inputChunks.push_back(std::move(nextChunk));
+            }
 
-                computedChunk.clear();
+            // Chunks of final pixels lie in the final image, the others in the oversampled one
+            inputChunks.erase(std::remove_if(inputChunks.begin(), inputChunks.end(), [&](const InputChunk& inputChunk)
+            {
+                return !AcceptChunk(inputChunk.chunkID, inputChunk.tile, inputChunk.antiAlias ? m_PixelsWide : largePixelsWide, inputChunk.antiAlias ? m_PixelsHigh : largePixelsHigh);
+            }), inputChunks.end());
 
-                for (const auto& lin : matrixLines)
+            // A rectangle of final pixels has plenty of oversampled pixels to keep every render thread busy on its own
+            for (const auto& inputChunk : inputChunks)
+            {
+                if (inputChunk.antiAlias)
                 {
-                    for (unsigned int col = 0; col < largePixelsHigh; ++col)
-                    {
-                        RayTracer::PixelData pixelColor = m_Scene->GetPixelAt(lin, col, m_PixelsWide, m_PixelsHigh, m_Zoom, m_AntiAliasFactor);
+                    const RayTracer::PixelTile& chunk = inputChunk.tile;
 
-                        computedChunk.push_back(std::make_pair(RayTracer::PixelCoordinates(lin, col), pixelColor));
-                    }
+                    QueueOutputPixels(inputChunk.chunkID,
+                        m_Scene->RenderDownsampledRect(chunk.GetLeft(), chunk.GetTop(), chunk.GetWidth(), chunk.GetHeight(), m_PixelsWide, m_PixelsHigh, m_Zoom, m_AntiAliasFactor,
+                            chunk.GetTileSize(), m_RenderThreadPool, traceContexts, system::FLOAT_PIXEL_COLORS));
                 }
-                
-                QueueOutputPixels(computedChunk);
             }
-        }
-    }
 
-    void ChunksManager::AsyncOutputProcessor()
-    {
-        while (m_PixelsProcessDone.load(std::memory_order_relaxed) == false)
-        {
-            std::unique_lock<std::mutex> guardLock(m_OutputQueueMutex);
+            // The chunks of oversampled pixels are traced together
+            inputChunks.erase(std::remove_if(inputChunks.begin(), inputChunks.end(), [](const InputChunk& inputChunk) { return inputChunk.antiAlias; }), inputChunks.end());
 
-            m_WaitOnOutputDataQueue.wait(guardLock);
+            if (inputChunks.empty())
+            {
+                continue;
+            }
 
-            for (bool tryToAquireWorker = false; !tryToAquireWorker;)
+            computedChunks.resize(inputChunks.size());
+            batchTiles.clear();
+
+            for (size_t chunkIndex = 0; chunkIndex < inputChunks.size(); ++chunkIndex)
             {
-                auto networkWorker = TryToAcquireNetworkWorker();
+                const RayTracer::PixelTile& chunk = inputChunks[chunkIndex].tile;
+
+                computedChunks[chunkIndex].reset(new RayTracer::ImageBuffer(chunk.GetWidth(), chunk.GetHeight()));
 
-                if (networkWorker)
+                chunk.GetTiles(chunkTiles);
+                for (const auto& chunkTile : chunkTiles)
                 {
-                    if (!m_OutputQueue.empty())
-                    {
-                        auto outputChunk = m_OutputQueue.back();
-                        m_OutputQueue.pop_back();
+                    batchTiles.push_back(std::make_pair(chunkIndex, chunkTile));
+                }
+            }
+
+            // Each task traces one tile of a chunk, in Morton order, straight into the chunk's own buffer.
+            m_RenderThreadPool.Run(batchTiles.size(), [&](size_t taskIndex, size_t threadIndex)
+            {
+                const auto& batchTile = batchTiles[taskIndex];
+                const RayTracer::PixelTile& chunk = inputChunks[batchTile.first].tile;
+                const size_t tileLeft = batchTile.second.first;
+                const size_t tileTop = batchTile.second.second;
 
-                        std::stringstream objectBuffer;
-                        boost::archive::text_oarchive outArchive(objectBuffer);
-                        outArchive << outputChunk;
-                        networkWorker->AsyncRequest(system::COMPUTED_PIXELS, objectBuffer.str());
+                m_Scene->TraceTile(*computedChunks[batchTile.first], chunk.GetLeft(), chunk.GetTop(), tileLeft, tileTop,
+                    std::min(chunk.GetTileSize(), chunk.GetWidth() - tileLeft), std::min(chunk.GetTileSize(), chunk.GetHeight() - tileTop),
+                    m_PixelsWide, m_PixelsHigh, m_Zoom, m_AntiAliasFactor, traceContexts[threadIndex]);
+            });
 
-                        Logger::WriteLog("Sending ray traced pixels to server..");
+            for (size_t chunkIndex = 0; chunkIndex < inputChunks.size(); ++chunkIndex)
+            {
+                const RayTracer::PixelTile& chunk = inputChunks[chunkIndex].tile;
+                const RayTracer::ImageBuffer& computedChunk = *computedChunks[chunkIndex];
 
-                        tryToAquireWorker = true;
+                computedPixels.resize(chunk.GetNumPixels());
+                for (size_t j = 0; j < chunk.GetHeight(); ++j)
+                {
+                    for (size_t i = 0; i < chunk.GetWidth(); ++i)
+                    {
+                        computedPixels[j * chunk.GetWidth() + i] = computedChunk.Pixel(i, j);
                     }
                 }
+
+                QueueOutputPixels(inputChunks[chunkIndex].chunkID,
+                    RayTracer::PixelRect(chunk.GetLeft(), chunk.GetTop(), chunk.GetWidth(), chunk.GetHeight(), computedPixels, system::FLOAT_PIXEL_COLORS));
             }
         }
     }
 
+    void ChunksManager::AsyncOutputProcessor()
+    {
+        std::pair<std::uint32_t, RayTracer::PixelRect> outputChunk;
+
+        // Sleeps while there is nothing to send; returns once the queue is closed
+        while (m_OutputQueue.Pop(outputChunk))
+        {
+            AcquireNetworkWorker()->AsyncRequest(Message::COMPUTED_PIXELS, RayTracer::SaveArchive(outputChunk.second), outputChunk.first);
+
+            // Its result returns the chunk's credit to the server
+            --m_ChunksHeld;
+
+            Logger::WriteLog("Sending ray traced pixels to server..", Logger::LEVEL_DEBUG);
+        }
+    }
+
     const std::shared_ptr<Client> ChunksManager::FinishNetworkWorkers()
     {
         std::lock_guard<std::mutex> guardLock(m_AsyncWorkersMutex);
@@ -179,46 +301,34 @@ namespace RayClient
 
                     workersIterator->swap(newWorker);
                     failedWorker.reset();
+
+                    // The fresh one opens a new session with its first request
+                    networkWorker = workersIterator.operator * ();
                     break;
                 }
 
-                case Client::AWAITING_WORK:
-                case Client::OK_STATUS:
+                // A session is never idle: it reads while it writes, so anything but a failure will do
+                default:
                 {
                     networkWorker = workersIterator.operator * ();
                     break;
                 }
-                   
-                default:
-                    break;
             }
         }
 
         return networkWorker;
     }
-    const std::shared_ptr<Client> ChunksManager::TryToAcquireNetworkWorker()
+    const std::shared_ptr<Client> ChunksManager::AcquireNetworkWorker()
     {
-        std::shared_ptr<Client> networkWorker;
+        std::shared_ptr<Client> networkWorker = FinishNetworkWorkers();
 
-        while (!(networkWorker))
+        if (!(networkWorker))
         {
-            networkWorker = FinishNetworkWorkers();
-
-            if (!(networkWorker))
-            {
-                if (m_AsyncRequests.size() < system::ASYNC_CLIENTS_MAX)
-                {
-                  
-                    std::lock_guard<std::mutex> guardLock(m_AsyncWorkersMutex);
-                    networkWorker = std::shared_ptr<Client>(std::shared_ptr<Client>(new Client(std::ref(*this))));
+            // The very first one
+            std::lock_guard<std::mutex> guardLock(m_AsyncWorkersMutex);
+            networkWorker = std::shared_ptr<Client>(new Client(std::ref(*this)));
 
-                    m_AsyncRequests.push_back(networkWorker);
-                }
-                else
-                {
-                    networkWorker = FinishNetworkWorkers();
-                }
-            }
+            m_AsyncRequests.push_back(networkWorker);
         }
 
         return networkWorker;
@@ -1,11 +1,12 @@
 #include "Client.h"
 #include "Logger.h"
 
+#include <algorithm>
+
 #include <boost/bind.hpp>
-#include <boost/algorithm/string/trim.hpp>
-#include <boost/algorithm/string/predicate.hpp>
 
 #include "Serialization.h"
+#include "ArchiveFormat.h"
 
 BOOST_CLASS_EXPORT_GUID(RayTracer::ChessBoard, "chess_board");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Color, "color");
@@ -14,6 +15,7 @@ BOOST_CLASS_EXPORT_GUID(RayTracer::Cuboid, "cuboid");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Cylinder, "cylinder");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Dodecahedron, "dodecahedron");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Icosahedron, "icosahedron");
+BOOST_CLASS_EXPORT_GUID(RayTracer::Instance, "instance");
 BOOST_CLASS_EXPORT_GUID(RayTracer::PixelData, "pixel_data");
 BOOST_CLASS_EXPORT_GUID(RayTracer::ImageBuffer, "image_buffer");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Intersection, "intersection");
@@ -38,9 +40,6 @@ BOOST_SERIALIZATION_ASSUME_ABSTRACT(RayTracer::SolidObject_BinaryOperator);
 BOOST_SERIALIZATION_ASSUME_ABSTRACT(RayTracer::SolidObject);
 BOOST_SERIALIZATION_ASSUME_ABSTRACT(RayTracer::Taggable);
 
-// Aliasing
-namespace algo = boost::algorithm;
-
 namespace RayClient
 {
     Client::Client(ChunksManager& chunksManager) :
@@ -49,9 +48,16 @@ namespace RayClient
         m_RootPath("..\\res"),
         m_CurrentStatus(NO_STATUS),
         m_WorkerStopped(false),
+        m_SessionConnected(false),
+        m_SessionStarting(false),
+        m_SessionCarriedMessages(false),
+        m_RequestRetried(false),
+        m_HeartbeatStarted(false),
         m_IoService(chunksManager.m_IoService),
         m_DnsResolver(chunksManager.m_IoService),
-        m_TcpSocket(chunksManager.m_IoService)
+        m_TcpSocket(chunksManager.m_IoService),
+        m_HeartbeatTimer(chunksManager.m_IoService),
+        m_Strand(chunksManager.m_IoService)
     {
         // Notify of properly constructed
         m_CurrentStatus = AWAITING_WORK;
@@ -72,8 +78,11 @@ namespace RayClient
     {
         // Set these
         m_WorkerStopped = true;
+        m_SessionConnected = false;
         boost::system::error_code ignoredCode;
 
+        m_HeartbeatTimer.cancel(ignoredCode);
+
         // Close it
         if (m_TcpSocket.is_open())
         {
@@ -83,27 +92,66 @@ namespace RayClient
     }
 
     /**
-    * Method accepts the data to be POST'ed to the given ETS server. The
-    * class is configured for GLOT purposes, but the basic framework can be
-    * used for any HTTP request to the necessary modifications or
-    * abstractizations. It starts a DNS resolve query, initiating the
-    * chain of requests;
+    * Method accepts the data to be sent to the server. The worker keeps
+    * one long-lived session (TCP connection) to the server which carries
+    * every kind of message: scene transfer, credits, results and the bye
+    * message. Nothing waits for a reply: requests are queued and written
+    * one after the other, while the session keeps reading whatever the
+    * server sends. The session is opened by the first request, and only
+    * opened again if writing on it fails;
+    */
+    void Client::AsyncRequest(Message::Types withType, const std::string & withData, std::uint32_t withChunkID)
+    {
+        std::shared_ptr<PendingRequest> request(new PendingRequest());
+        request->type = withType;
+        request->chunkID = withChunkID;
+        request->body = withData;
+
+        // Callers come from any thread; the session state is only touched on the strand. Every handler holds on to this
+        // Client, which the reconnect timer may drop from the ChunksManager at any moment once it failed
+        m_Strand.post(boost::bind(&Client::QueueRequest, shared_from_this(), request));
+    }
+
+    void Client::QueueRequest(std::shared_ptr<PendingRequest> request)
+    {
+        if (m_WorkerStopped.load(std::memory_order_relaxed) == true)
+        {
+            return;
+        }
+
+        m_WriteQueue.push_back(std::move(*request));
+
+        if (m_SessionConnected)
+        {
+            // Otherwise the write in progress picks it up when it is done
+            if (m_WriteQueue.size() == 1)
+            {
+                WriteRequest();
+            }
+        }
+        else if (!m_SessionStarting)
+        {
+            StartSession();
+        }
+    }
+
+    /**
+    * Starts a DNS resolve query, followed by the connect, initiating
+    * a new session with the server;
     */
-    void Client::AsyncRequest(const std::string & withStatus, const std::string & withData)
+    void Client::StartSession()
     {
         // Try to resolve the IPv4/v6 for the given hostname
         asio::ip::tcp::resolver::query dnsQuery(k_OnServer, "120");
 
-        m_WithStatus = withStatus;
-        m_WithData = withData;
-
         // Go for it
+        m_SessionStarting = true;
         m_CurrentStatus = RESOLVING_DNS;
         m_DnsResolver.async_resolve(dnsQuery,
-            boost::bind(
-                &Client::HandleResolve, this,
+            m_Strand.wrap(boost::bind(
+                &Client::HandleResolve, shared_from_this(),
                 asio::placeholders::error, asio::placeholders::iterator
-            )
+            ))
         );
 
     }
@@ -123,10 +171,10 @@ namespace RayClient
             m_CurrentStatus = CONNECTING_TO_ENDPOINT;
             asio::async_connect(m_TcpSocket,
                 endpointIterator++,
-                boost::bind(
+                m_Strand.wrap(boost::bind(
                     &Client::HandleConnect,
-                    this, asio::placeholders::error
-                )
+                    shared_from_this(), asio::placeholders::error
+                ))
             );
         }
         else
@@ -135,7 +183,7 @@ namespace RayClient
 
             m_CurrentStatus = FAILED_ON_RESOLVE;
 
-            Logger::WriteLog("HandleResolve: Network failed on resolve! Error code is: " + Utils::ToString(errorCode.value()));
+            Logger::WriteLog("HandleResolve: Network failed on resolve! Error code is: " + Utils::ToString(errorCode.value()), Logger::LEVEL_ERROR);
         }
     }
 
@@ -147,24 +195,50 @@ namespace RayClient
             return;
         }
 
+        m_SessionStarting = false;
+
         if (!(errorCode))
         {
-            std::ostream writeOnSocket(&m_RequestBuffer);
-
-            writeOnSocket
-                << m_WithStatus << system::SEPARATOR
-                << m_WithData.size() << system::SEPARATOR
-                << m_WithData << system::SEPARATOR
-                << system::NIX_EOL << system::NIX_EOL;
-
-            m_CurrentStatus = WRITING_TO_SOCKET;
-            asio::async_write(m_TcpSocket,
-                m_RequestBuffer,
-                boost::bind(
-                    &Client::HandleWriteRequest, this,
-                    asio::placeholders::error
-                )
-            );
+            m_SessionConnected = true;
+            m_SessionCarriedMessages = false;
+            m_CurrentStatus = OK_STATUS;
+
+            Logger::WriteLog("Session opened with " + k_OnServer);
+
+            /**
+            * The server knows nothing of a worker on a new session. If the scene is
+            * already here, this replaces a lost session, whether this Client retried
+            * a write or replaced a Client that failed: grant again the credits for
+            * the chunks this worker has room for. The chunks it still holds return
+            * their credits with their results, which go out on this session too.
+            * A grant still queued from the lost session was never received, and this
+            * one replaces it rather than adding to it;
+            */
+            if (m_ChunksManager.m_SceneReceived)
+            {
+                m_WriteQueue.erase(std::remove_if(m_WriteQueue.begin(), m_WriteQueue.end(),
+                    [](const PendingRequest& request) { return request.type == Message::CREDITS; }),
+                    m_WriteQueue.end());
+
+                PendingRequest credits;
+                credits.type = Message::CREDITS;
+                credits.chunkID = m_ChunksManager.GetFreeChunkCredits();
+                m_WriteQueue.push_front(std::move(credits));
+            }
+
+            StartRead();
+
+            if (!m_WriteQueue.empty())
+            {
+                WriteRequest();
+            }
+
+            // One heartbeat for the whole run, whichever session carries it
+            if (!m_HeartbeatStarted)
+            {
+                m_HeartbeatStarted = true;
+                StartHeartbeat();
+            }
         }
         else
         {
@@ -172,10 +246,54 @@ namespace RayClient
 
             m_CurrentStatus = FAILED_ON_CONNECT;
 
-            Logger::WriteLog("HandleConnect: Network failed on connect! Error code is: " + Utils::ToString(errorCode.value()));
+            Logger::WriteLog("HandleConnect: Network failed on connect! Error code is: " + Utils::ToString(errorCode.value()), Logger::LEVEL_ERROR);
         }
     }
 
+    /**
+    * Sends the oldest queued request, header and body with one gathering
+    * write, the body straight from the queue where it stays until written;
+    */
+    void Client::WriteRequest()
+    {
+        const PendingRequest& request = m_WriteQueue.front();
+
+        m_WriteMessage.SetHeader(request.type, request.chunkID, request.body.size());
+
+        asio::async_write(m_TcpSocket,
+            m_WriteMessage.ToBuffers(request.body),
+            m_Strand.wrap(boost::bind(
+                &Client::HandleWriteRequest, shared_from_this(),
+                asio::placeholders::error
+            ))
+        );
+    }
+
+    /**
+    * A session that sat idle may have been dropped by the server or the
+    * network without us noticing. If a write on such a reused session fails,
+    * the server never got the message, so the queue is sent once more on a
+    * brand new session instead of failing the worker;
+    */
+    bool Client::RetryOnNewSession()
+    {
+        if (!m_SessionCarriedMessages || m_RequestRetried)
+        {
+            return false;
+        }
+
+        m_RequestRetried = true;
+        m_SessionConnected = false;
+
+        boost::system::error_code ignoredCode;
+        m_TcpSocket.close(ignoredCode);
+
+        Logger::WriteLog("Session lost, reconnecting to " + k_OnServer, Logger::LEVEL_WARNING);
+
+        StartSession();
+        return true;
+    }
+
     void Client::HandleWriteRequest(const boost::system::error_code &errorCode)
     {
         // Check
@@ -187,27 +305,115 @@ namespace RayClient
         // Check
         if (!(errorCode))
         {
-            // We need to read the socket now
-            m_CurrentStatus = READING_CONTENT;
-
-            asio::async_read_until(m_TcpSocket,
-                m_ResponseBuffer,
-                system::NIX_EOL,
-                boost::bind(
-                    &Client::HandleRead,
-                    this, asio::placeholders::error
-                )
-            );
+            m_SessionCarriedMessages = true;
+            m_RequestRetried = false;
+
+            m_WriteQueue.pop_front();
+
+            if (!m_WriteQueue.empty())
+            {
+                WriteRequest();
+            }
         }
         else
         {
+            if (RetryOnNewSession())
+            {
+                return;
+            }
+
             // Log this down
             HandleStop();
 
             m_CurrentStatus = FAILED_ON_WRITE_TO_SOCKET;
 
-            Logger::WriteLog("HandleWriteRequest: Network failed on write! Error code is: " + Utils::ToString(errorCode.value()));
+            Logger::WriteLog("HandleWriteRequest: Network failed on write! Error code is: " + Utils::ToString(errorCode.value()), Logger::LEVEL_ERROR);
+        }
+    }
+
+    void Client::StartHeartbeat()
+    {
+        m_HeartbeatTimer.expires_from_now(std::chrono::milliseconds(system::HEARTBEAT_MILLISECONDS));
+        m_HeartbeatTimer.async_wait(
+            m_Strand.wrap(boost::bind(
+                &Client::HandleHeartbeat, shared_from_this(),
+                asio::placeholders::error
+            ))
+        );
+    }
+
+    /**
+    * The server leases every chunk to this worker for a few seconds at a time,
+    * and takes it back for another worker unless the lease is renewed. Any
+    * message renews the leases, so a heartbeat only goes out when nothing else
+    * is on its way; the render threads never wait for it;
+    */
+    void Client::HandleHeartbeat(const boost::system::error_code &errorCode)
+    {
+        if (errorCode || m_WorkerStopped.load(std::memory_order_relaxed) == true)
+        {
+            return;
+        }
+
+        if (m_SessionConnected && m_WriteQueue.empty())
+        {
+            PendingRequest heartbeat;
+            heartbeat.type = Message::HEARTBEAT;
+            heartbeat.chunkID = 0;
+            m_WriteQueue.push_back(std::move(heartbeat));
+
+            WriteRequest();
+        }
+
+        StartHeartbeat();
+    }
+
+    // The session reads for as long as it is open, the header of each message first
+    void Client::StartRead()
+    {
+        asio::async_read(m_TcpSocket,
+            m_ReadMessage.HeaderBuffer(),
+            m_Strand.wrap(boost::bind(
+                &Client::HandleReadHeader,
+                shared_from_this(), asio::placeholders::error
+            ))
+        );
+    }
+
+    void Client::HandleReadHeader(const boost::system::error_code &errorCode)
+    {
+        // Check
+        if (m_WorkerStopped.load(std::memory_order_relaxed) == true)
+        {
+            return;
+        }
+
+        if (errorCode == asio::error::operation_aborted && !m_SessionConnected)
+        {
+            // The session was closed to be replaced by a new one, see RetryOnNewSession
+            return;
+        }
+
+        if (errorCode || !m_ReadMessage.DecodeHeader())
+        {
+            // Log this down
+            HandleStop();
+
+            m_CurrentStatus = FAILED_ON_READ;
+
+            Logger::WriteLog("HandleReadHeader: Network failed on reading a message header! Error code is: " + Utils::ToString(errorCode.value()), Logger::LEVEL_ERROR);
+
+            return;
         }
+
+        // Then exactly the body the header announced
+        asio::async_read(m_TcpSocket,
+            m_ReadMessage.BodyBuffer(),
+            m_Strand.wrap(boost::bind(
+                &Client::HandleRead,
+                shared_from_this(), asio::placeholders::error
+            ))
+        );
     }
 
     void Client::HandleRead(const boost::system::error_code &errorCode)
@@ -218,72 +424,88 @@ namespace RayClient
             return;
         }
 
+        if (errorCode == asio::error::operation_aborted && !m_SessionConnected)
+        {
+            // The session was closed to be replaced by a new one, see RetryOnNewSession
+            return;
+        }
+
         // Check
         if (!(errorCode))
         {
-            // Process the response headers
-            std::istream responseBufferStream(&m_ResponseBuffer);
-
-            // We've reading more
-            if (m_ResponseBuffer.size() > 0)
-            {
-                std::ostringstream contentBuffer;
-                contentBuffer << &m_ResponseBuffer;
-                std::string content(contentBuffer.str());
+            const Message::Types messageType = m_ReadMessage.GetType();
+            const std::vector<char>& body = m_ReadMessage.GetBody();
 
-                std::string copyContent(content);
-                std::string status;
-                unsigned int bodySize;
-                std::string bodyContent;
+            // Archives from a server built differently, or damaged on the way, are refused instead of ending the worker
+            std::string invalidArchiveReason;
 
-                status = Utils::GetUntilSeparator(copyContent);
-                if (!status.empty())
+            // Check
+            if (messageType == Message::PIXELS_TO_PROCESS || messageType == Message::PIXELS_TO_DOWNSAMPLE)
+            {
+                try
                 {
-                    std::string bodySizeStr = Utils::GetUntilSeparator(copyContent);
+                    // deserialize straight from the body, without copying it
+                    RayTracer::LoadArchive(body.data(), body.size(), m_ReceivedChunk);
 
-                    if (!bodySizeStr.empty())
-                    {
-                        unsigned int bodySize = std::stoi(bodySizeStr);
+                    m_CurrentStatus = OK_STATUS;
 
-                        bodyContent = Utils::GetUntilSeparator(copyContent);
-                    }
+                    m_ChunksManager.QueueInputPixels(m_ReadMessage.GetChunkID(), m_ReceivedChunk, messageType == Message::PIXELS_TO_DOWNSAMPLE);
 
-                    // Check
-                    if (algo::equals(system::PIXEL_TO_PROCESS, status))
-                    {
-                        m_CurrentStatus = OK_STATUS;
-
-                        m_ReceivedChunk.clear();
+                    Logger::WriteLog("Received new pixels coordinates to process!", Logger::LEVEL_DEBUG);
+                }
+                catch (const ImagerException& exception)
+                {
+                    invalidArchiveReason = exception.GetMessage();
+                }
+                catch (const std::exception& exception)
+                {
+                    // a truncated or corrupted archive
+                    invalidArchiveReason = exception.what();
+                }
+            }
+            else if (messageType == Message::SEND_SCENE)
+            {
+                try
+                {
+                    m_ChunksManager.SaveScene(body);
 
-                        // deserialize
-                        {
-                            std::stringstream objectBuffer(bodyContent);
-                            boost::archive::text_iarchive inArchive(objectBuffer);
-                            inArchive >> m_ReceivedChunk;
-                        }
+                    m_CurrentStatus = OK_STATUS;
 
-                        m_ChunksManager.QueueInputPixels(m_ReceivedChunk);
+                    Logger::WriteLog("Received scene!");
+                }
+                catch (const ImagerException& exception)
+                {
+                    invalidArchiveReason = exception.GetMessage();
+                }
+                catch (const std::exception& exception)
+                {
+                    // a truncated or corrupted archive
+                    invalidArchiveReason = exception.what();
+                }
+            }
+            else if (messageType == Message::BYE_BYE)
+            {
+                m_CurrentStatus = OK_STATUS;
 
-                        Logger::WriteLog("Received new pixels coordinates to process!");
+                m_ChunksManager.StopProcessing();
 
-                    }
-                    else if (algo::equals(system::SEND_SCENE, status))
-                    {
-                        m_CurrentStatus = OK_STATUS;
+                Logger::WriteLog("Job Done!");
 
-                        m_ChunksManager.SaveScene(bodyContent);
+                // The bye message ends the session
+                HandleStop();
+            }
 
-                        Logger::WriteLog("Received scene!");
-                    }
-                    else if (algo::equals(system::BYE_BYE, status))
-                    {
-                        m_CurrentStatus = OK_STATUS;
+            if (!invalidArchiveReason.empty())
+            {
+                HandleStop();
 
-                        m_ChunksManager.m_PixelsProcessDone = true;
+                m_CurrentStatus = FAILED_ON_READ;
 
-                        Logger::WriteLog("Job Done!");
-                    }
-                }
+                Logger::WriteLog("HandleRead: Refused the archive received, session closed: " + invalidArchiveReason, Logger::LEVEL_ERROR);
+            }
+            else if (m_WorkerStopped.load(std::memory_order_relaxed) == false)
+            {
+                StartRead();
             }
         }
         else
@@ -293,7 +515,7 @@ namespace RayClient
 
             m_CurrentStatus = FAILED_ON_READ;
 
-            Logger::WriteLog("HandleRead: Network failed on read! Error code is: " + Utils::ToString(errorCode.value()));
+            Logger::WriteLog("HandleRead: Network failed on read! Error code is: " + Utils::ToString(errorCode.value()), Logger::LEVEL_ERROR);
         }
     }
 
@@ -2,26 +2,313 @@
 
 #include "Requirements.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
 #include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace RayClient
 {
-    void Logger::WriteLog(const std::string &objLog)
+    namespace
     {
-        std::stringstream onStream;
+        struct LogLine
+        {
+            // Global order of the line, across the threads
+            std::uint64_t sequence;
+            std::time_t time;
+            Logger::Levels level;
+            std::string text;
+        };
 
-        onStream << "[RayClient] LOG ## " << "At: "
-            << Utils::GetUTCAsString() << system::HASHTAG
-            << objLog;
+        /**
+         * The lines of one thread on their way to the flusher. Only the owning thread
+         * pushes and only the flusher pops, so the two positions are enough to share
+         * the ring without a lock;
+         */
+        class LogRing
+        {
+        public:
+            LogRing() :
+                m_Lines(system::LOG_RING_LINES),
+                m_Head(0),
+                m_Tail(0),
+                m_DroppedLines(0),
+                m_ThreadExited(false)
+            {
+            }
 
-        std::cout << onStream.str() << std::endl;
+            // False if the ring is full; the flusher has fallen behind
+            bool Push(LogLine& line)
+            {
+                const std::size_t head = m_Head.load(std::memory_order_relaxed);
+                if (head - m_Tail.load(std::memory_order_acquire) == m_Lines.size())
+                {
+                    return false;
+                }
 
-        // Set the stream path
-        std::string debugPath(system::LOG_FILE_PATH);
+                m_Lines[head % m_Lines.size()] = std::move(line);
+                m_Head.store(head + 1, std::memory_order_release);
 
-        std::ofstream onDebug(debugPath.c_str(), std::ios::out | std::ios::ate | std::ios::app);
+                return true;
+            }
 
-        onDebug << onStream.str() << std::endl;
-        onDebug.close();
+            void PopAll(std::vector<LogLine>& lines)
+            {
+                std::size_t tail = m_Tail.load(std::memory_order_relaxed);
+                const std::size_t head = m_Head.load(std::memory_order_acquire);
+
+                for (; tail != head; ++tail)
+                {
+                    lines.push_back(std::move(m_Lines[tail % m_Lines.size()]));
+                }
+
+                m_Tail.store(tail, std::memory_order_release);
+            }
+
+            bool IsEmpty() const
+            {
+                return m_Tail.load(std::memory_order_acquire) == m_Head.load(std::memory_order_acquire);
+            }
+
+        private:
+            std::vector<LogLine> m_Lines;
+            std::atomic<std::size_t> m_Head;
+            std::atomic<std::size_t> m_Tail;
+
+        public:
+            // Lines the owning thread could not log, full ring or rate limit, since the flusher last looked
+            std::atomic<unsigned int> m_DroppedLines;
+
+            // Set once the owning thread is gone; the flusher forgets the ring when it is empty
+            std::atomic<bool> m_ThreadExited;
+        };
+
+        // Allows LOG_LINES_PER_SECOND lines, in bursts of as many, to one thread
+        class RateLimit
+        {
+        public:
+            RateLimit() :
+                m_Tokens(system::LOG_LINES_PER_SECOND),
+                m_LastRefill(std::chrono::steady_clock::now())
+            {
+            }
+
+            bool Allow()
+            {
+                const auto now = std::chrono::steady_clock::now();
+                const double refill = std::chrono::duration<double>(now - m_LastRefill).count() * system::LOG_LINES_PER_SECOND;
+
+                m_Tokens = std::min<double>(m_Tokens + refill, system::LOG_LINES_PER_SECOND);
+                m_LastRefill = now;
+
+                if (m_Tokens < 1.0)
+                {
+                    return false;
+                }
+
+                m_Tokens -= 1.0;
+                return true;
+            }
+
+        private:
+            double m_Tokens;
+            std::chrono::steady_clock::time_point m_LastRefill;
+        };
+
+        /**
+         * Owns the rings of every thread that logged and the thread writing them out.
+         * Started with the first line logged and stopped, after a last flush, when
+         * the program exits;
+         */
+        class LogFlusher
+        {
+        public:
+            LogFlusher() :
+                m_NextSequence(0),
+                m_Stopping(false),
+                m_LogFile(system::LOG_FILE_PATH.c_str(), std::ios::out | std::ios::app)
+            {
+                m_Thread = std::thread(&LogFlusher::Run, this);
+            }
+
+            ~LogFlusher()
+            {
+                {
+                    std::lock_guard<std::mutex> guardLock(m_WakeMutex);
+                    m_Stopping = true;
+                }
+
+                m_Wake.notify_one();
+                m_Thread.join();
+            }
+
+            std::shared_ptr<LogRing> AddRing()
+            {
+                std::shared_ptr<LogRing> ring(new LogRing());
+
+                std::lock_guard<std::mutex> guardLock(m_RingsMutex);
+                m_Rings.push_back(ring);
+
+                return ring;
+            }
+
+            std::uint64_t NextSequence()
+            {
+                return m_NextSequence.fetch_add(1, std::memory_order_relaxed);
+            }
+
+        private:
+            void Run()
+            {
+                std::unique_lock<std::mutex> wakeLock(m_WakeMutex);
+
+                while (!m_Stopping)
+                {
+                    m_Wake.wait_for(wakeLock, std::chrono::milliseconds(system::LOG_FLUSH_MILLISECONDS));
+
+                    wakeLock.unlock();
+                    WriteOut();
+                    wakeLock.lock();
+                }
+
+                // Whatever was logged up to the exit
+                wakeLock.unlock();
+                WriteOut();
+            }
+
+            // Drains every ring and writes the lines out in the order they were logged
+            void WriteOut()
+            {
+                unsigned int droppedLines(0);
+                {
+                    std::lock_guard<std::mutex> guardLock(m_RingsMutex);
+
+                    for (const auto& ring : m_Rings)
+                    {
+                        ring->PopAll(m_Lines);
+                        droppedLines += ring->m_DroppedLines.exchange(0);
+                    }
+
+                    m_Rings.erase(std::remove_if(m_Rings.begin(), m_Rings.end(),
+                        [](const std::shared_ptr<LogRing>& ring) { return ring->m_ThreadExited && ring->IsEmpty(); }), m_Rings.end());
+                }
+
+                if (m_Lines.empty() && droppedLines == 0)
+                {
+                    return;
+                }
+
+                std::sort(m_Lines.begin(), m_Lines.end(),
+                    [](const LogLine& first, const LogLine& second) { return first.sequence < second.sequence; });
+
+                std::string text;
+                for (const auto& line : m_Lines)
+                {
+                    AppendLine(text, line.time, line.level, line.text);
+                }
+                m_Lines.clear();
+
+                if (droppedLines > 0)
+                {
+                    AppendLine(text, std::time(nullptr), Logger::LEVEL_WARNING, Utils::ToString(droppedLines) + " log lines dropped");
+                }
+
+                std::cout << text << std::flush;
+
+                m_LogFile << text;
+                m_LogFile.flush();
+            }
+
+            static void AppendLine(std::string& text, std::time_t time, Logger::Levels level, const std::string& line)
+            {
+                static const char* const levelNames[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+
+                // Only this thread formats times
+                char timeText[32] = { 0 };
+                std::strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", std::gmtime(&time));
+
+                text += "[RayClient] LOG ## At: ";
+                text += timeText;
+                text += system::HASHTAG;
+                if (level != Logger::LEVEL_INFO)
+                {
+                    text += levelNames[level];
+                    text += ": ";
+                }
+                text += line;
+                text += '\n';
+            }
+
+            std::atomic<std::uint64_t> m_NextSequence;
+
+            std::mutex m_RingsMutex;
+            std::vector<std::shared_ptr<LogRing>> m_Rings;
+
+            std::mutex m_WakeMutex;
+            std::condition_variable m_Wake;
+            bool m_Stopping;
+
+            std::vector<LogLine> m_Lines;
+            std::ofstream m_LogFile;
+
+            std::thread m_Thread;
+        };
+
+        LogFlusher& GetFlusher()
+        {
+            static LogFlusher flusher;
+            return flusher;
+        }
+
+        // The ring and the rate limit of the calling thread, made with its first line
+        struct ThreadLog
+        {
+            ThreadLog() :
+                ring(GetFlusher().AddRing())
+            {
+            }
+
+            ~ThreadLog()
+            {
+                ring->m_ThreadExited = true;
+            }
+
+            std::shared_ptr<LogRing> ring;
+            RateLimit rateLimit;
+        };
+    }
+
+    void Logger::WriteLog(const std::string &objLog, Levels level)
+    {
+        if (level < static_cast<Levels>(system::LOG_LEVEL))
+        {
+            return;
+        }
+
+        thread_local ThreadLog threadLog;
+
+        if (level < LEVEL_WARNING && !threadLog.rateLimit.Allow())
+        {
+            ++threadLog.ring->m_DroppedLines;
+            return;
+        }
+
+        LogLine line;
+        line.sequence = GetFlusher().NextSequence();
+        line.time = std::time(nullptr);
+        line.level = level;
+        line.text = objLog;
+
+        if (!threadLog.ring->Push(line))
+        {
+            ++threadLog.ring->m_DroppedLines;
+        }
     }
-}
\ No newline at end of file
+}
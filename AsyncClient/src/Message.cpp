@@ -0,0 +1,138 @@
+#include "Message.h"
+
+#include <cassert>
+
+namespace RayClient
+{
+    namespace
+    {
+        void WriteUInt32(unsigned char* bytes, std::uint32_t value)
+        {
+            bytes[0] = static_cast<unsigned char>(value);
+            bytes[1] = static_cast<unsigned char>(value >> 8);
+            bytes[2] = static_cast<unsigned char>(value >> 16);
+            bytes[3] = static_cast<unsigned char>(value >> 24);
+        }
+
+        std::uint32_t ReadUInt32(const unsigned char* bytes)
+        {
+            return static_cast<std::uint32_t>(bytes[0])
+                | (static_cast<std::uint32_t>(bytes[1]) << 8)
+                | (static_cast<std::uint32_t>(bytes[2]) << 16)
+                | (static_cast<std::uint32_t>(bytes[3]) << 24);
+        }
+    }
+
+    Message::Message() :
+        m_Type(NO_MESSAGE),
+        m_ChunkID(0),
+        m_BodySize(0)
+    {
+        m_Header.fill(0);
+    }
+
+    void Message::SetHeader(Types type, std::uint32_t chunkID, std::size_t bodySize)
+    {
+        // The peer would refuse the header, and sizes past 4 GB do not even fit in it; senders must check first
+        assert(bodySize <= system::MAX_MESSAGE_BODY_SIZE);
+
+        m_Type = type;
+        m_ChunkID = chunkID;
+        m_BodySize = static_cast<std::uint32_t>(bodySize);
+
+        WriteUInt32(&m_Header[0], system::MESSAGE_MAGIC);
+        WriteUInt32(&m_Header[4], m_Type);
+        WriteUInt32(&m_Header[8], m_ChunkID);
+        WriteUInt32(&m_Header[12], m_BodySize);
+    }
+
+    /**
+    * Rejects anything that does not start with our magic number, and bodies
+    * larger than MAX_MESSAGE_BODY_SIZE, so a stray connection or a broken
+    * peer cannot make us allocate an arbitrary amount of memory;
+    */
+    bool Message::DecodeHeader()
+    {
+        if (ReadUInt32(&m_Header[0]) != system::MESSAGE_MAGIC)
+        {
+            return false;
+        }
+
+        m_Type = static_cast<Types>(ReadUInt32(&m_Header[4]));
+        m_ChunkID = ReadUInt32(&m_Header[8]);
+        m_BodySize = ReadUInt32(&m_Header[12]);
+
+        if (m_BodySize > system::MAX_MESSAGE_BODY_SIZE)
+        {
+            return false;
+        }
+
+        // Keeps the capacity, so the buffer only grows
+        m_Body.resize(m_BodySize);
+
+        return true;
+    }
+
+    Message::Types Message::GetType() const
+    {
+        return m_Type;
+    }
+
+    std::uint32_t Message::GetChunkID() const
+    {
+        return m_ChunkID;
+    }
+
+    std::size_t Message::GetBodySize() const
+    {
+        return m_BodySize;
+    }
+
+    std::uint32_t Message::GetCredits() const
+    {
+        return m_ChunkID;
+    }
+
+    asio::mutable_buffers_1 Message::HeaderBuffer()
+    {
+        return asio::buffer(m_Header);
+    }
+
+    asio::mutable_buffers_1 Message::BodyBuffer()
+    {
+        return asio::buffer(m_Body);
+    }
+
+    const std::vector<char>& Message::GetBody() const
+    {
+        return m_Body;
+    }
+
+    std::array<asio::const_buffer, 2> Message::ToBuffers(const std::string& body) const
+    {
+        std::array<asio::const_buffer, 2> buffers =
+        {
+            asio::buffer(m_Header),
+            asio::buffer(body)
+        };
+
+        return buffers;
+    }
+
+    std::string Message::GetTypeName(Types type)
+    {
+        switch (type)
+        {
+            case SEND_SCENE: return "send_scene";
+            case RECEIVED_SCENE: return "received_scene";
+            case PIXELS_TO_PROCESS: return "pixels_to_process";
+            case COMPUTED_PIXELS: return "computed_pixels";
+            case BYE_BYE: return "bye";
+            case PIXELS_TO_DOWNSAMPLE: return "pixels_to_downsample";
+            case CREDITS: return "credits";
+            case HEARTBEAT: return "heartbeat";
+            case REFUSED_CHUNK: return "refused_chunk";
+            default: return "unknown";
+        }
+    }
+}
\ No newline at end of file
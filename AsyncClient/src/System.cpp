@@ -7,6 +7,10 @@ namespace RayClient
     namespace system
     {
         const std::string LOG_FILE_PATH("..\\..\\RAY_CLIENT_LOG.txt"); // Write debug to this file;
+        const unsigned int LOG_LEVEL(1); // Lines below this Logger::Levels are dropped: 0 debug, 1 info, 2 warning, 3 error;
+        const unsigned int LOG_RING_LINES(4096); // Lines one thread may have waiting for the flusher;
+        const unsigned int LOG_FLUSH_MILLISECONDS(50); // How often the flusher writes the waiting lines out;
+        const unsigned int LOG_LINES_PER_SECOND(1000); // Lines below warnings one thread may log, in bursts of as many;
     
         const unsigned int WRITE_BUFFER_SIZE(4096);
 
@@ -18,12 +22,14 @@ namespace RayClient
         const std::string BACKSLASH("/");
         const std::string HASHTAG(" # # ");
         const std::string ALL_DIGITS("0123456789");
-        const std::string PIXEL_TO_PROCESS("pixels_to_process");
-        const std::string SEND_SCENE("send_scene");
-        const std::string COMPUTED_PIXELS("computed_pixels");
-        const std::string RECEIVED_SCENE("received_scene");
-        const std::string SEPARATOR("###");
-        const std::string BYE_BYE("bye");
-        const unsigned int ASYNC_CLIENTS_MAX(4);
+
+        // Protocol
+        const unsigned int MESSAGE_MAGIC(0x54594152); // "RAYT" on the wire, first field of every message header;
+        const unsigned int MAX_MESSAGE_BODY_SIZE(512 * 1024 * 1024); // Larger bodies are taken for a broken peer;
+        const unsigned int CHUNK_CREDITS_PER_RENDER_THREAD(2); // Chunks buffered per render thread, so the next batch is here before the current one is done;
+        const unsigned int HEARTBEAT_MILLISECONDS(1000); // How often an idle session tells the server the worker is alive; the server's lease is 5 seconds;
+
+        // Rendering
+        const bool FLOAT_PIXEL_COLORS(true); // Send computed colors as floats instead of doubles, halving the result payload;
     }
 }
\ No newline at end of file
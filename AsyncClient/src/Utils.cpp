@@ -12,7 +12,6 @@ namespace RayClient
     boost::uuids::basic_random_generator<boost::random::mt19937> Utils::s_OneUuidGenerator;
     const boost::posix_time::ptime Utils::s_ObjEpoch(boost::gregorian::date(1970, 1, 1));
     std::mutex Utils::s_GetUUIDMutex;
-    std::mutex Utils::s_ToStringMutex;
     std::string Utils::s_TimeFormat("%Y-%m-%d %H:%M:%S");
 
     /**
@@ -199,22 +198,4 @@ namespace RayClient
         std::string s(strStream.str());
         return std::vector<char>(s.begin(), s.end());
     }
-
-    std::string Utils::GetUntilSeparator(std::string& input)
-    {
-        size_t separatorPos;
-
-        separatorPos = input.find(system::SEPARATOR);
-
-        if (separatorPos != std::string::npos)
-        {
-            std::string extractedStr = input.substr(0, separatorPos);
-
-            input.erase(input.begin(), input.begin() + separatorPos + system::SEPARATOR.size());
-
-            return extractedStr;
-        }
-
-        return std::string();
-    }
 }
\ No newline at end of file
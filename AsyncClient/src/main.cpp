@@ -18,17 +18,15 @@ int main()
     double zoom = 3;
     size_t antiAliasFactor = 3;
 
+    // Threads that render received chunks, separate from the network threads below.
+    unsigned int renderThreads = std::thread::hardware_concurrency();
+
     boost::asio::io_service ioService;
     std::vector<std::thread> networkThreads;
 
-    std::shared_ptr<RayClient::ChunksManager> chunksManager = std::shared_ptr<RayClient::ChunksManager>(new RayClient::ChunksManager(ioService, serverAdress, pixelsWide, pixelsHigh, zoom, antiAliasFactor));
+    std::shared_ptr<RayClient::ChunksManager> chunksManager = std::shared_ptr<RayClient::ChunksManager>(new RayClient::ChunksManager(ioService, serverAdress, pixelsWide, pixelsHigh, zoom, antiAliasFactor, renderThreads));
 
-    auto firstRequest = chunksManager->TryToAcquireNetworkWorker();
-    
-    if (firstRequest)
-    {
-        firstRequest->AsyncRequest(RayClient::system::SEND_SCENE);
-    }
+    chunksManager->AcquireNetworkWorker()->AsyncRequest(RayClient::Message::SEND_SCENE);
 
     ioService.post(std::bind(&RayClient::ChunksManager::AsyncInputProcessor, chunksManager));
     ioService.post(std::bind(&RayClient::ChunksManager::AsyncOutputProcessor, chunksManager));
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Requirements.h"
+#include "PixelTile.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace RayServer
+{
+    /**
+     * How fast one worker gets through its chunks, measured on the server from
+     * nothing but the times chunks go out and results come back. The worker
+     * renders several chunks at once and sends them back in bursts, so the rate
+     * is taken over whole stretches of at least MIN_RATE_SAMPLE_SECONDS rather
+     * than from one result to the next. The round trip is what is left of a
+     * chunk's turnaround once the work queued on the worker ahead of it, and its
+     * own, are taken out at the measured rate;
+     */
+    class WorkerThroughput
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        WorkerThroughput();
+
+        void OnChunkSent(std::uint32_t chunkID, std::size_t pixels, Clock::time_point now);
+
+        // False for a chunk that was not sent to this worker
+        bool OnResultReceived(std::uint32_t chunkID, Clock::time_point now);
+
+        // A chunk the worker handed back unrendered: no longer outstanding, and not counted in the rate
+        void OnChunkReturned(std::uint32_t chunkID);
+
+        // 0 until the first stretch has been measured
+        double GetPixelsPerSecond() const;
+        double GetLatencySeconds() const;
+
+        // How long until the result of a chunk of 'pixels' sent now is back, with the chunks already out ahead of it; 0 if not known yet
+        double EstimateTurnaroundSeconds(std::size_t pixels) const;
+
+    private:
+        struct SentChunk
+        {
+            Clock::time_point sendTime;
+            std::size_t pixels;
+            std::size_t pixelsAhead;
+        };
+
+        std::map<std::uint32_t, SentChunk> m_SentChunks;
+        std::size_t m_OutstandingPixels;
+
+        // Start of the stretch being measured and the pixels returned in it so far
+        Clock::time_point m_SampleStart;
+        std::size_t m_SamplePixels;
+
+        double m_PixelsPerSecond;
+        double m_LatencySeconds;
+    };
+
+    /**
+     * Cuts the image into chunks on demand, as workers ask for them, instead of
+     * all at once before any worker connects. The region to render is split into
+     * square tiles, and a chunk is a rectangle of whole tiles: a run of tiles along
+     * one row of tiles, or whole rows of tiles at once. Its size follows guided
+     * scheduling: about TARGET_CHUNK_SECONDS of work at the rate of the worker it
+     * goes to (or longer than a round trip to that worker, whichever is more), but
+     * never more than a share of what is left, so chunks are large at the start and
+     * shrink toward the end of the frame, when the workers should all finish
+     * together. Chunk ids count up from 0; there are at most as many chunks as
+     * tiles. Safe to use from any io thread;
+     */
+    class ChunkScheduler
+    {
+    public:
+        /**
+         * 'region' is the part of the image to render, cut in tiles of its tile size;
+         * every pixel of it takes 'samplesPerPixel' rays to trace. 'initialChunkTiles'
+         * is the size of a chunk for a worker not measured yet. With 'fixedChunkTiles'
+         * every chunk has that many tiles, or what is left of the row;
+         */
+        ChunkScheduler(const RayTracer::PixelTile& region, std::size_t samplesPerPixel, std::size_t initialChunkTiles, std::size_t fixedChunkTiles = 0);
+
+        /**
+         * Cuts the next chunk for a worker of the given throughput, while
+         * 'numWorkers' share the rest of the region; false once all of it
+         * has been handed out;
+         */
+        bool NextChunk(const WorkerThroughput& throughput, std::size_t numWorkers, std::uint32_t& chunkID, RayTracer::PixelTile& chunk);
+
+        std::size_t GetNumPixels() const;
+        std::size_t GetSamplesPerPixel() const;
+        std::size_t GetMaxNumOfChunks() const;
+
+    private:
+        std::size_t ChunkTilesFor(const WorkerThroughput& throughput, std::size_t numWorkers, std::size_t remainingTiles) const;
+
+        const RayTracer::PixelTile m_Region;
+        const std::size_t m_SamplesPerPixel;
+        const std::size_t m_InitialChunkTiles;
+        const std::size_t m_FixedChunkTiles;
+
+        const std::size_t m_TileColumns;
+        const std::size_t m_TileRows;
+
+        std::mutex m_Mutex;
+        std::size_t m_NextTileColumn;
+        std::size_t m_NextTileRow;
+        std::size_t m_TilesHandedOut;
+        std::uint32_t m_NextChunkID;
+    };
+}
@@ -1,12 +1,11 @@
 #pragma once
 
 #include "Requirements.h"
+#include "Message.h"
+#include "ChunkScheduler.h"
+#include "PixelRect.h"
 
-namespace RayTracer
-{
-    class PixelData;
-    class PixelCoordinates;
-}
+#include <set>
 
 namespace RayServer
 {
@@ -51,20 +50,73 @@ namespace RayServer
 
         // asio
         asio::ip::tcp::socket m_TcpSocket;
-        asio::streambuf m_RequestBuffer;
-        asio::streambuf m_ResponseBuffer;
+
+        // The io_service runs on several threads; the handlers of one connection run one at a time, through this strand
+        asio::io_service::strand m_Strand;
+
+        // A message waiting to be sent, with its header already filled in
+        struct OutgoingMessage
+        {
+            Message message;
+            std::string body;
+            const std::string* sharedBody = nullptr;
+
+            const std::string& GetBody() const
+            {
+                return sharedBody ? *sharedBody : body;
+            }
+        };
+
+        // Reused for every message of the session
+        Message m_ReadMessage;
+
+        // Sent front to back, one write at a time; the front is the message being written
+        std::deque<OutgoingMessage> m_WriteQueue;
 
         // Methods
         void Start(Server*);
+        void StartRead(Server*);
+        void HandleReadHeader(Server*, const boost::system::error_code&);
         void HandleRead(Server*, const boost::system::error_code&);
-        void HandlePixelRequest(Server*);
-        void HandleSceneRequest(Server*);
-        void HandleBye(Server*);
+        void QueueMessage(Server*, Message::Types, std::uint32_t chunkID, std::string body, const std::string* sharedBody = nullptr);
+        void WriteNext(Server*);
+        void HandleWrite(Server*, const boost::system::error_code&);
+        void SendChunks(Server*);
+        void QueueBye(Server*);
+
+        // Marks the session as over and gives up the leases of the chunks the worker still holds
+        void HandleStop(Server*);
+
+        // Safe to call from any thread; Server::FinishWork says bye to every worker with it
+        void SendBye(Server*);
+
+        // Safe to call from any thread: hands out whatever the worker has room for, copies of chunks still out included
+        void OfferChunks(Server*);
 
         std::atomic<Statuses> m_CurrentStatus;
         bool m_ConnectionStopped;
+        bool m_ByeQueued;
+
+        /**
+         * Credit-based flow control: the number of chunks the worker still has room for.
+         * The worker grants credits with a credits message, and every computed chunk it
+         * sends back returns one; chunks are handed out as long as credits are left, so
+         * the worker always has its next chunks at hand while it renders;
+         */
+        unsigned int m_Credits;
+
+        /**
+         * Chunks the worker handed back because it cannot render them, say with an image size other than the
+         * server's. They are left for the other workers; touched on the strand only, where chunks are handed out;
+         */
+        std::set<std::uint32_t> m_RefusedChunks;
+
+        bool HasRefused(std::uint32_t chunkID) const;
+
+        // Measured from the chunks handed out to this worker, to size its next chunks
+        WorkerThroughput m_Throughput;
 
-        std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>> m_ReceivedChunk;
+        RayTracer::PixelRect m_ReceivedChunk;
 
         std::string m_ClientID;
     };
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+namespace RayServer
+{
+    namespace LoadTests
+    {
+        /**
+         * Measures how fast the server takes in computed pixels with 1, 2, 4... io threads, up to one per hardware thread.
+         * Fake workers on this machine answer every chunk at once with a result made up in advance, so what is timed
+         * is the server's own work: reading the messages, deserializing the results, copying them into the render
+         * target and handing out the next chunks.
+         */
+        void ResultIngestLoadTest(std::size_t numWorkers = 32);
+    }
+}
@@ -4,11 +4,32 @@
 
 namespace RayServer
 {
+    /**
+     * Asynchronous logger. WriteLog() never touches the console or the log file:
+     * it moves the line into a ring buffer owned by the calling thread, which only
+     * that thread writes and only the flusher thread reads, so no lock is taken.
+     * The flusher wakes every LOG_FLUSH_MILLISECONDS, puts the lines of all the
+     * threads back in the order they were logged, and writes them to the console
+     * and to LOG_FILE_PATH, which it keeps open.
+     *
+     * Lines below LOG_LEVEL are dropped before anything else is done with them.
+     * Each thread may log LOG_LINES_PER_SECOND lines below LEVEL_WARNING, with
+     * bursts of as many; past that, and when its ring is full, lines are dropped
+     * and counted rather than waited for, and the flusher reports how many;
+     */
     class Logger
     {
     public:
+        enum Levels
+        {
+            LEVEL_DEBUG = 0,
+            LEVEL_INFO = 1,
+            LEVEL_WARNING = 2,
+            LEVEL_ERROR = 3
+        };
+
         Logger(const std::string& path);
 
-        static void WriteLog(const std::string& message);
+        static void WriteLog(const std::string& message, Levels level = LEVEL_INFO);
     };
-}
\ No newline at end of file
+}
@@ -3,10 +3,15 @@
 #include "Requirements.h"
 #include "RayTracer.h"
 
+#include <chrono>
+#include <map>
+
 namespace RayServer
 {
     class Message;
     class ClientConnection;
+    class ChunkScheduler;
+    class WorkerThroughput;
 
     class Server
     {
@@ -24,13 +29,125 @@ namespace RayServer
         
         std::string m_SerializedScene;
 
-        std::mutex m_InputQueueMutex;
-        std::mutex m_OutputQueueMutex;
-
-        std::deque<std::string> & m_InputQueue;
-        std::deque<std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>>> & m_OutputQueue;
-     
-        std::atomic<unsigned int> m_NumOfNetworkPackages;
+        // Whether the workers anti-alias their chunks and send back final pixels
+        bool m_AntiAliasOnWorkers;
+
+        // Cuts the chunks as the workers ask for them; set by SetWork()
+        std::unique_ptr<ChunkScheduler> m_Scheduler;
+
+        /**
+         * The image being assembled. Each connection copies the pixels it receives straight into it; chunks cover
+         * disjoint regions of the image, so no lock is needed. Likewise the largest color value of each chunk
+         * has its own slot, indexed by chunk id.
+         */
+        RayTracer::ImageBuffer m_RenderTarget;
+        std::vector<double> m_ChunkMaxColorValues;
+
+        std::atomic<size_t> m_NumOfCompletedPixels;
+
+        // A chunk handed out whose result has not come in yet
+        struct AssignedChunk
+        {
+            RayTracer::PixelTile tile;
+            std::string serializedChunk;
+            size_t numTracedPixels;
+
+            // When the last copy was handed out, and when its result is overdue
+            std::chrono::steady_clock::time_point assignTime;
+            std::chrono::steady_clock::time_point deadline;
+
+            // A worker holding a copy of the chunk, for as long as it keeps renewing its lease
+            struct Lease
+            {
+                const ClientConnection* worker;
+                std::chrono::steady_clock::time_point expiry;
+                bool isCopy;
+            };
+
+            // No lease left means nobody renders the chunk any more: it is back in m_RequeuedChunks
+            std::vector<Lease> leases;
+
+            bool IsHeldBy(const ClientConnection* worker) const;
+        };
+
+        /**
+         * Speculative re-execution: chunks whose result is overdue, and once everything has been handed out, any chunk
+         * still out, are handed out again to workers that have room, up to MAX_CHUNK_COPIES copies. Whichever result
+         * comes in first is kept, the others are dropped by chunk id.
+         */
+        std::mutex m_AssignedChunksMutex;
+        std::map<std::uint32_t, AssignedChunk> m_AssignedChunks;
+        std::vector<bool> m_CompletedChunks;
+
+        std::atomic<unsigned int> m_SpeculativeCopies;
+        std::atomic<unsigned int> m_SpeculativeWins;
+        std::atomic<unsigned int> m_DuplicateResults;
+
+        /**
+         * Leases: a worker holds its chunks for LEASE_SECONDS at a time, and every message it sends, heartbeats
+         * included, renews the leases of all of them. A chunk whose last lease expires, or whose last holder closes
+         * its session, goes back here and is handed out again before any new chunk, no copy limit applying.
+         * Guarded by m_AssignedChunksMutex.
+         */
+        std::deque<std::uint32_t> m_RequeuedChunks;
+
+        std::atomic<unsigned int> m_ExpiredLeases;
+        std::atomic<unsigned int> m_ReleasedLeases;
+        std::atomic<unsigned int> m_RequeuedChunksCount;
+        std::atomic<unsigned int> m_RefusedChunksCount;
+
+        // Takes a lease off a chunk, requeueing the chunk if that was its last; m_AssignedChunksMutex must be held
+        void DropLease(std::map<std::uint32_t, AssignedChunk>::iterator assigned, std::vector<AssignedChunk::Lease>::iterator lease);
+
+        // Takes back the lease of a chunk the worker refused, requeueing the chunk if that was its last; the chunk is not handed to it again
+        void ReturnLease(const ClientConnection* worker, std::uint32_t chunkID);
+
+        // Every message from the worker says it is alive: extends the leases of all the chunks it holds
+        void RenewLeases(const ClientConnection* worker);
+
+        // Requeues the chunks of a worker whose session is gone; safe to call more than once
+        void ReleaseLeases(const ClientConnection* worker);
+
+        // Takes back the chunks of the workers that have not been heard of for LEASE_SECONDS
+        void ExpireLeases();
+
+        // Expires leases and offers the workers copies of the chunks still out from time to time, in case nothing else comes in to do so
+        asio::steady_timer m_StragglerTimer;
+
+        void StartStragglerTimer();
+        void HandleStragglerTimer(const boost::system::error_code&);
+
+        // Lets every worker with room left take copies of the chunks still out
+        void OfferChunkCopies();
+
+        /**
+         * Picks the chunk 'worker' should get a copy of: the one overdue the longest, or with 'anyChunk',
+         * the one due the soonest. False if there is none it may take; call with m_AssignedChunksMutex held
+         */
+        bool PickChunkToCopy(const ClientConnection* worker, std::chrono::steady_clock::time_point now, bool anyChunk, std::uint32_t& chunkID);
+
+        /**
+         * Picks the next chunk for 'worker', of the given throughput, and serializes it into 'chunk'; 'numTracedPixels' is
+         * the number of rays it takes to render and 'isCopy' tells a speculative copy of a chunk already out from a new one.
+         * A requeued chunk goes first, then an overdue one, then a new one. False once there is nothing left to hand out
+         * to this worker. Safe to call from any io thread
+         */
+        bool NextChunk(const ClientConnection* worker, const WorkerThroughput& throughput, std::uint32_t& chunkID, std::string& chunk, size_t& numTracedPixels, bool& isCopy);
+
+        /**
+         * Copies the computed pixels of a chunk into the render target and counts the chunk as done. False, and nothing
+         * copied, for the result of a chunk already done; throws for a chunk that is not out or a rectangle that is not the chunk's
+         */
+        bool StoreComputedChunk(const ClientConnection* worker, std::uint32_t chunkID, const RayTracer::PixelRect& computedChunk);
+
+        bool AreAllChunksCompleted() const;
+
+        // Marks the work as done, says bye to every worker and wakes up whoever waits for the image
+        void FinishWork();
+
+        // Every session accepted so far, to say bye to once the work is done
+        std::mutex m_ConnectionsMutex;
+        std::vector<std::weak_ptr<ClientConnection>> m_Connections;
 
         std::mutex & m_WaitOnNetworkDone;
         std::condition_variable & m_NotifyNetworkIsDone;
@@ -38,17 +155,36 @@ namespace RayServer
     public:
 
         Server(asio::io_service& ioService,
-            std::deque<std::string> & inputQueue,
-            std::deque<std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>>> & outputQueue,
+            size_t imagePixelsWide,
+            size_t imagePixelsHigh,
             std::condition_variable & notifyNetworkIsDone,
             std::mutex & waitOnNetworkDone);
 
+        ~Server();
+
         std::atomic<bool> m_IsWorkDone;
 
         void Run();
    
         void LoadScene(const std::string& serializedScene);
 
+        // Set before Run(); the chunks are then rectangles of final pixels
+        void SetAntiAliasOnWorkers(bool antiAliasOnWorkers);
+
+        /**
+         * Set before Run(): the part of the render target to render, cut in tiles of its tile size, each pixel of it
+         * traced with 'samplesPerPixel' rays. It is handed out in chunks of 'initialChunkTiles' tiles until the rate of
+         * a worker is known; with 'fixedChunkTiles' the chunks are not sized to the workers at all.
+         */
+        void SetWork(const RayTracer::PixelTile& region, size_t samplesPerPixel, size_t initialChunkTiles, size_t fixedChunkTiles = 0);
+
         bool IsWorkDone() const;
+
+        // Only to be read once IsWorkDone()
+        const RayTracer::ImageBuffer& GetRenderTarget() const;
+        RayTracer::ImageBuffer& GetRenderTarget();
+
+        // The largest of the color values the workers reported with their chunks
+        double GetMaxColorValue() const;
     };
 }
\ No newline at end of file
@@ -7,18 +7,27 @@ namespace RayServer
     namespace system
     {
         extern const std::string LOG_FILE_PATH;
+        extern const unsigned int LOG_LEVEL;
+        extern const unsigned int LOG_RING_LINES;
+        extern const unsigned int LOG_FLUSH_MILLISECONDS;
+        extern const unsigned int LOG_LINES_PER_SECOND;
         extern const unsigned int WRITE_BUFFER_SIZE;
         extern const std::string NIX_EOL;
         extern const std::string CR;
         extern const std::string BACKSLASH;
         extern const std::string HASHTAG;
         extern const std::string ALL_DIGITS;
-        extern const std::string SEPARATOR;
-        extern const std::string PIXEL_TO_PROCESS;
-        extern const std::string SEND_SCENE;
-        extern const std::string COMPUTED_PIXELS;
-        extern const std::string RECEIVED_SCENE;
-        extern const std::string BYE_BYE;
+        extern const unsigned int MESSAGE_MAGIC;
+        extern const unsigned int MAX_MESSAGE_BODY_SIZE;
+        extern const unsigned int IO_THREADS;
+        extern const double TARGET_CHUNK_SECONDS;
+        extern const unsigned int GUIDED_SCHEDULING_FACTOR;
+        extern const double MIN_RATE_SAMPLE_SECONDS;
+        extern const unsigned int MAX_CHUNK_COPIES;
+        extern const double STRAGGLER_DEADLINE_FACTOR;
+        extern const double MIN_STRAGGLER_SECONDS;
+        extern const unsigned int STRAGGLER_CHECK_MILLISECONDS;
+        extern const double LEASE_SECONDS;
         extern const std::string STOPPED_CONNECTION;
     }
 }
\ No newline at end of file
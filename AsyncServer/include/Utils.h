@@ -24,12 +24,10 @@ namespace RayServer
         static unsigned int GetTZTAsSeconds();
         static std::string GetUTCAsString();
         static bool TryParseStringToUInt(const std::string& stringIn, unsigned int& uIntOut);
-        static std::string GetUntilSeparator(std::string& input);
 
         template<class T>
         static inline std::string ToString(T objVar)
         {
-            std::lock_guard<std::mutex> guardLock(s_ToStringMutex);
             return boost::lexical_cast<std::string> (objVar);
         }
 
@@ -39,7 +37,6 @@ namespace RayServer
         static boost::uuids::basic_random_generator<boost::random::mt19937> s_OneUuidGenerator;
         static const boost::posix_time::ptime s_ObjEpoch;
         static std::mutex s_GetUUIDMutex;
-        static std::mutex s_ToStringMutex;
         static std::string s_TimeFormat;
     };
 }
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "ChunkScheduler.h"
+#include "System.h"
+
+#include <algorithm>
+
+namespace RayServer
+{
+    namespace
+    {
+        // Weight of the newest measurement in the running rate and round trip of a worker
+        const double SMOOTHING = 0.3;
+
+        double Smooth(double average, double sample)
+        {
+            return (average > 0.0) ? average + SMOOTHING * (sample - average) : sample;
+        }
+    }
+
+    WorkerThroughput::WorkerThroughput() :
+        m_OutstandingPixels(0),
+        m_SamplePixels(0),
+        m_PixelsPerSecond(0.0),
+        m_LatencySeconds(0.0)
+    {
+    }
+
+    void WorkerThroughput::OnChunkSent(std::uint32_t chunkID, std::size_t pixels, Clock::time_point now)
+    {
+        // A requeued chunk may come back to the worker that still has it outstanding; only one result will count it off
+        const auto resentChunk = m_SentChunks.find(chunkID);
+        if (resentChunk != m_SentChunks.end())
+        {
+            m_OutstandingPixels -= resentChunk->second.pixels;
+            m_SentChunks.erase(resentChunk);
+        }
+
+        // A worker that had nothing to do starts a new stretch with this chunk
+        if (m_OutstandingPixels == 0)
+        {
+            m_SampleStart = now;
+            m_SamplePixels = 0;
+        }
+
+        SentChunk sentChunk;
+        sentChunk.sendTime = now;
+        sentChunk.pixels = pixels;
+        sentChunk.pixelsAhead = m_OutstandingPixels;
+
+        m_SentChunks[chunkID] = sentChunk;
+        m_OutstandingPixels += pixels;
+    }
+
+    void WorkerThroughput::OnChunkReturned(std::uint32_t chunkID)
+    {
+        const auto sentChunk = m_SentChunks.find(chunkID);
+        if (sentChunk != m_SentChunks.end())
+        {
+            m_OutstandingPixels -= sentChunk->second.pixels;
+            m_SentChunks.erase(sentChunk);
+        }
+    }
+
+    bool WorkerThroughput::OnResultReceived(std::uint32_t chunkID, Clock::time_point now)
+    {
+        const auto sentChunk = m_SentChunks.find(chunkID);
+        if (sentChunk == m_SentChunks.end())
+        {
+            return false;
+        }
+
+        const SentChunk chunk = sentChunk->second;
+        m_SentChunks.erase(sentChunk);
+        m_OutstandingPixels -= chunk.pixels;
+
+        m_SamplePixels += chunk.pixels;
+        const double sampleSeconds = std::chrono::duration<double>(now - m_SampleStart).count();
+        if (sampleSeconds >= system::MIN_RATE_SAMPLE_SECONDS)
+        {
+            m_PixelsPerSecond = Smooth(m_PixelsPerSecond, m_SamplePixels / sampleSeconds);
+
+            m_SampleStart = now;
+            m_SamplePixels = 0;
+        }
+
+        if (m_PixelsPerSecond > 0.0)
+        {
+            const double turnaroundSeconds = std::chrono::duration<double>(now - chunk.sendTime).count();
+            const double renderSeconds = (chunk.pixelsAhead + chunk.pixels) / m_PixelsPerSecond;
+
+            m_LatencySeconds = Smooth(m_LatencySeconds, std::max(turnaroundSeconds - renderSeconds, 0.0));
+        }
+
+        return true;
+    }
+
+    double WorkerThroughput::GetPixelsPerSecond() const
+    {
+        return m_PixelsPerSecond;
+    }
+
+    double WorkerThroughput::GetLatencySeconds() const
+    {
+        return m_LatencySeconds;
+    }
+
+    double WorkerThroughput::EstimateTurnaroundSeconds(std::size_t pixels) const
+    {
+        if (m_PixelsPerSecond <= 0.0)
+        {
+            return 0.0;
+        }
+
+        return (m_OutstandingPixels + pixels) / m_PixelsPerSecond + m_LatencySeconds;
+    }
+
+    ChunkScheduler::ChunkScheduler(const RayTracer::PixelTile& region, std::size_t samplesPerPixel, std::size_t initialChunkTiles, std::size_t fixedChunkTiles) :
+        m_Region(region),
+        m_SamplesPerPixel(std::max<std::size_t>(samplesPerPixel, 1)),
+        m_InitialChunkTiles(std::max<std::size_t>(initialChunkTiles, 1)),
+        m_FixedChunkTiles(fixedChunkTiles),
+        m_TileColumns((region.GetWidth() + region.GetTileSize() - 1) / region.GetTileSize()),
+        m_TileRows((region.GetHeight() + region.GetTileSize() - 1) / region.GetTileSize()),
+        m_NextTileColumn(0),
+        m_NextTileRow(0),
+        m_TilesHandedOut(0),
+        m_NextChunkID(0)
+    {
+    }
+
+    bool ChunkScheduler::NextChunk(const WorkerThroughput& throughput, std::size_t numWorkers, std::uint32_t& chunkID, RayTracer::PixelTile& chunk)
+    {
+        std::lock_guard<std::mutex> guardLock(m_Mutex);
+
+        if (m_NextTileRow >= m_TileRows)
+        {
+            return false;
+        }
+
+        const std::size_t tileSize = m_Region.GetTileSize();
+        const std::size_t numChunkTiles = ChunkTilesFor(throughput, numWorkers, m_TileColumns * m_TileRows - m_TilesHandedOut);
+
+        const std::size_t chunkLeft = m_NextTileColumn * tileSize;
+        const std::size_t chunkTop = m_NextTileRow * tileSize;
+
+        std::size_t chunkTileColumns;
+        std::size_t chunkTileRows;
+
+        if (m_NextTileColumn == 0 && numChunkTiles >= m_TileColumns)
+        {
+            // Whole rows of tiles
+            chunkTileColumns = m_TileColumns;
+            chunkTileRows = std::min(numChunkTiles / m_TileColumns, m_TileRows - m_NextTileRow);
+        }
+        else
+        {
+            // The next tiles of the current row
+            chunkTileColumns = std::min(numChunkTiles, m_TileColumns - m_NextTileColumn);
+            chunkTileRows = 1;
+        }
+
+        chunk = RayTracer::PixelTile(
+            m_Region.GetLeft() + chunkLeft,
+            m_Region.GetTop() + chunkTop,
+            std::min(chunkTileColumns * tileSize, m_Region.GetWidth() - chunkLeft),
+            std::min(chunkTileRows * tileSize, m_Region.GetHeight() - chunkTop),
+            tileSize);
+        chunkID = m_NextChunkID++;
+
+        m_TilesHandedOut += chunkTileColumns * chunkTileRows;
+        m_NextTileColumn += chunkTileColumns;
+        if (m_NextTileColumn == m_TileColumns)
+        {
+            m_NextTileColumn = 0;
+            m_NextTileRow += chunkTileRows;
+        }
+
+        return true;
+    }
+
+    std::size_t ChunkScheduler::ChunkTilesFor(const WorkerThroughput& throughput, std::size_t numWorkers, std::size_t remainingTiles) const
+    {
+        if (m_FixedChunkTiles)
+        {
+            return m_FixedChunkTiles;
+        }
+
+        std::size_t numChunkTiles = m_InitialChunkTiles;
+
+        const double pixelsPerSecond = throughput.GetPixelsPerSecond();
+        if (pixelsPerSecond > 0.0)
+        {
+            // A chunk shorter than the round trip would leave the worker waiting for the next one
+            const double chunkSeconds = std::max(system::TARGET_CHUNK_SECONDS, 2.0 * throughput.GetLatencySeconds());
+            const double tracedPixelsPerTile = static_cast<double>(m_Region.GetTileSize() * m_Region.GetTileSize() * m_SamplesPerPixel);
+
+            numChunkTiles = static_cast<std::size_t>(pixelsPerSecond * chunkSeconds / tracedPixelsPerTile);
+        }
+
+        // Guided scheduling: the fewer tiles are left, the smaller the chunks
+        const std::size_t shares = system::GUIDED_SCHEDULING_FACTOR * std::max<std::size_t>(numWorkers, 1);
+        numChunkTiles = std::min(numChunkTiles, (remainingTiles + shares - 1) / shares);
+
+        return std::max<std::size_t>(numChunkTiles, 1);
+    }
+
+    std::size_t ChunkScheduler::GetNumPixels() const
+    {
+        return m_Region.GetNumPixels();
+    }
+
+    std::size_t ChunkScheduler::GetSamplesPerPixel() const
+    {
+        return m_SamplesPerPixel;
+    }
+
+    std::size_t ChunkScheduler::GetMaxNumOfChunks() const
+    {
+        return m_TileColumns * m_TileRows;
+    }
+}
@@ -4,19 +4,18 @@
 #include "Server.h"
 
 #include <boost/bind.hpp>
-#include <boost/algorithm/string/trim.hpp>
-#include <boost/algorithm/string/predicate.hpp>
 
 #include "Serialization.h"
-
-// Aliasing
-namespace algo = boost::algorithm;
+#include "ArchiveFormat.h"
 
 namespace RayServer
 {
     ClientConnection::ClientConnection(boost::asio::io_service& ios) :
         m_TcpSocket(ios),
+        m_Strand(ios),
         m_ConnectionStopped(false),
+        m_ByeQueued(false),
+        m_Credits(0),
         m_CurrentStatus(NO_STATUS),
         m_ClientID("unkonwn")
     {
@@ -29,259 +28,357 @@ namespace RayServer
 
         m_ClientID = Utils::ToString(m_TcpSocket.remote_endpoint());
 
+        // Through the strand, as the bye message may already be on its way to this connection
+        m_Strand.dispatch(boost::bind(&ClientConnection::StartRead, shared_from_this(), server));
+    }
+
+    /**
+     * Waits for the next message on this session. A worker keeps its session open
+     * for its whole run and never waits for replies, so the connection is always
+     * reading, while the messages for the worker go out through the write queue.
+     * The fixed size header is read first; it tells how long the body is;
+     */
+    void ClientConnection::StartRead(Server* server)
+    {
         m_CurrentStatus = READING_HEADERS;
 
-        // read headers
-        asio::async_read_until(m_TcpSocket,
-            m_ResponseBuffer,
-            system::NIX_EOL,
-            boost::bind(
-                &ClientConnection::HandleRead, shared_from_this(),
+        // read header
+        asio::async_read(m_TcpSocket,
+            m_ReadMessage.HeaderBuffer(),
+            m_Strand.wrap(boost::bind(
+                &ClientConnection::HandleReadHeader, shared_from_this(),
                 server,
                 asio::placeholders::error
-            )
+            ))
         );
     }
 
-    void ClientConnection::HandleRead(Server* server, const boost::system::error_code &errorCode)
+    void ClientConnection::HandleReadHeader(Server* server, const boost::system::error_code &errorCode)
     {
-        if (m_ConnectionStopped)
+        if (errorCode)
         {
-            Logger::WriteLog(m_ClientID + system::HASHTAG + "connection stopped");
+            // The worker closed its session, or the connection failed
+            HandleStop(server);
+
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "session closed");
 
             return;
         }
 
-        // Check
-        if (!(errorCode))
+        if (!m_ReadMessage.DecodeHeader())
         {
-            // Process the response headers
-            std::istream responseBufferStream(&m_ResponseBuffer);
+            HandleStop(server);
+            m_CurrentStatus = FAILED_ON_READ_HEADERS;
 
-            // We've reading more
-            if (m_ResponseBuffer.size() > 0)
-            {
-                std::ostringstream contentBuffer;
-                contentBuffer << &m_ResponseBuffer;
-                std::string content(contentBuffer.str());
-
-                std::string copyContent(content);
-                std::string status;
-                unsigned int bodySize;
-                std::string bodyContent;
-
-                status = Utils::GetUntilSeparator(copyContent);
-                if (!status.empty())
-                {
-                    std::string bodySizeStr = Utils::GetUntilSeparator(copyContent);
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "Failed on reading headers: not a message header, session closed", Logger::LEVEL_WARNING);
 
-                    if (!bodySizeStr.empty())
-                    {
-                        unsigned int bodySize = std::stoi(bodySizeStr);
+            boost::system::error_code ignoredCode;
+            m_TcpSocket.shutdown(asio::ip::tcp::socket::shutdown_both, ignoredCode);
+            m_TcpSocket.close(ignoredCode);
 
-                        bodyContent = Utils::GetUntilSeparator(copyContent);
-                    }
+            return;
+        }
 
-                    if (server->m_IsWorkDone == true)
-                    {
-                        HandleBye(server);
+        m_CurrentStatus = READING_CONTENT;
 
-                        m_ConnectionStopped = true;
+        // read exactly the body announced by the header
+        asio::async_read(m_TcpSocket,
+            m_ReadMessage.BodyBuffer(),
+            m_Strand.wrap(boost::bind(
+                &ClientConnection::HandleRead, shared_from_this(),
+                server,
+                asio::placeholders::error
+            ))
+        );
+    }
 
-                        Logger::WriteLog("Network workers finished processing!");
-                    }
+    void ClientConnection::HandleRead(Server* server, const boost::system::error_code &errorCode)
+    {
+        if (m_ConnectionStopped)
+        {
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "connection stopped", Logger::LEVEL_DEBUG);
 
-                    if (m_CurrentStatus == INPUT_QUEUE_EMPTY)
-                    {
-                        const bool isWorkDone(server->m_NumOfNetworkPackages.load(std::memory_order_relaxed) == server->m_OutputQueue.size());
+            return;
+        }
 
-                        if (isWorkDone)
-                        {
-                            HandleBye(server);
+        if (errorCode)
+        {
+            // The worker closed its session, or the connection failed
+            HandleStop(server);
 
-                            Logger::WriteLog("Network workers finished processing!");
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "session closed");
 
-                            m_ConnectionStopped = true;
+            return;
+        }
 
-                            server->m_IsWorkDone = true;
-                            server->m_NotifyNetworkIsDone.notify_one();
-                        }
-                    }
+        const Message::Types messageType = m_ReadMessage.GetType();
 
-                    if (!m_ConnectionStopped)
-                    {
-                        // Check
-                        if (algo::equals(system::COMPUTED_PIXELS, status))
-                        {
-                            m_CurrentStatus = COMPUTED_PIXELS;
+        // Whatever the worker sends, it is alive and still rendering its chunks
+        server->RenewLeases(this);
 
-                            m_ReceivedChunk.clear();
+        if (messageType == Message::COMPUTED_PIXELS)
+        {
+            m_CurrentStatus = COMPUTED_PIXELS;
 
-                            // deserialize
-                            {
-                                std::stringstream objectBuffer(bodyContent);
-                                boost::archive::text_iarchive inArchive(objectBuffer);
-                                inArchive >> m_ReceivedChunk;
-                            }
+            std::string invalidChunkReason;
 
-                            // save computed chunk
-                            {
-                                std::lock_guard<std::mutex> buffer(server->m_OutputQueueMutex);
-                                server->m_OutputQueue.push_back(m_ReceivedChunk);
-                            }
+            /**
+            * A worker that lost its session sends the results of the chunks it held
+            * on its next one. Those chunks were requeued when the old session closed,
+            * but are still taken if they are not done yet; the server checks the
+            * rectangle against the chunk all the same;
+            */
+            if (!m_Throughput.OnResultReceived(m_ReadMessage.GetChunkID(), WorkerThroughput::Clock::now()))
+            {
+                Logger::WriteLog(m_ClientID + system::HASHTAG + "sent chunk " + Utils::ToString(m_ReadMessage.GetChunkID()) + ", handed out on an earlier session", Logger::LEVEL_WARNING);
+            }
 
-                            HandlePixelRequest(server);
+            try
+            {
+                // deserialize straight from the body, without copying it
+                const std::vector<char>& body = m_ReadMessage.GetBody();
+                RayTracer::LoadArchive(body.data(), body.size(), m_ReceivedChunk);
 
-                            Logger::WriteLog(m_ClientID + system::HASHTAG + "sent computed pixels");
-                        }
-                        else if (algo::equals(system::SEND_SCENE, status))
-                        {
-                            m_CurrentStatus = SENDING_SCENE;
+                // and into its place in the image, unless another copy of the chunk came in first
+                if (!server->StoreComputedChunk(this, m_ReadMessage.GetChunkID(), m_ReceivedChunk))
+                {
+                    Logger::WriteLog(m_ClientID + system::HASHTAG + "sent a duplicate of chunk " + Utils::ToString(m_ReadMessage.GetChunkID()) + ", dropped", Logger::LEVEL_DEBUG);
+                }
+            }
+            catch (const ImagerException& exception)
+            {
+                invalidChunkReason = exception.GetMessage();
+            }
+            catch (const std::exception& exception)
+            {
+                // a truncated or corrupted archive
+                invalidChunkReason = exception.what();
+            }
 
-                            HandleSceneRequest(server);
+            if (!invalidChunkReason.empty())
+            {
+                Logger::WriteLog(m_ClientID + system::HASHTAG + "sent invalid computed pixels: " + invalidChunkReason + ", session closed", Logger::LEVEL_ERROR);
 
-                            Logger::WriteLog(m_ClientID + system::HASHTAG + "sending scene...");
-                        }
-                        else if (algo::equals(system::RECEIVED_SCENE, status))
-                        {
-                            m_CurrentStatus = SCENE_PROPRELY_SENT;
+                HandleStop(server);
 
-                            Logger::WriteLog(m_ClientID + system::HASHTAG + "scene received!");
+                boost::system::error_code ignoredCode;
+                m_TcpSocket.shutdown(asio::ip::tcp::socket::shutdown_both, ignoredCode);
+                m_TcpSocket.close(ignoredCode);
 
-                            HandlePixelRequest(server);
-                        }
-                        else
-                        {
-                            Logger::WriteLog(m_ClientID + system::HASHTAG + "Failed on reading headers: unknown header message");
+                return;
+            }
 
-                            m_CurrentStatus = FAILED_ON_READ_HEADERS;
-                        }
-                    }
-                }
-                else
-                {
-                    Logger::WriteLog(m_ClientID + system::HASHTAG + "Status empty");
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "sent computed pixels of chunk " + Utils::ToString(m_ReadMessage.GetChunkID()), Logger::LEVEL_DEBUG);
 
-                    m_CurrentStatus = FAILED_ON_READ_HEADERS;
-                }
+            if (server->AreAllChunksCompleted())
+            {
+                // Says bye to every worker, this one included
+                server->FinishWork();
             }
             else
             {
-                // Logger::WriteLog(m_ClientID + system::HASHTAG + "Response empty!");
+                // The worker has room for one more chunk now that this one is done
+                ++m_Credits;
+
+                SendChunks(server);
             }
         }
-        else
+        else if (messageType == Message::CREDITS)
         {
-            m_ConnectionStopped = true;
+            m_Credits += m_ReadMessage.GetCredits();
+
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "can take " + Utils::ToString(m_Credits) + " chunks", Logger::LEVEL_DEBUG);
+
+            SendChunks(server);
         }
-    }
+        else if (messageType == Message::REFUSED_CHUNK)
+        {
+            const std::uint32_t chunkID = m_ReadMessage.GetChunkID();
 
-    void ClientConnection::HandlePixelRequest(Server* server)
-    {
-        std::string withData;
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "cannot render chunk " + Utils::ToString(chunkID) + ", handed back; check that the worker renders an image of the server's size", Logger::LEVEL_ERROR);
 
-        // load chunk
+            m_RefusedChunks.insert(chunkID);
+            m_Throughput.OnChunkReturned(chunkID);
+            server->ReturnLease(this, chunkID);
+
+            // The credit the chunk took comes back with it
+            ++m_Credits;
+
+            SendChunks(server);
+        }
+        else if (messageType == Message::HEARTBEAT)
         {
-            std::lock_guard<std::mutex> buffer(server->m_InputQueueMutex);
-            if (!server->m_InputQueue.empty())
-            {
-                withData = server->m_InputQueue.back();
-                server->m_InputQueue.pop_back();
-            }
-            else
-            {
-                m_CurrentStatus = INPUT_QUEUE_EMPTY;
-            }
+            // Nothing more to it than the renewal above
         }
-        
-        if (m_CurrentStatus != INPUT_QUEUE_EMPTY)
+        else if (messageType == Message::SEND_SCENE)
         {
-            std::ostream writeOnSocket(&m_ResponseBuffer);
-
-            writeOnSocket
-                << system::PIXEL_TO_PROCESS << system::SEPARATOR
-                << withData.size() << system::SEPARATOR
-                << withData << system::SEPARATOR
-                << system::NIX_EOL;
-
-            m_CurrentStatus = WRITING_TO_SOCKET;
-
-            asio::async_write(m_TcpSocket,
-                m_ResponseBuffer,
-                boost::bind(
-                    &ClientConnection::HandleRead, shared_from_this(),
-                    server, asio::placeholders::error
-                )
-            );
+            m_CurrentStatus = SENDING_SCENE;
+
+            // The scene is sent straight from the server's copy
+            QueueMessage(server, Message::SEND_SCENE, 0, std::string(), &server->m_SerializedScene);
+
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "sending scene...");
+        }
+        else if (messageType == Message::RECEIVED_SCENE)
+        {
+            m_CurrentStatus = SCENE_PROPRELY_SENT;
+
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "scene received!");
         }
         else
         {
-            bool isWorkDone;
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "Failed on reading headers: unknown message type " + Utils::ToString(static_cast<unsigned int>(messageType)), Logger::LEVEL_WARNING);
 
-            {
-                std::lock_guard<std::mutex> buffer(server->m_InputQueueMutex);
-                isWorkDone = (server->m_NumOfNetworkPackages.load(std::memory_order_relaxed) == server->m_OutputQueue.size());
-            }
+            m_CurrentStatus = FAILED_ON_READ_HEADERS;
+        }
 
-            if (isWorkDone)
-            {
-                HandleBye(server);
+        // The worker does not wait for replies, so keep reading whatever it sends next
+        StartRead(server);
+    }
+
+    /**
+     * Hands out chunks while the worker has room for them, each cut to the
+     * size this worker gets through in about TARGET_CHUNK_SECONDS. Once the
+     * whole region is out, the worker gets copies of the chunks other workers
+     * still render instead; when there is nothing left it may take either, the
+     * credit stays with this connection until a copy or the bye message
+     * comes along;
+     */
+    void ClientConnection::SendChunks(Server* server)
+    {
+        if (m_ConnectionStopped || m_ByeQueued)
+        {
+            return;
+        }
 
-                Logger::WriteLog("Network workers finished processing!");
+        const Message::Types chunkType = server->m_AntiAliasOnWorkers ? Message::PIXELS_TO_DOWNSAMPLE : Message::PIXELS_TO_PROCESS;
 
-                Logger::WriteLog("Construncting image...");
+        std::uint32_t chunkID(0);
+        std::string chunk;
+        size_t numTracedPixels(0);
+        bool isCopy(false);
 
-                m_ConnectionStopped = true;
+        while (m_Credits > 0 && server->NextChunk(this, m_Throughput, chunkID, chunk, numTracedPixels, isCopy))
+        {
+            --m_Credits;
 
-                server->m_IsWorkDone = true;
+            m_Throughput.OnChunkSent(chunkID, numTracedPixels, WorkerThroughput::Clock::now());
 
-                server->m_NotifyNetworkIsDone.notify_one();
-            }
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "gets " + (isCopy ? "a copy of chunk " : "chunk ") + Utils::ToString(chunkID) + " of " + Utils::ToString(numTracedPixels) + " rays", Logger::LEVEL_DEBUG);
+
+            QueueMessage(server, chunkType, chunkID, std::move(chunk));
         }
     }
 
-    void ClientConnection::HandleSceneRequest(Server* server)
+    bool ClientConnection::HasRefused(std::uint32_t chunkID) const
     {
-        std::string withData = server->m_SerializedScene;
+        return m_RefusedChunks.find(chunkID) != m_RefusedChunks.end();
+    }
 
-        std::ostream writeOnSocket(&m_ResponseBuffer);
+    void ClientConnection::OfferChunks(Server* server)
+    {
+        m_Strand.post(boost::bind(&ClientConnection::SendChunks, shared_from_this(), server));
+    }
 
-        writeOnSocket
-            << system::SEND_SCENE << system::SEPARATOR
-            << withData.size() << system::SEPARATOR
-            << withData << system::SEPARATOR
-            << system::NIX_EOL;
+    void ClientConnection::SendBye(Server* server)
+    {
+        m_Strand.post(boost::bind(&ClientConnection::QueueBye, shared_from_this(), server));
+    }
 
-        m_CurrentStatus = WRITING_TO_SOCKET;
-        
-        asio::async_write(m_TcpSocket,
-            m_ResponseBuffer,
-            boost::bind(
-                &ClientConnection::HandleRead, shared_from_this(),
-                server, asio::placeholders::error
-            )
-        );
+    void ClientConnection::QueueBye(Server* server)
+    {
+        if (m_ConnectionStopped || m_ByeQueued)
+        {
+            return;
+        }
+
+        m_ByeQueued = true;
+
+        QueueMessage(server, Message::BYE_BYE, 0, std::string());
+    }
+
+    /**
+     * A worker that is gone, or that we hung up on, renders nothing more: the
+     * chunks it held go back to the server at once, instead of when their
+     * leases run out;
+     */
+    void ClientConnection::HandleStop(Server* server)
+    {
+        if (m_ConnectionStopped)
+        {
+            return;
+        }
+
+        m_ConnectionStopped = true;
+
+        server->ReleaseLeases(this);
     }
 
-    void ClientConnection::HandleBye(Server* server)
+    /**
+     * Messages go out one at a time, in the order they were queued. 'sharedBody',
+     * if given, is sent in place of 'body' and must outlive the connection;
+     */
+    void ClientConnection::QueueMessage(Server* server, Message::Types messageType, std::uint32_t chunkID, std::string body, const std::string* sharedBody)
     {
-        std::ostream writeOnSocket(&m_ResponseBuffer);
+        m_WriteQueue.push_back(OutgoingMessage());
 
-        writeOnSocket
-            << system::BYE_BYE << system::SEPARATOR
-            << system::BYE_BYE.size() << system::SEPARATOR
-            << system::BYE_BYE << system::SEPARATOR
-            << system::NIX_EOL;
+        OutgoingMessage& outgoing = m_WriteQueue.back();
+        outgoing.body.swap(body);
+        outgoing.sharedBody = sharedBody;
+        outgoing.message.SetHeader(messageType, chunkID, outgoing.GetBody().size());
 
-        m_CurrentStatus = WRITING_TO_SOCKET;
+        if (m_WriteQueue.size() == 1)
+        {
+            WriteNext(server);
+        }
+    }
+
+    /**
+     * Sends the header and the body of the oldest queued message with one
+     * gathering write, straight from the queue, where it stays until HandleWrite;
+     */
+    void ClientConnection::WriteNext(Server* server)
+    {
+        const OutgoingMessage& outgoing = m_WriteQueue.front();
 
         asio::async_write(m_TcpSocket,
-            m_ResponseBuffer,
-            boost::bind(
-                &ClientConnection::HandleRead, shared_from_this(),
+            outgoing.message.ToBuffers(outgoing.GetBody()),
+            m_Strand.wrap(boost::bind(
+                &ClientConnection::HandleWrite, shared_from_this(),
                 server, asio::placeholders::error
-            )
+            ))
         );
     }
-}
 
+    void ClientConnection::HandleWrite(Server* server, const boost::system::error_code& errorCode)
+    {
+        if (errorCode)
+        {
+            HandleStop(server);
+
+            Logger::WriteLog(m_ClientID + system::HASHTAG + "failed on write, session closed", Logger::LEVEL_WARNING);
+
+            return;
+        }
+
+        const bool wasBye = (m_WriteQueue.front().message.GetType() == Message::BYE_BYE);
+        m_WriteQueue.pop_front();
+
+        if (wasBye)
+        {
+            // The bye message is the last one on this session
+            HandleStop(server);
+
+            boost::system::error_code ignoredCode;
+            m_TcpSocket.shutdown(asio::ip::tcp::socket::shutdown_both, ignoredCode);
+            m_TcpSocket.close(ignoredCode);
+
+            return;
+        }
+
+        if (!m_WriteQueue.empty())
+        {
+            WriteNext(server);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "LoadTests.h"
+#include "Server.h"
+#include "Message.h"
+#include "ChunkScheduler.h"
+
+#include "ArchiveFormat.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace RayServer
+{
+    namespace LoadTests
+    {
+        namespace
+        {
+            // The chunks of an 800 x 600 image anti-aliased 3 times on the server: 8 tiles of 60 x 60 oversampled pixels each
+            const std::size_t LARGE_PIXELS_WIDE = 2400;
+            const std::size_t LARGE_PIXELS_HIGH = 1800;
+            const std::size_t TILE_SIZE = 60;
+            const std::size_t TILES_PER_CHUNK = 8;
+            const std::uint32_t WORKER_CREDITS = 2;
+
+            RayTracer::PixelTile WholeImage()
+            {
+                return RayTracer::PixelTile(0, 0, LARGE_PIXELS_WIDE, LARGE_PIXELS_HIGH, TILE_SIZE);
+            }
+
+            void WriteMessage(asio::ip::tcp::socket& socket, Message& message, Message::Types type, std::uint32_t chunkID, const std::string& body)
+            {
+                message.SetHeader(type, chunkID, body.size());
+                asio::write(socket, message.ToBuffers(body));
+            }
+
+            bool ReadMessage(asio::ip::tcp::socket& socket, Message& message)
+            {
+                asio::read(socket, message.HeaderBuffer());
+                if (!message.DecodeHeader())
+                {
+                    return false;
+                }
+
+                asio::read(socket, message.BodyBuffer());
+                return true;
+            }
+
+            /**
+            * A worker that already has the scene: it grants a few credits and
+            * answers every chunk with its result, until the server says bye or
+            * closes the session;
+            */
+            void FakeWorker(const std::vector<std::string>& results)
+            {
+                asio::io_service ioService;
+                asio::ip::tcp::socket socket(ioService);
+
+                Message readMessage;
+                Message writeMessage;
+
+                try
+                {
+                    socket.connect(asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 120));
+
+                    WriteMessage(socket, writeMessage, Message::RECEIVED_SCENE, 0, std::string());
+                    WriteMessage(socket, writeMessage, Message::CREDITS, WORKER_CREDITS, std::string());
+
+                    while (ReadMessage(socket, readMessage) && readMessage.GetType() == Message::PIXELS_TO_PROCESS)
+                    {
+                        WriteMessage(socket, writeMessage, Message::COMPUTED_PIXELS, readMessage.GetChunkID(), results.at(readMessage.GetChunkID()));
+                    }
+                }
+                catch (const boost::system::system_error&)
+                {
+                    // The server closed the session once the work was done
+                }
+            }
+
+            // Returns the time from starting the server to the last result being in the render target
+            double IngestAllChunks(unsigned int ioThreads, std::size_t numWorkers, const std::vector<std::string>& results)
+            {
+                std::condition_variable notifyNetworkIsDone;
+                std::mutex waitOnNetworkDone;
+
+                std::vector<std::thread> workers;
+                double seconds;
+
+                {
+                    asio::io_service ioService;
+                    Server server(ioService, LARGE_PIXELS_WIDE, LARGE_PIXELS_HIGH, notifyNetworkIsDone, waitOnNetworkDone);
+
+                    // Chunks of a fixed size, so that chunk id i is the rectangle of results[i]
+                    server.SetWork(WholeImage(), 1, TILES_PER_CHUNK, TILES_PER_CHUNK);
+
+                    const auto start = std::chrono::steady_clock::now();
+
+                    server.Run();
+
+                    std::vector<std::thread> networkThreads;
+                    for (unsigned int i = 0; i < ioThreads; ++i)
+                    {
+                        networkThreads.push_back(std::thread(std::bind(static_cast<size_t(asio::io_service::*) ()> (&asio::io_service::run), std::ref(ioService))));
+                    }
+
+                    for (std::size_t i = 0; i < numWorkers; ++i)
+                    {
+                        workers.push_back(std::thread(FakeWorker, std::cref(results)));
+                    }
+
+                    {
+                        std::unique_lock<std::mutex> guardLock(waitOnNetworkDone);
+                        notifyNetworkIsDone.wait(guardLock, [&server] { return server.IsWorkDone(); });
+                    }
+
+                    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                    ioService.stop();
+                    for (auto& networkThread : networkThreads)
+                    {
+                        networkThread.join();
+                    }
+                }
+
+                // Destroying the io_service closed the sessions still open, which lets the remaining workers go
+                for (auto& worker : workers)
+                {
+                    worker.join();
+                }
+
+                return seconds;
+            }
+        }
+
+        void ResultIngestLoadTest(std::size_t numWorkers)
+        {
+            using namespace RayTracer;
+
+            std::mt19937 generator(12345);
+            std::uniform_real_distribution<double> intensity(0.0, 1.0);
+
+            std::vector<std::string> results;
+            std::size_t resultBytes = 0;
+
+            // The server cuts its chunks the same way
+            ChunkScheduler scheduler(WholeImage(), 1, TILES_PER_CHUNK, TILES_PER_CHUNK);
+            const WorkerThroughput unmeasured;
+
+            std::uint32_t chunkID(0);
+            PixelTile chunk;
+            while (scheduler.NextChunk(unmeasured, numWorkers, chunkID, chunk))
+            {
+                std::vector<PixelData> pixels(chunk.GetNumPixels());
+                for (auto& pixel : pixels)
+                {
+                    pixel.color = Color(intensity(generator), intensity(generator), intensity(generator));
+                }
+                results.push_back(SaveArchive(PixelRect(chunk.GetLeft(), chunk.GetTop(), chunk.GetWidth(), chunk.GetHeight(), pixels, true)));
+                resultBytes += results.back().size();
+            }
+
+            const unsigned int maxIoThreads = std::max(std::thread::hardware_concurrency(), 2u);
+
+            std::cout << results.size() << " results of " << (resultBytes / results.size()) << " bytes from " << numWorkers << " workers:" << std::endl;
+
+            for (unsigned int ioThreads = 1; ioThreads <= maxIoThreads; ioThreads *= 2)
+            {
+                const double seconds = IngestAllChunks(ioThreads, numWorkers, results);
+
+                std::cout << "    " << ioThreads << " io thread(s): " << (results.size() / seconds) << " chunks/s, "
+                    << (resultBytes / seconds / (1024.0 * 1024.0)) << " MB/s" << std::endl;
+            }
+        }
+    }
+}
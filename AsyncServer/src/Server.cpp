@@ -1,41 +1,87 @@
 #include "Server.h"
 #include "Logger.h"
+#include "Utils.h"
 #include "ClientConnection.h"
+#include "ChunkScheduler.h"
+#include "ArchiveFormat.h"
 
+#include <algorithm>
 #include <iostream>
 
 namespace RayServer
 {
     Server::Server(asio::io_service& ioService,
-        std::deque<std::string> & inputQueue,
-        std::deque<std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>>> & outputQueue,
+        size_t imagePixelsWide,
+        size_t imagePixelsHigh,
         std::condition_variable & notifyNetworkIsDone,
         std::mutex & waitOnNetworkDone) :
             mIoService(ioService),
             mAcceptor(ioService, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), 120)),
-            m_InputQueue(inputQueue),
-            m_OutputQueue(outputQueue),
-            m_NumOfNetworkPackages(0),
+            m_AntiAliasOnWorkers(false),
+            m_RenderTarget(imagePixelsWide, imagePixelsHigh),
+            m_NumOfCompletedPixels(0),
+            m_SpeculativeCopies(0),
+            m_SpeculativeWins(0),
+            m_DuplicateResults(0),
+            m_ExpiredLeases(0),
+            m_ReleasedLeases(0),
+            m_RequeuedChunksCount(0),
+            m_RefusedChunksCount(0),
+            m_StragglerTimer(ioService),
             m_IsWorkDone(false),
             m_NotifyNetworkIsDone(notifyNetworkIsDone),
             m_WaitOnNetworkDone(waitOnNetworkDone)
     {
     }
 
+    Server::~Server()
+    {
+    }
+
     void Server::LoadScene(const std::string& serializedScene)
     {
+        // Workers take a larger message for a broken peer and drop the session, so refuse it here, where it can be told why
+        if (serializedScene.size() > system::MAX_MESSAGE_BODY_SIZE)
+        {
+            Logger::WriteLog("The serialized scene is " + Utils::ToString(serializedScene.size()) + " bytes, more than the " +
+                Utils::ToString(system::MAX_MESSAGE_BODY_SIZE) + " bytes a message may carry.", Logger::LEVEL_ERROR);
+            throw ImagerException("The serialized scene is too large to send to the workers.");
+        }
+
         m_SerializedScene = serializedScene;
         Logger::WriteLog("Serialized scene loaded.");
     }
 
+    void Server::SetAntiAliasOnWorkers(bool antiAliasOnWorkers)
+    {
+        m_AntiAliasOnWorkers = antiAliasOnWorkers;
+    }
+
+    void Server::SetWork(const RayTracer::PixelTile& region, size_t samplesPerPixel, size_t initialChunkTiles, size_t fixedChunkTiles)
+    {
+        if (region.GetLeft() + region.GetWidth() > m_RenderTarget.GetPixelsWide() || region.GetTop() + region.GetHeight() > m_RenderTarget.GetPixelsHigh())
+        {
+            throw ImagerException("The region to render does not fit in the image.");
+        }
+
+        m_Scheduler.reset(new ChunkScheduler(region, samplesPerPixel, initialChunkTiles, fixedChunkTiles));
+    }
+
     void Server::Run()
     {
+        if (!m_Scheduler)
+        {
+            throw ImagerException("The server was started without any work to hand out.");
+        }
+
         Logger::WriteLog("Server started...");
         Logger::WriteLog("Using port: 120");
 
-        m_NumOfNetworkPackages = m_InputQueue.size();
+        m_ChunkMaxColorValues.assign(m_Scheduler->GetMaxNumOfChunks(), 0.0);
+        m_CompletedChunks.assign(m_Scheduler->GetMaxNumOfChunks(), false);
 
         StartAccept();
+        StartStragglerTimer();
     }
 
     void Server::StartAccept()
@@ -57,6 +103,22 @@ namespace RayServer
     {
         if (!errorCode)
         {
+            {
+                std::lock_guard<std::mutex> guardLock(m_ConnectionsMutex);
+
+                // Forget the sessions that are gone
+                m_Connections.erase(std::remove_if(m_Connections.begin(), m_Connections.end(),
+                    [](const std::weak_ptr<ClientConnection>& session) { return session.expired(); }), m_Connections.end());
+
+                m_Connections.push_back(connection);
+
+                // A worker that connects after the end only gets the bye message
+                if (m_IsWorkDone)
+                {
+                    connection->SendBye(this);
+                }
+            }
+
             connection->Start(this);
 
             // start accepting the next client
@@ -72,4 +134,401 @@ namespace RayServer
     {
         return m_IsWorkDone;
     }
+
+    namespace
+    {
+        // How long a worker of the given throughput may take over a chunk before its result is overdue
+        std::chrono::steady_clock::duration StragglerDeadline(const WorkerThroughput& throughput, size_t numTracedPixels)
+        {
+            const double seconds = std::max(system::MIN_STRAGGLER_SECONDS, system::STRAGGLER_DEADLINE_FACTOR * throughput.EstimateTurnaroundSeconds(numTracedPixels));
+
+            return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+        }
+
+        std::chrono::steady_clock::time_point LeaseExpiry(std::chrono::steady_clock::time_point now)
+        {
+            return now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(system::LEASE_SECONDS));
+        }
+    }
+
+    bool Server::AssignedChunk::IsHeldBy(const ClientConnection* worker) const
+    {
+        return std::any_of(leases.begin(), leases.end(), [worker](const Lease& lease) { return lease.worker == worker; });
+    }
+
+    bool Server::NextChunk(const ClientConnection* worker, const WorkerThroughput& throughput, std::uint32_t& chunkID, std::string& chunk, size_t& numTracedPixels, bool& isCopy)
+    {
+        const auto now = std::chrono::steady_clock::now();
+
+        // Hands out the chunk picked once more, to be rendered again from scratch or as a copy; m_AssignedChunksMutex must be held
+        auto handOut = [&](bool asCopy)
+        {
+            AssignedChunk& assigned = m_AssignedChunks[chunkID];
+            assigned.leases.push_back(AssignedChunk::Lease{ worker, LeaseExpiry(now), asCopy });
+            assigned.assignTime = now;
+            assigned.deadline = now + StragglerDeadline(throughput, assigned.numTracedPixels);
+
+            chunk = assigned.serializedChunk;
+            numTracedPixels = assigned.numTracedPixels;
+            isCopy = asCopy;
+
+            if (asCopy)
+            {
+                ++m_SpeculativeCopies;
+            }
+        };
+
+        {
+            std::lock_guard<std::mutex> guardLock(m_AssignedChunksMutex);
+
+            // A chunk nobody holds any more goes first; it may have come in since it was requeued
+            for (auto requeued = m_RequeuedChunks.begin(); requeued != m_RequeuedChunks.end();)
+            {
+                chunkID = *requeued;
+
+                // Left for another worker
+                if (worker->HasRefused(chunkID))
+                {
+                    ++requeued;
+                    continue;
+                }
+
+                requeued = m_RequeuedChunks.erase(requeued);
+
+                const auto assigned = m_AssignedChunks.find(chunkID);
+                if (assigned != m_AssignedChunks.end() && assigned->second.leases.empty())
+                {
+                    handOut(false);
+                    return true;
+                }
+            }
+
+            // An overdue chunk goes before new ones: the worker that has it may be stuck
+            if (PickChunkToCopy(worker, now, false, chunkID))
+            {
+                handOut(true);
+                return true;
+            }
+        }
+
+        // The workers still connected share what is left of the image
+        size_t numWorkers(0);
+        {
+            std::lock_guard<std::mutex> guardLock(m_ConnectionsMutex);
+
+            numWorkers = std::count_if(m_Connections.begin(), m_Connections.end(),
+                [](const std::weak_ptr<ClientConnection>& session) { return !session.expired(); });
+        }
+
+        RayTracer::PixelTile tile;
+        if (m_Scheduler->NextChunk(throughput, numWorkers, chunkID, tile))
+        {
+            AssignedChunk assigned;
+            assigned.tile = tile;
+            assigned.serializedChunk = RayTracer::SaveArchive(tile);
+            assigned.numTracedPixels = tile.GetNumPixels() * m_Scheduler->GetSamplesPerPixel();
+            assigned.assignTime = now;
+            assigned.deadline = now + StragglerDeadline(throughput, assigned.numTracedPixels);
+            assigned.leases.push_back(AssignedChunk::Lease{ worker, LeaseExpiry(now), false });
+
+            chunk = assigned.serializedChunk;
+            numTracedPixels = assigned.numTracedPixels;
+            isCopy = false;
+
+            std::lock_guard<std::mutex> guardLock(m_AssignedChunksMutex);
+            m_AssignedChunks[chunkID] = std::move(assigned);
+
+            return true;
+        }
+
+        // Everything has been handed out: rather than wait, race the workers still rendering the last chunks
+        std::lock_guard<std::mutex> guardLock(m_AssignedChunksMutex);
+
+        if (PickChunkToCopy(worker, now, true, chunkID))
+        {
+            handOut(true);
+            return true;
+        }
+
+        return false;
+    }
+
+    bool Server::PickChunkToCopy(const ClientConnection* worker, std::chrono::steady_clock::time_point now, bool anyChunk, std::uint32_t& chunkID)
+    {
+        bool found(false);
+        std::chrono::steady_clock::time_point earliestDeadline;
+
+        for (const auto& assigned : m_AssignedChunks)
+        {
+            const AssignedChunk& chunk = assigned.second;
+
+            // A chunk without leases is requeued, and handed out from there
+            if (chunk.leases.empty() || chunk.leases.size() >= system::MAX_CHUNK_COPIES || (!anyChunk && now < chunk.deadline)
+                || chunk.IsHeldBy(worker) || worker->HasRefused(assigned.first))
+            {
+                continue;
+            }
+
+            if (!found || chunk.deadline < earliestDeadline)
+            {
+                found = true;
+                earliestDeadline = chunk.deadline;
+                chunkID = assigned.first;
+            }
+        }
+
+        return found;
+    }
+
+    /**
+    * Runs on the connection that received the chunk, concurrently with the
+    * other connections. Copies of one chunk may come in at the same time on
+    * two connections, so the chunk is claimed under the lock first; past that,
+    * only the pixels and the slot of this chunk are touched;
+    */
+    bool Server::StoreComputedChunk(const ClientConnection* worker, std::uint32_t chunkID, const RayTracer::PixelRect& computedChunk)
+    {
+        computedChunk.CheckPayload();
+
+        bool isCopyResult(false);
+        {
+            std::lock_guard<std::mutex> guardLock(m_AssignedChunksMutex);
+
+            const auto assigned = m_AssignedChunks.find(chunkID);
+            if (assigned == m_AssignedChunks.end())
+            {
+                if (chunkID < m_CompletedChunks.size() && m_CompletedChunks[chunkID])
+                {
+                    // Another copy of the chunk came in first
+                    ++m_DuplicateResults;
+                    return false;
+                }
+
+                throw ImagerException("Received computed pixels for an unknown chunk.");
+            }
+
+            const RayTracer::PixelTile& tile = assigned->second.tile;
+            if (computedChunk.GetLeft() != tile.GetLeft() || computedChunk.GetTop() != tile.GetTop()
+                || computedChunk.GetWidth() != tile.GetWidth() || computedChunk.GetHeight() != tile.GetHeight())
+            {
+                throw ImagerException("Received computed pixels that do not cover their chunk.");
+            }
+
+            // A worker whose lease expired may still deliver; the chunk is done all the same
+            const auto& leases = assigned->second.leases;
+            isCopyResult = std::any_of(leases.begin(), leases.end(),
+                [worker](const AssignedChunk::Lease& lease) { return lease.worker == worker && lease.isCopy; });
+
+            m_CompletedChunks[chunkID] = true;
+            m_AssignedChunks.erase(assigned);
+        }
+
+        if (isCopyResult)
+        {
+            ++m_SpeculativeWins;
+        }
+
+        computedChunk.CopyTo(m_RenderTarget);
+        m_ChunkMaxColorValues[chunkID] = computedChunk.GetMaxColorValue();
+
+        // Counted last, so that whoever sees the final count also sees every pixel
+        m_NumOfCompletedPixels += computedChunk.GetNumPixels();
+
+        return true;
+    }
+
+    void Server::DropLease(std::map<std::uint32_t, AssignedChunk>::iterator assigned, std::vector<AssignedChunk::Lease>::iterator lease)
+    {
+        assigned->second.leases.erase(lease);
+
+        if (assigned->second.leases.empty())
+        {
+            m_RequeuedChunks.push_back(assigned->first);
+            ++m_RequeuedChunksCount;
+        }
+    }
+
+    void Server::ReturnLease(const ClientConnection* worker, std::uint32_t chunkID)
+    {
+        {
+            std::lock_guard<std::mutex> guardLock(m_AssignedChunksMutex);
+
+            // The chunk may be done already, by a copy on another worker
+            const auto assigned = m_AssignedChunks.find(chunkID);
+            if (assigned != m_AssignedChunks.end())
+            {
+                auto& leases = assigned->second.leases;
+                const auto lease = std::find_if(leases.begin(), leases.end(),
+                    [worker](const AssignedChunk::Lease& held) { return held.worker == worker; });
+
+                if (lease != leases.end())
+                {
+                    DropLease(assigned, lease);
+                }
+            }
+
+            ++m_RefusedChunksCount;
+        }
+
+        // Another worker may have room for it
+        if (!m_IsWorkDone)
+        {
+            OfferChunkCopies();
+        }
+    }
+
+    void Server::RenewLeases(const ClientConnection* worker)
+    {
+        const auto expiry = LeaseExpiry(std::chrono::steady_clock::now());
+
+        std::lock_guard<std::mutex> guardLock(m_AssignedChunksMutex);
+        for (auto& assigned : m_AssignedChunks)
+        {
+            for (auto& lease : assigned.second.leases)
+            {
+                if (lease.worker == worker)
+                {
+                    lease.expiry = expiry;
+                }
+            }
+        }
+    }
+
+    void Server::ReleaseLeases(const ClientConnection* worker)
+    {
+        {
+            std::lock_guard<std::mutex> guardLock(m_AssignedChunksMutex);
+            for (auto assigned = m_AssignedChunks.begin(); assigned != m_AssignedChunks.end(); ++assigned)
+            {
+                auto& leases = assigned->second.leases;
+                const auto lease = std::find_if(leases.begin(), leases.end(),
+                    [worker](const AssignedChunk::Lease& held) { return held.worker == worker; });
+
+                if (lease != leases.end())
+                {
+                    DropLease(assigned, lease);
+                    ++m_ReleasedLeases;
+                }
+            }
+        }
+
+        // The workers still connected may have room for the chunks just requeued
+        if (!m_IsWorkDone)
+        {
+            OfferChunkCopies();
+        }
+    }
+
+    void Server::ExpireLeases()
+    {
+        const auto now = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> guardLock(m_AssignedChunksMutex);
+        for (auto assigned = m_AssignedChunks.begin(); assigned != m_AssignedChunks.end(); ++assigned)
+        {
+            auto& leases = assigned->second.leases;
+            for (size_t lease = 0; lease < leases.size();)
+            {
+                if (leases[lease].expiry > now)
+                {
+                    ++lease;
+                    continue;
+                }
+
+                Logger::WriteLog("Lease on chunk " + Utils::ToString(assigned->first) + " expired", Logger::LEVEL_WARNING);
+
+                DropLease(assigned, leases.begin() + lease);
+                ++m_ExpiredLeases;
+            }
+        }
+    }
+
+    void Server::StartStragglerTimer()
+    {
+        m_StragglerTimer.expires_from_now(std::chrono::milliseconds(system::STRAGGLER_CHECK_MILLISECONDS));
+        m_StragglerTimer.async_wait(boost::bind(&Server::HandleStragglerTimer, this, asio::placeholders::error));
+    }
+
+    void Server::HandleStragglerTimer(const boost::system::error_code& errorCode)
+    {
+        if (errorCode || m_IsWorkDone)
+        {
+            return;
+        }
+
+        ExpireLeases();
+        OfferChunkCopies();
+
+        StartStragglerTimer();
+    }
+
+    void Server::OfferChunkCopies()
+    {
+        std::lock_guard<std::mutex> guardLock(m_ConnectionsMutex);
+        for (const auto& session : m_Connections)
+        {
+            if (auto connection = session.lock())
+            {
+                connection->OfferChunks(this);
+            }
+        }
+    }
+
+    bool Server::AreAllChunksCompleted() const
+    {
+        return m_NumOfCompletedPixels.load() >= m_Scheduler->GetNumPixels();
+    }
+
+    void Server::FinishWork()
+    {
+        // Set under the lock the image thread waits with, so the notification cannot slip in between its check and its wait
+        {
+            std::lock_guard<std::mutex> guardLock(m_WaitOnNetworkDone);
+            if (m_IsWorkDone)
+            {
+                return;
+            }
+            m_IsWorkDone = true;
+        }
+
+        Logger::WriteLog("Network workers finished processing!");
+        Logger::WriteLog("Speculative copies of chunks handed out: " + Utils::ToString(m_SpeculativeCopies.load()) + ", won: " + Utils::ToString(m_SpeculativeWins.load())
+            + ", duplicate results dropped: " + Utils::ToString(m_DuplicateResults.load()));
+        Logger::WriteLog("Leases expired: " + Utils::ToString(m_ExpiredLeases.load()) + ", released by closed sessions: " + Utils::ToString(m_ReleasedLeases.load())
+            + ", chunks requeued: " + Utils::ToString(m_RequeuedChunksCount.load()) + ", chunks refused by workers: " + Utils::ToString(m_RefusedChunksCount.load()));
+        Logger::WriteLog("Construncting image...");
+
+        m_NotifyNetworkIsDone.notify_one();
+
+        std::lock_guard<std::mutex> guardLock(m_ConnectionsMutex);
+        for (const auto& session : m_Connections)
+        {
+            if (auto connection = session.lock())
+            {
+                connection->SendBye(this);
+            }
+        }
+    }
+
+    const RayTracer::ImageBuffer& Server::GetRenderTarget() const
+    {
+        return m_RenderTarget;
+    }
+
+    RayTracer::ImageBuffer& Server::GetRenderTarget()
+    {
+        return m_RenderTarget;
+    }
+
+    double Server::GetMaxColorValue() const
+    {
+        double maxColorValue = 0.0;
+
+        for (const double chunkMaxColorValue : m_ChunkMaxColorValues)
+        {
+            maxColorValue = std::max(maxColorValue, chunkMaxColorValue);
+        }
+
+        return maxColorValue;
+    }
 }
\ No newline at end of file
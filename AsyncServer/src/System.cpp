@@ -7,6 +7,10 @@ namespace RayServer
     namespace system
     {
         const std::string LOG_FILE_PATH("..\\..\\RAY_SERVER_LOG.txt"); // Write debug to this file;
+        const unsigned int LOG_LEVEL(1); // Lines below this Logger::Levels are dropped: 0 debug, 1 info, 2 warning, 3 error;
+        const unsigned int LOG_RING_LINES(4096); // Lines one thread may have waiting for the flusher;
+        const unsigned int LOG_FLUSH_MILLISECONDS(50); // How often the flusher writes the waiting lines out;
+        const unsigned int LOG_LINES_PER_SECOND(1000); // Lines below warnings one thread may log, in bursts of as many;
 
         const unsigned int WRITE_BUFFER_SIZE(4096);
 
@@ -18,11 +22,26 @@ namespace RayServer
         const std::string BACKSLASH("/");
         const std::string HASHTAG(" # # ");
         const std::string ALL_DIGITS("0123456789");
-        const std::string PIXEL_TO_PROCESS("pixels_to_process");
-        const std::string SEND_SCENE("send_scene");
-        const std::string COMPUTED_PIXELS("computed_pixels");
-        const std::string RECEIVED_SCENE("received_scene");
-        const std::string SEPARATOR("###");
-        const std::string BYE_BYE("bye");
+
+        // Protocol
+        const unsigned int MESSAGE_MAGIC(0x54594152); // "RAYT" on the wire, first field of every message header;
+        const unsigned int MAX_MESSAGE_BODY_SIZE(512 * 1024 * 1024); // Larger bodies are taken for a broken peer;
+
+        // Network
+        const unsigned int IO_THREADS(0); // Threads running the io_service; 0 for one per hardware thread;
+
+        // Scheduling
+        const double TARGET_CHUNK_SECONDS(0.2); // Work in one chunk, at the measured rate of the worker it goes to;
+        const unsigned int GUIDED_SCHEDULING_FACTOR(2); // A chunk is at most 1 / (factor * workers) of the lines left;
+        const double MIN_RATE_SAMPLE_SECONDS(0.05); // Shortest stretch a worker's rate is measured over;
+
+        // Speculative re-execution
+        const unsigned int MAX_CHUNK_COPIES(2); // Workers rendering the same chunk at most, the first one included;
+        const double STRAGGLER_DEADLINE_FACTOR(4.0); // A chunk is overdue after this many times its expected turnaround...;
+        const double MIN_STRAGGLER_SECONDS(2.0); // ...and never sooner than this;
+        const unsigned int STRAGGLER_CHECK_MILLISECONDS(500); // How often idle workers are offered copies of the chunks still out, and leases checked;
+
+        // Leases
+        const double LEASE_SECONDS(5.0); // A worker not heard of for this long loses its chunks; it sends a heartbeat every second;
     }
 }
\ No newline at end of file
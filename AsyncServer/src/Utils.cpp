@@ -11,7 +11,6 @@ namespace RayServer
     const boost::posix_time::ptime Utils::s_ObjEpoch(boost::gregorian::date(1970, 1, 1));
     std::string Utils::s_TimeFormat("%Y-%m-%d %H:%M:%S");
     std::mutex Utils::s_GetUUIDMutex;
-    std::mutex Utils::s_ToStringMutex;
 
     /**
      * Method relies on boost::random to return an integer from a
@@ -191,22 +190,4 @@ namespace RayServer
         }
         return false;
     }
-
-    std::string Utils::GetUntilSeparator(std::string& input)
-    {
-        size_t separatorPos;
-
-        separatorPos = input.find(system::SEPARATOR);
-
-        if (separatorPos != std::string::npos)
-        {
-            std::string extractedStr = input.substr(0, separatorPos);
-
-            input.erase(input.begin(), input.begin() + separatorPos + system::SEPARATOR.size());
-
-            return extractedStr;
-        }
-
-        return std::string();
-    }
 }
\ No newline at end of file
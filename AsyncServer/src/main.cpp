@@ -1,21 +1,18 @@
 #include "Server.h"
+#include "LoadTests.h"
 #include "Serialization.h"
+#include "ArchiveFormat.h"
 #include "RayTracer.h"
 
+#include <algorithm>
 #include <thread>
 #include <condition_variable>
 
 std::shared_ptr<RayServer::Server> server;
 boost::shared_ptr<RayTracer::Scene> scene = boost::shared_ptr<RayTracer::Scene>(new RayTracer::Scene(RayTracer::Color(0.196078, 0.8, 0.196078, 7.0e-6)));
-std::deque<std::string> serializedData;
-std::deque<std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>>> outputQueue;
 std::condition_variable notifyNetworkIsDone;
 std::mutex waitOnNetworkDone;
 
-#if defined(_NETWORK_UNIT_TESTS)
-std::deque<std::vector<RayTracer::PixelCoordinates>> plainData;
-#endif
-
 std::string sceneName;
 const size_t pixelsWide = 800;
 const size_t pixelsHigh = 600;
@@ -24,6 +21,12 @@ const size_t antiAliasFactor = 3;
 const size_t largePixelsWide = antiAliasFactor * pixelsWide;
 const size_t largePixelsHigh = antiAliasFactor * pixelsHigh;
 
+// The image is handed out to the workers in square tiles this many oversampled pixels wide, each traced in Morton order
+const size_t tileSize = 48;
+
+// Let the workers average their oversampled pixels down and send back final pixels, a ninth as many with an anti-aliasing factor of 3
+const bool antiAliasOnWorkers = true;
+
 BOOST_CLASS_EXPORT_GUID(RayTracer::ChessBoard, "chess_board");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Color, "color");
 BOOST_CLASS_EXPORT_GUID(RayTracer::ConcreteBlock, "concrete_block");
@@ -31,6 +34,7 @@ BOOST_CLASS_EXPORT_GUID(RayTracer::Cuboid, "cuboid");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Cylinder, "cylinder");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Dodecahedron, "dodecahedron");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Icosahedron, "icosahedron");
+BOOST_CLASS_EXPORT_GUID(RayTracer::Instance, "instance");
 BOOST_CLASS_EXPORT_GUID(RayTracer::PixelData, "pixel_data");
 BOOST_CLASS_EXPORT_GUID(RayTracer::PixelCoordinates, "pixel_coordinates");
 BOOST_CLASS_EXPORT_GUID(RayTracer::ImageBuffer, "image_buffer");
@@ -196,144 +200,73 @@ void SerializeData()
 {
     using namespace RayTracer;
 
-    std::stringstream objectBuffer;
-
-    {
-        boost::archive::text_oarchive outArchive(objectBuffer);
-        outArchive << *scene;
-    }
+    server->LoadScene(SaveArchive(*scene));
 
-    server->LoadScene(objectBuffer.str());
+    // The size of the first chunks of every worker, until the server has measured how fast it is
+    const size_t initialTilesToSend = 8;
 
-    std::vector<int> chunk;
-    
-    // std::vector<std::vector<int>> allChunks;
-
-    // create inputPixels
-    int linesToSend = 15;
-    
-    const size_t largePixelsWide = antiAliasFactor * pixelsWide;
-    const size_t largePixelsHigh = antiAliasFactor * pixelsHigh;
-    
-    for (size_t i = 0; i < largePixelsWide; ++i)
+    /**
+     * Workers that anti-alias need whole final pixels, so their chunks are rectangles of final pixels instead,
+     * each traced as antiAliasFactor x antiAliasFactor oversampled pixels. The chunks themselves are cut as the workers ask for them.
+     */
+    if (antiAliasOnWorkers)
     {
-        if (i && i % linesToSend == 0)
-        {
-            chunk.shrink_to_fit();
-    
-            // serialize
-            {
-                objectBuffer = std::stringstream();
-                boost::archive::text_oarchive outArchive(objectBuffer);
-                outArchive << chunk;
-    
-                serializedData.push_back(objectBuffer.str());
-            }
-
-        #if defined(_NETWORK_UNIT_TESTS)
-            plainData.push_back(chunk);
-        #endif
-
-            // allChunks.push_back(chunk);
-
-            chunk.clear();
-    
-            chunk.push_back(i);
-        }
-        else
-        {
-            chunk.push_back(i);
-        }
+        server->SetWork(PixelTile(0, 0, pixelsWide, pixelsHigh, std::max(tileSize / antiAliasFactor, size_t(1))), antiAliasFactor * antiAliasFactor, initialTilesToSend);
     }
-
-    if (!chunk.empty())
+    else
     {
-        chunk.shrink_to_fit();
-
-        // serialize
-        {
-            objectBuffer = std::stringstream();
-            boost::archive::text_oarchive outArchive(objectBuffer);
-            outArchive << chunk;
-
-            serializedData.push_back(objectBuffer.str());
-        }
+        server->SetWork(PixelTile(0, 0, largePixelsWide, largePixelsHigh, tileSize), 1, initialTilesToSend);
     }
+
+    server->SetAntiAliasOnWorkers(antiAliasOnWorkers);
 }
 
 void ComputeReceivedDataAndCreateImage()
 {
     using namespace RayTracer;
 
-    std::unique_lock<std::mutex> guardLock(waitOnNetworkDone);
-
-    while (server->IsWorkDone() == false)
+    // The connections have been filling the render target all along; wait until the last chunk is in
     {
-        notifyNetworkIsDone.wait(guardLock);
+        std::unique_lock<std::mutex> guardLock(waitOnNetworkDone);
+        notifyNetworkIsDone.wait(guardLock, [] { return server->IsWorkDone(); });
+    }
 
-        RayTracer::ImageBuffer outputImageBuffer = RayTracer::ImageBuffer(largePixelsWide, largePixelsHigh, Color(0.0, 0.0, 0.0));
+    ImageBuffer& renderTarget = server->GetRenderTarget();
 
-        std::stringstream objectBuffer;
+    if (antiAliasOnWorkers)
+    {
+        // The workers have already healed and averaged their pixels; only the brightness scale is left, taken over the whole image
+        double maxColorValue = server->GetMaxColorValue();
 
-        while (!outputQueue.empty())
+        // Same safety feature as ImageBuffer::MaxColorValue: do not scale a black image
+        if (maxColorValue == 0.0)
         {
-            auto completedChunk = outputQueue.back();
-
-            outputQueue.pop_back();
-
-            for (const auto& computedPixel : completedChunk)
-            {
-                PixelData& pixel = outputImageBuffer.Pixel(computedPixel.first.i, computedPixel.first.j);
-                pixel.color = computedPixel.second.color;
-                pixel.isAmbiguous = computedPixel.second.isAmbiguous;
-            }
+            maxColorValue = 1.0;
         }
 
-        scene->HandleAmbigousPixels(outputImageBuffer, pixelsWide, pixelsHigh, zoom, antiAliasFactor);
-        scene->CreateImage(sceneName, outputImageBuffer, pixelsWide, pixelsHigh, zoom, antiAliasFactor);
+        scene->CreateImage(sceneName, renderTarget, maxColorValue);
     }
-}
-
-#if defined(_NETWORK_UNIT_TESTS)
-    void UnitTest()
+    else
     {
-        SerializeData();
-
-        std::vector<std::pair<RayTracer::PixelCoordinates, RayTracer::PixelData>> computedChunk;
-
-        while (!plainData.empty())
-        {
-            auto pixelChunk = plainData.front();
-
-            plainData.pop_front();
-
-            computedChunk.clear();
-
-            for (const auto& pixelCoord : pixelChunk)
-            {
-                RayTracer::PixelData pixelColor = scene->GetPixelAt(pixelCoord.i, pixelCoord.j, pixelsWide, pixelsHigh, zoom, antiAliasFactor);
-
-                computedChunk.push_back(std::make_pair(pixelCoord, pixelColor));
-            }
-
-            computedChunk.shrink_to_fit();
-            outputQueue.push_back(computedChunk);
-        }
-
-        ComputeReceivedDataAndCreateImage();
-
-        std::cout << "Unit tests done..";
+        scene->HandleAmbigousPixels(renderTarget, pixelsWide, pixelsHigh, zoom, antiAliasFactor);
+        scene->CreateImage(sceneName, renderTarget, pixelsWide, pixelsHigh, zoom, antiAliasFactor);
     }
-#endif
+}
 
 int main()
 {
+#if defined(_NETWORK_LOAD_TESTS)
+    RayServer::LoadTests::ResultIngestLoadTest();
+    return 0;
+#endif
+
     std::string serverAdress = "localhost";
     
     boost::asio::io_service ioService;
     std::vector<std::thread> networkThreads;
 
-    server = std::shared_ptr<RayServer::Server>(new RayServer::Server(std::ref(ioService), std::ref(serializedData), std::ref(outputQueue), std::ref(notifyNetworkIsDone), std::ref(waitOnNetworkDone)));
+    server = std::shared_ptr<RayServer::Server>(new RayServer::Server(std::ref(ioService),
+        antiAliasOnWorkers ? pixelsWide : largePixelsWide, antiAliasOnWorkers ? pixelsHigh : largePixelsHigh, std::ref(notifyNetworkIsDone), std::ref(waitOnNetworkDone)));
     
     // SetupChessBoardScene();
 
@@ -347,22 +280,21 @@ int main()
 
     server->Run();
 
-    auto objConcurrency(1);
-    for (auto i = 0; i < objConcurrency; ++i)
+    // Every connection runs its handlers through its own strand, so any number of threads may run the io_service
+    const unsigned int objConcurrency(RayServer::system::IO_THREADS ? RayServer::system::IO_THREADS : std::max(std::thread::hardware_concurrency(), 1u));
+    for (unsigned int i = 0; i < objConcurrency; ++i)
     {
         networkThreads.push_back(std::thread(std::bind(static_cast<size_t(boost::asio::io_service::*) ()> (&boost::asio::io_service::run), std::ref(ioService))));
     }
 
     std::thread lastStep(ComputeReceivedDataAndCreateImage);
     
-    for (auto i = 0; i < objConcurrency; ++i)
+    for (unsigned int i = 0; i < objConcurrency; ++i)
     {
         networkThreads[i].join();
     }
 
     lastStep.join();
 
-    // UnitTest();
-
     return 0;
 }
\ No newline at end of file
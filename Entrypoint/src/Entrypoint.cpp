@@ -21,6 +21,7 @@ BOOST_CLASS_EXPORT_GUID(RayTracer::Cuboid, "cuboid");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Cylinder, "cylinder");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Dodecahedron, "dodecahedron");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Icosahedron, "icosahedron");
+BOOST_CLASS_EXPORT_GUID(RayTracer::Instance, "instance");
 BOOST_CLASS_EXPORT_GUID(RayTracer::PixelData, "pixel_data");
 BOOST_CLASS_EXPORT_GUID(RayTracer::ImageBuffer, "image_buffer");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Intersection, "intersection");
@@ -0,0 +1,152 @@
+#ifndef _ARCHIVE_FORMAT_H_
+#define _ARCHIVE_FORMAT_H_
+
+#include "ImagerException.h"
+#include "Serialization.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
+
+// Define as 1 to send scenes and pixel chunks as human readable text archives, for debugging.
+#ifndef RAYTRACE_TEXT_ARCHIVES
+#define RAYTRACE_TEXT_ARCHIVES 0
+#endif
+
+namespace RayTracer
+{
+    enum ArchiveFormat : unsigned char
+    {
+        TEXT_ARCHIVE = 1,
+        BINARY_ARCHIVE = 2
+    };
+
+#if RAYTRACE_TEXT_ARCHIVES
+    const ArchiveFormat DEFAULT_ARCHIVE_FORMAT = TEXT_ARCHIVE;
+#else
+    const ArchiveFormat DEFAULT_ARCHIVE_FORMAT = BINARY_ARCHIVE;
+#endif
+
+    /**
+     * Every archive made by SaveArchive() starts with a small header:
+     *
+     *     'R' 'A' | header version | format | byte order mark (2 bytes) | sizeof(std::size_t)
+     *
+     * The byte order mark is the number 0x0102 in the byte order of the machine that wrote the archive.
+     * Boost binary archives store numbers in that native order and at their native size (their own header only
+     * checks the sizes of int, long, float and double), so a binary archive written on a machine with the other
+     * byte order, or with another size of std::size_t, which pixel chunks are full of, is refused here instead
+     * of being read as garbage. A 32-bit and a 64-bit Windows build differ only in the latter.
+     * Text archives can be read anywhere.
+     */
+    namespace ArchiveHeader
+    {
+        const std::size_t SIZE = 7;
+        const unsigned char VERSION = 2;
+        const std::uint16_t BYTE_ORDER_MARK = 0x0102;
+
+        inline void Write(std::ostream& output, ArchiveFormat format)
+        {
+            const std::uint16_t byteOrderMark = BYTE_ORDER_MARK;
+            const unsigned char* byteOrderBytes = reinterpret_cast<const unsigned char*>(&byteOrderMark);
+
+            const unsigned char header[SIZE] = { 'R', 'A', VERSION, format, byteOrderBytes[0], byteOrderBytes[1], sizeof(std::size_t) };
+            output.write(reinterpret_cast<const char*>(header), SIZE);
+        }
+
+        // Returns the format of the archive that follows the header, or throws ImagerException if it cannot be read here.
+        inline ArchiveFormat Read(const char* data, std::size_t size)
+        {
+            if (size < SIZE || data[0] != 'R' || data[1] != 'A')
+            {
+                throw ImagerException("Serialized data does not start with an archive header.");
+            }
+
+            if (static_cast<unsigned char>(data[2]) != VERSION)
+            {
+                throw ImagerException("Archive header has an unsupported version.");
+            }
+
+            const ArchiveFormat format = static_cast<ArchiveFormat>(data[3]);
+            if (format == TEXT_ARCHIVE)
+            {
+                return format;
+            }
+
+            if (format != BINARY_ARCHIVE)
+            {
+                throw ImagerException("Archive header names an unknown archive format.");
+            }
+
+            std::uint16_t byteOrderMark;
+            std::copy(data + 4, data + 6, reinterpret_cast<char*>(&byteOrderMark));
+            if (byteOrderMark != BYTE_ORDER_MARK)
+            {
+                throw ImagerException("Binary archive was written on a machine with a different byte order.");
+            }
+
+            if (static_cast<unsigned char>(data[6]) != sizeof(std::size_t))
+            {
+                throw ImagerException("Binary archive was written on a machine with a different size of std::size_t.");
+            }
+
+            return format;
+        }
+    }
+
+    // Serializes 'object' (a Scene, a chunk of pixels...) behind an archive header.
+    template<class T>
+    std::string SaveArchive(const T& object, ArchiveFormat format = DEFAULT_ARCHIVE_FORMAT)
+    {
+        std::ostringstream objectBuffer(std::ios_base::out | std::ios_base::binary);
+
+        ArchiveHeader::Write(objectBuffer, format);
+
+        // The archive must be destroyed before the buffer is read, so that it has written everything.
+        if (format == BINARY_ARCHIVE)
+        {
+            boost::archive::binary_oarchive outArchive(objectBuffer);
+            outArchive << object;
+        }
+        else
+        {
+            boost::archive::text_oarchive outArchive(objectBuffer);
+            outArchive << object;
+        }
+
+        return objectBuffer.str();
+    }
+
+    // Loads an archive made by SaveArchive() in either format, reading straight from 'data' without copying it.
+    template<class T>
+    void LoadArchive(const char* data, std::size_t size, T& object)
+    {
+        const ArchiveFormat format = ArchiveHeader::Read(data, size);
+
+        boost::iostreams::stream<boost::iostreams::array_source> objectBuffer(data + ArchiveHeader::SIZE, size - ArchiveHeader::SIZE);
+
+        if (format == BINARY_ARCHIVE)
+        {
+            boost::archive::binary_iarchive inArchive(objectBuffer);
+            inArchive >> object;
+        }
+        else
+        {
+            boost::archive::text_iarchive inArchive(objectBuffer);
+            inArchive >> object;
+        }
+    }
+
+    template<class T>
+    void LoadArchive(const std::string& data, T& object)
+    {
+        LoadArchive(data.data(), data.size(), object);
+    }
+}
+
+#endif
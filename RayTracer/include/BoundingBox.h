@@ -0,0 +1,197 @@
+#ifndef _BOUNDING_BOX_H_
+#define _BOUNDING_BOX_H_
+
+#include <cmath>
+
+#include "Vector.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace RayTracer
+{
+    /**
+     * An axis-aligned box in camera space that encloses every surface point of a solid.
+     * A default-constructed box is unbounded (it encloses all of space); this is the safe answer
+     * for solids that cannot tell where they end, such as SetComplement.
+     * An empty box encloses nothing and is the starting point for growing a box with Include().
+     */
+    class BoundingBox
+    {
+    public:
+
+        Vector minCorner;
+        Vector maxCorner;
+
+        BoundingBox()
+            : minCorner(-Infinity(), -Infinity(), -Infinity())
+            , maxCorner(+Infinity(), +Infinity(), +Infinity())
+        {
+        }
+
+        BoundingBox(const Vector& _minCorner, const Vector& _maxCorner)
+            : minCorner(_minCorner)
+            , maxCorner(_maxCorner)
+        {
+        }
+
+        static BoundingBox Empty()
+        {
+            return BoundingBox(
+                Vector(+Infinity(), +Infinity(), +Infinity()),
+                Vector(-Infinity(), -Infinity(), -Infinity()));
+        }
+
+        bool IsEmpty() const
+        {
+            return (minCorner.x > maxCorner.x) || (minCorner.y > maxCorner.y) || (minCorner.z > maxCorner.z);
+        }
+
+        // Returns true if the box has finite extent on every axis, i.e. it can be placed in a bounding volume hierarchy.
+        bool IsFinite() const
+        {
+            return
+                (minCorner.x > -Infinity()) && (maxCorner.x < +Infinity()) &&
+                (minCorner.y > -Infinity()) && (maxCorner.y < +Infinity()) &&
+                (minCorner.z > -Infinity()) && (maxCorner.z < +Infinity());
+        }
+
+        BoundingBox& Include(const Vector& point)
+        {
+            minCorner.x = std::min(minCorner.x, point.x);
+            minCorner.y = std::min(minCorner.y, point.y);
+            minCorner.z = std::min(minCorner.z, point.z);
+            maxCorner.x = std::max(maxCorner.x, point.x);
+            maxCorner.y = std::max(maxCorner.y, point.y);
+            maxCorner.z = std::max(maxCorner.z, point.z);
+            return *this;
+        }
+
+        BoundingBox& Include(const BoundingBox& other)
+        {
+            minCorner.x = std::min(minCorner.x, other.minCorner.x);
+            minCorner.y = std::min(minCorner.y, other.minCorner.y);
+            minCorner.z = std::min(minCorner.z, other.minCorner.z);
+            maxCorner.x = std::max(maxCorner.x, other.maxCorner.x);
+            maxCorner.y = std::max(maxCorner.y, other.maxCorner.y);
+            maxCorner.z = std::max(maxCorner.z, other.maxCorner.z);
+            return *this;
+        }
+
+        // Shrinks this box to the region it shares with 'other'. The result is empty if the two boxes do not overlap.
+        BoundingBox& Intersect(const BoundingBox& other)
+        {
+            minCorner.x = std::max(minCorner.x, other.minCorner.x);
+            minCorner.y = std::max(minCorner.y, other.minCorner.y);
+            minCorner.z = std::max(minCorner.z, other.minCorner.z);
+            maxCorner.x = std::min(maxCorner.x, other.maxCorner.x);
+            maxCorner.y = std::min(maxCorner.y, other.maxCorner.y);
+            maxCorner.z = std::min(maxCorner.z, other.maxCorner.z);
+            return *this;
+        }
+
+        // Grows the box by 'margin' on every side, so that roundoff in the solid's own intersection math cannot put a surface point just outside it.
+        BoundingBox& Expand(double margin)
+        {
+            minCorner.x -= margin;
+            minCorner.y -= margin;
+            minCorner.z -= margin;
+            maxCorner.x += margin;
+            maxCorner.y += margin;
+            maxCorner.z += margin;
+            return *this;
+        }
+
+        Vector Centroid() const
+        {
+            return Vector(
+                (minCorner.x + maxCorner.x) / 2.0,
+                (minCorner.y + maxCorner.y) / 2.0,
+                (minCorner.z + maxCorner.z) / 2.0);
+        }
+
+        double SurfaceArea() const
+        {
+            if (IsEmpty())
+            {
+                return 0.0;
+            }
+            const double dx = maxCorner.x - minCorner.x;
+            const double dy = maxCorner.y - minCorner.y;
+            const double dz = maxCorner.z - minCorner.z;
+            return 2.0 * (dx*dy + dy*dz + dz*dx);
+        }
+
+        /**
+         * Slab test of the ray vantage + u*direction against this box.
+         * inverseDirection holds the reciprocal of each direction component (infinite for zero components), so it can be computed
+         * once per ray and reused for every box the ray is tested against.
+         * Returns true if the ray passes through the box for some u in [0, maxU]; in that case uEnter receives the smallest such u.
+         */
+        bool IntersectsRay(
+            const Vector& vantage,
+            const Vector& inverseDirection,
+            double maxU,
+            double& uEnter) const
+        {
+            double uMin = 0.0;
+            double uMax = maxU;
+            if (ClipSlab(vantage.x, inverseDirection.x, minCorner.x, maxCorner.x, uMin, uMax) &&
+                ClipSlab(vantage.y, inverseDirection.y, minCorner.y, maxCorner.y, uMin, uMax) &&
+                ClipSlab(vantage.z, inverseDirection.z, minCorner.z, maxCorner.z, uMin, uMax))
+            {
+                uEnter = uMin;
+                return true;
+            }
+            return false;
+        }
+
+        // Convenience form of the slab test for a single ray starting at 'vantage', with no upper limit on u.
+        bool IsHitByRay(const Vector& vantage, const Vector& direction) const
+        {
+            const Vector inverseDirection(1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z);
+            double uEnter;
+            return IntersectsRay(vantage, inverseDirection, Infinity(), uEnter);
+        }
+
+        static double Infinity()
+        {
+            return std::numeric_limits<double>::infinity();
+        }
+
+    private:
+
+        static bool ClipSlab(
+            double origin,
+            double inverseDirection,
+            double slabMin,
+            double slabMax,
+            double& uMin,
+            double& uMax)
+        {
+            if (inverseDirection == +Infinity() || inverseDirection == -Infinity())
+            {
+                // The ray runs parallel to this slab, so it is either always inside it or never.
+                return (origin >= slabMin) && (origin <= slabMax);
+            }
+
+            double u1 = (slabMin - origin) * inverseDirection;
+            double u2 = (slabMax - origin) * inverseDirection;
+            if (u1 > u2)
+            {
+                std::swap(u1, u2);
+            }
+            if (u1 > uMin)
+            {
+                uMin = u1;
+            }
+            if (u2 < uMax)
+            {
+                uMax = u2;
+            }
+            return uMin <= uMax;
+        }
+    };
+}
+
+#endif
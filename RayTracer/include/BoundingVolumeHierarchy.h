@@ -0,0 +1,84 @@
+#ifndef _BOUNDING_VOLUME_HIERARCHY_H_
+#define _BOUNDING_VOLUME_HIERARCHY_H_
+
+#include "BoundingBox.h"
+#include "BoxTree.h"
+#include "SolidObject.h"
+#include "TraceContext.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <vector>
+
+namespace RayTracer
+{
+    /**
+     * A bounding volume hierarchy over the solids of a Scene, so that a ray only has to be tested against the
+     * solids whose bounding boxes it actually passes through.
+     * Solids whose GetBoundingBox() is not finite (e.g. SetComplement) cannot be placed in the tree; they are kept
+     * in a separate list and tested against every ray, exactly like the plain linear scan would do.
+     *
+     * The hierarchy keeps raw pointers to the solids, so it must be rebuilt (or cleared) whenever the list it was
+     * built from changes or any of its solids is moved or rotated.
+     */
+    class BoundingVolumeHierarchy
+    {
+    public:
+
+        BoundingVolumeHierarchy()
+            : isBuilt(false)
+        {
+        }
+
+        void Build(const std::vector<boost::shared_ptr<SolidObject>>& solidObjectList);
+
+        void Clear();
+
+        bool IsBuilt() const
+        {
+            return isBuilt;
+        }
+
+        /**
+         * Appends to 'intersectionList' the intersections of every solid that can own the closest intersection
+         * along the ray, including all intersections that tie with it within EPSILON.
+         * Solids whose bounding boxes start farther away than the closest intersection found so far are skipped.
+         * The appended intersections are grouped by solid in the same order as the list the hierarchy was built from,
+         * so PickClosestIntersection sees the same sequence of candidates as it does for a linear scan.
+         */
+        void AppendClosestCandidates(
+            const Vector& vantage,
+            const Vector& direction,
+            std::vector<Intersection>& intersectionList,
+            TraceContext& context) const;
+
+        /**
+         * Returns true if any solid has an intersection with the ray vantage + u*direction
+         * whose squared distance from the vantage point is less than maxDistanceSquared.
+         * Stops at the first such solid found, in whatever order the tree happens to visit them.
+         */
+        bool HasIntersectionCloserThan(
+            const Vector& vantage,
+            const Vector& direction,
+            double maxDistanceSquared,
+            TraceContext& context) const;
+
+        size_t GetNodeCount() const
+        {
+            return tree.GetNodeCount();
+        }
+
+    private:
+
+        bool isBuilt;
+
+        // The solids in the order of the scene's solid object list. Indexes below refer to this list.
+        std::vector<const SolidObject*> solidList;
+
+        // Over the bounded solids; its item indexes are indexes into solidList.
+        BoxTree tree;
+        std::vector<size_t> unboundedObjectList;
+    };
+}
+
+#endif
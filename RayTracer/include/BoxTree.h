@@ -0,0 +1,142 @@
+#ifndef _BOX_TREE_H_
+#define _BOX_TREE_H_
+
+#include "BoundingBox.h"
+
+#include <vector>
+
+namespace RayTracer
+{
+    /**
+     * A binary tree of axis-aligned boxes built with a binned surface area heuristic.
+     * The tree only knows its items by their index and their box, so the same tree serves the Scene's hierarchy
+     * of solids and the hierarchy of triangles inside each TriangleMesh; testing a ray against an item is up to the caller.
+     */
+    class BoxTree
+    {
+    public:
+
+        struct Node
+        {
+            BoundingBox box;
+
+            // For leaves, the range [firstItem, firstItem + itemCount) of the item index list. Inner nodes have itemCount == 0.
+            size_t firstItem;
+            size_t itemCount;
+
+            // The first child of an inner node always immediately follows it in the node list; this is the index of the second child.
+            size_t secondChild;
+        };
+
+        // Nodes deep enough to overflow a traversal stack of this size are never built.
+        static const size_t TRAVERSAL_STACK_SIZE = 128;
+
+        /**
+         * Builds the tree over the items whose box is itemBoxList[itemIndex].
+         * Items with an empty box are left out of the tree; every other box must be finite.
+         */
+        void Build(const std::vector<BoundingBox>& itemBoxList);
+
+        void Clear()
+        {
+            nodeList.clear();
+            itemIndexList.clear();
+        }
+
+        bool IsEmpty() const
+        {
+            return nodeList.empty();
+        }
+
+        const std::vector<Node>& GetNodeList() const
+        {
+            return nodeList;
+        }
+
+        size_t GetFirstChild(const Node& node) const
+        {
+            return &node - nodeList.data() + 1;
+        }
+
+        size_t GetItemIndex(size_t position) const
+        {
+            return itemIndexList[position];
+        }
+
+        size_t GetNodeCount() const
+        {
+            return nodeList.size();
+        }
+
+        static Vector InverseDirection(const Vector& direction)
+        {
+            return Vector(1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z);
+        }
+
+        /**
+         * Calls visitItem(itemIndex) for every item of every leaf whose box the ray vantage + u*direction passes through
+         * for some u in [0, maxU], in no particular order, and stops as soon as visitItem returns true.
+         * Returns true if it was stopped that way.
+         */
+        template<typename VisitItem>
+        bool VisitItemsAlongRay(
+            const Vector& vantage,
+            const Vector& inverseDirection,
+            double maxU,
+            VisitItem visitItem) const
+        {
+            if (nodeList.empty())
+            {
+                return false;
+            }
+
+            size_t stack[TRAVERSAL_STACK_SIZE];
+            size_t stackSize = 0;
+            stack[stackSize++] = 0;
+
+            while (stackSize > 0)
+            {
+                const Node& node = nodeList[stack[--stackSize]];
+
+                double uEnter;
+                if (!node.box.IntersectsRay(vantage, inverseDirection, maxU, uEnter))
+                {
+                    continue;
+                }
+
+                if (node.itemCount > 0)
+                {
+                    for (size_t i = node.firstItem; i < node.firstItem + node.itemCount; ++i)
+                    {
+                        if (visitItem(itemIndexList[i]))
+                        {
+                            return true;
+                        }
+                    }
+                    continue;
+                }
+
+                stack[stackSize++] = node.secondChild;
+                stack[stackSize++] = GetFirstChild(node);
+            }
+
+            return false;
+        }
+
+    private:
+
+        struct BuildEntry
+        {
+            BoundingBox box;
+            Vector centroid;
+            size_t itemIndex;
+        };
+
+        size_t BuildNode(std::vector<BuildEntry>& entryList, size_t begin, size_t end, int depth);
+
+        std::vector<Node> nodeList;
+        std::vector<size_t> itemIndexList;
+    };
+}
+
+#endif
@@ -31,9 +31,11 @@ namespace RayTracer
 
 	protected:
 
-		virtual void ObjectSpace_AppendAllIntersections(const Vector& vantage, const Vector& direction, std::vector<Intersection>& intersectionList) const;
+		virtual void ObjectSpace_AppendAllIntersections(const Vector& vantage, const Vector& direction, std::vector<Intersection>& intersectionList, TraceContext& context) const;
 
-		virtual bool ObjectSpace_Contains(const Vector& point) const
+		virtual bool ObjectSpace_HasIntersectionCloserThan(const Vector& vantage, const Vector& direction, double maxDistanceSquared, TraceContext& context) const;
+
+		virtual bool ObjectSpace_Contains(const Vector& point, TraceContext& context) const
 		{
 			return
 				(fabs(point.x) <= a + EPSILON) &&
@@ -41,8 +43,27 @@ namespace RayTracer
 				(fabs(point.z) <= c + EPSILON);
 		}
 
+		// Faces accept points up to EPSILON beyond the edges (see ObjectSpace_Contains), so the box does too.
+		virtual BoundingBox ObjectSpace_GetBoundingBox() const
+		{
+			return BoundingBox(Vector(-a, -b, -c), Vector(+a, +b, +c)).Expand(EPSILON);
+		}
+
 	private:
-        
+
+		// Checks one face candidate the same way ObjectSpace_AppendAllIntersections does, plus the distance limit.
+		bool IsFaceHitCloserThan(double u, const Vector& vantage, const Vector& direction, double maxDistanceSquared, TraceContext& context) const
+		{
+			if(u > EPSILON)
+			{
+				const Vector displacement = u * direction;
+				return
+					(displacement.MagnitudeSquared() < maxDistanceSquared) &&
+					ObjectSpace_Contains(vantage + displacement, context);
+			}
+			return false;
+		}
+
 		const double  a;   // half of the width:  faces at r = -a and r = +a.
 		const double  b;   // half of the length: faces at s = -b and s = +b.
 		const double  c;   // half of the height: faces at t = -c and t = +c.
@@ -33,15 +33,27 @@ namespace RayTracer
 		virtual void ObjectSpace_AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
+
+		virtual bool ObjectSpace_HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const;
 
-		virtual bool ObjectSpace_Contains(const Vector& point) const
+		virtual bool ObjectSpace_Contains(const Vector& point, TraceContext& context) const
 		{
 			return
 				(fabs(point.z) <= b + EPSILON) &&
 				(point.x*point.x + point.y*point.y <= a*a + EPSILON);
 		}
 
+		virtual BoundingBox ObjectSpace_GetBoundingBox() const
+		{
+			return BoundingBox(Vector(-a, -a, -b), Vector(+a, +a, +b));
+		}
+
 	private:
 		void AppendDiskIntersection(
 			const Vector& vantage,
@@ -4,6 +4,10 @@
 #include "Color.h"
 #include "PixelCoordinates.h"
 
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
 namespace RayTracer
 {
 	// The information available for any pixel in an ImageBuffer
@@ -0,0 +1,88 @@
+#ifndef _INSTANCE_H_
+#define _INSTANCE_H_
+
+#include "SolidObject_Reorientable.h"
+
+#include <boost/shared_ptr.hpp>
+
+namespace RayTracer
+{
+    /**
+	 * Places a solid in the scene without copying it.  Any number of instances may share one 'geometry', each with its own
+	 * position and orientation, so memory, archive size and the work of building acceleration structures grow with the number
+	 * of distinct solids instead of the number of copies: a serialized scene holds each shared geometry once, and a TriangleMesh
+	 * builds its triangle tree once for all of its instances, below the Scene's own tree over the instances.
+	 *
+	 * The geometry itself is never moved or rotated by an instance, and does not need to be added to the scene.
+	 * Rays are carried into its space by the SolidObject_Reorientable conversion, with the geometry's center as the origin of
+	 * object space.  A new instance is centered on the geometry's center, so it covers the geometry exactly until it is moved or rotated.
+	 * The geometry must not change while a scene that uses it is rendering.  Its refractive index is copied when the instance is made.
+	 */
+    class Instance: public SolidObject_Reorientable
+	{
+	public:
+		explicit Instance(const boost::shared_ptr<SolidObject>& _geometry = boost::shared_ptr<SolidObject>())
+			: SolidObject_Reorientable(_geometry ? _geometry->Center() : Vector())
+			, geometry(_geometry)
+		{
+			SetTag("Instance");
+			if(geometry)
+			{
+				SetRefraction(geometry->GetRefractiveIndex());
+			}
+		}
+
+        friend class access;
+        template<class Archive>
+        void serialize(Archive & ar, const unsigned int version)
+        {
+            ar & boost::serialization::base_object<SolidObject_Reorientable>(*this);
+            ar & geometry;
+        }
+
+		const boost::shared_ptr<SolidObject>& GetGeometry() const
+		{
+			return geometry;
+		}
+
+	protected:
+        /**
+		 * Intersections keep the solid the geometry reported, which may be one of its parts, so that the surface optics
+		 * come from the solid that was hit; the point where it was hit, in its own space, is kept in Intersection::solidPoint.
+		 */
+        virtual void ObjectSpace_AppendAllIntersections(
+			const Vector& vantage,
+			const Vector& direction,
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
+
+		virtual bool ObjectSpace_HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const
+		{
+			return geometry->HasIntersectionCloserThan(vantage + geometry->Center(), direction, maxDistanceSquared, context);
+		}
+
+		virtual bool ObjectSpace_Contains(const Vector& point, TraceContext& context) const
+		{
+			return geometry->Contains(point + geometry->Center(), context);
+		}
+
+		virtual BoundingBox ObjectSpace_GetBoundingBox() const;
+
+		virtual Optics ObjectSpace_SurfaceOptics(
+			const Vector& surfacePoint,
+			const void *context) const
+		{
+			return geometry->SurfaceOptics(surfacePoint + geometry->Center(), context);
+		}
+
+	private:
+
+		boost::shared_ptr<SolidObject> geometry;
+	};
+}
+
+#endif
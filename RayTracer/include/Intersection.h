@@ -22,6 +22,8 @@ namespace RayTracer
             ar & distanceSquared;
             ar & point;
             ar & surfaceNormal;
+            ar & solidPoint;
+            ar & hasSolidPoint;
             ar & reinterpret_cast<SolidObject&> (solid);
             ar & reinterpret_cast<SolidObject&> (context);
             ar & tag;
@@ -39,6 +41,13 @@ namespace RayTracer
 		// A pointer to the solid object that the ray intersected with.
 		const SolidObject* solid;
 
+        /**
+		 * The intersection point in the space of 'solid' itself, which is not camera space when 'solid' is shared geometry placed in the scene by an Instance.
+		 * Only set when hasSolidPoint is true; otherwise 'point' is where 'solid' was hit.  Surface optics are looked up at this point.
+		 */
+        Vector solidPoint;
+		bool hasSolidPoint;
+
         /**
 		 * An optional tag for classes derived from SolidObject to cache  arbitrary information about surface optics.  
          * Most classes can safely leave this pointer as NULL, its default value.
@@ -58,6 +67,8 @@ namespace RayTracer
 			, point()
 			, surfaceNormal()
 			, solid(nullptr)
+			, solidPoint()
+			, hasSolidPoint(false)
 			, context(nullptr)
 			, tag(std::string())
 		{
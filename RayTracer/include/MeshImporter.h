@@ -0,0 +1,100 @@
+#ifndef _MESH_IMPORTER_H_
+#define _MESH_IMPORTER_H_
+
+#include "TriangleMesh.h"
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace RayTracer
+{
+    class RenderThreadPool;
+
+    // What MeshImporter::Load did, for the caller to log.
+    struct MeshImportReport
+    {
+        MeshImportReport()
+            : pointCount(0)
+            , triangleCount(0)
+            , skippedTriangleCount(0)
+            , fileBytes(0)
+            , seconds(0.0)
+            , meshMemoryBytes(0)
+            , peakMemoryBytes(0)
+        {
+        }
+
+        size_t pointCount;
+        size_t triangleCount;
+
+        // Triangles that use the same point twice have no area; they are left out of the mesh.
+        size_t skippedTriangleCount;
+
+        size_t fileBytes;
+        double seconds;
+
+        // The memory the loaded mesh takes up: its points, triangles and triangle geometry.
+        size_t meshMemoryBytes;
+
+        /**
+         * The most memory the import held at once. While parsing, that is the whole mapped file and the point and
+         * triangle lists, allocated once at their final size; afterwards, the finished mesh. The parsers' scratch,
+         * a few small lists per chunk of the file, is left out.
+         */
+        size_t peakMemoryBytes;
+    };
+
+    /**
+     * Builds a TriangleMesh from a Wavefront OBJ file (".obj") or a binary PLY file (".ply").
+     * The file is mapped into memory rather than read, and parsed in chunks on every thread of a RenderThreadPool:
+     * a first pass counts the points and triangles of each chunk, so that every list is allocated once at its final size,
+     * and a second pass parses each chunk straight into its place in those lists.
+     *
+     * From an OBJ file only the vertex positions ("v") and the faces ("f") are used; faces with more than three
+     * points are split into a fan of triangles. From a PLY file only the x, y and z of the "vertex" element and the
+     * "vertex_indices" list of the "face" element are used. Faces must list their points counterclockwise as seen
+     * from outside the solid, as both formats recommend.
+     *
+     * The mesh's center, about which it rotates, is the middle of its bounding box; Move() puts the model there.
+     * Every triangle gets the given optics.  Files that cannot be read or parsed throw ImagerException.
+     */
+    class MeshImporter
+    {
+    public:
+
+        static boost::shared_ptr<TriangleMesh> Load(
+            const std::string& filename,
+            const Optics& optics,
+            MeshImportReport& report,
+            bool isFullyEnclosed = true);
+
+        // As above, parsing on the threads of the given pool.
+        static boost::shared_ptr<TriangleMesh> Load(
+            const std::string& filename,
+            const Optics& optics,
+            MeshImportReport& report,
+            bool isFullyEnclosed,
+            RenderThreadPool& threadPool);
+
+    private:
+
+        typedef TriangleMesh::Triangle Triangle;
+
+        static void ParseObj(
+            const char* begin,
+            const char* end,
+            RenderThreadPool& threadPool,
+            std::vector<Vector>& pointList,
+            std::vector<Triangle>& triangleList);
+
+        static void ParsePly(
+            const char* begin,
+            const char* end,
+            RenderThreadPool& threadPool,
+            std::vector<Vector>& pointList,
+            std::vector<Triangle>& triangleList);
+    };
+}
+
+#endif
@@ -44,6 +44,15 @@ namespace RayTracer
 			return opacity;
 		}
 
+		// Exact comparison, used to find a material that is already in a table rather than to compare computed colors.
+		bool operator == (const Optics& other) const
+		{
+			return
+				(matteColor.red == other.matteColor.red) && (matteColor.green == other.matteColor.green) && (matteColor.blue == other.matteColor.blue) &&
+				(glossColor.red == other.glossColor.red) && (glossColor.green == other.glossColor.green) && (glossColor.blue == other.glossColor.blue) &&
+				(opacity == other.opacity);
+		}
+
         friend class access;
         template<class Archive>
         void serialize(Archive & ar, const unsigned int version)
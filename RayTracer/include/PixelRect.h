@@ -0,0 +1,101 @@
+#ifndef _PIXEL_RECT_H_
+#define _PIXEL_RECT_H_
+
+#include "ImageBuffer.h"
+#include "Serialization.h"
+
+#include <vector>
+
+namespace RayTracer
+{
+    /**
+     * The computed pixels of one rectangle of an image: columns [left, left + width) and rows [top, top + height).
+     * The rectangle is named once; the pixel coordinates are implied by the position of each pixel in the payload.
+     * Colors are stored row by row (like ImageBuffer) as red, green, blue triples, either as doubles or,
+     * to halve the payload, as floats. The ambiguity flags are packed eight to a byte in the same order.
+     */
+    class PixelRect
+    {
+    public:
+
+        PixelRect();
+
+        /**
+         * Packs 'pixels', which holds the width * height pixels of the rectangle in row order.
+         * With useFloatColors the colors are rounded to float, which is still far finer than the 8 bits
+         * per channel of the final image.
+         */
+        PixelRect(
+            size_t _left,
+            size_t _top,
+            size_t _width,
+            size_t _height,
+            const std::vector<PixelData>& pixels,
+            bool _useFloatColors);
+
+        size_t GetLeft() const { return left; }
+        size_t GetTop() const { return top; }
+        size_t GetWidth() const { return width; }
+        size_t GetHeight() const { return height; }
+
+        size_t GetNumPixels() const
+        {
+            return width * height;
+        }
+
+        /**
+         * For pixels averaged down from oversampled pixels on a worker (see Scene::RenderDownsampledRect), the largest
+         * color value among those oversampled pixels, which the image brightness is scaled by; 0 otherwise.
+         */
+        double GetMaxColorValue() const { return maxColorValue; }
+        void SetMaxColorValue(double _maxColorValue) { maxColorValue = _maxColorValue; }
+
+        // Returns the pixel at image column i and row j, which must lie inside the rectangle.
+        PixelData GetPixel(size_t i, size_t j) const;
+
+        // Throws if the payload does not hold exactly the pixels of the rectangle, as may happen with a deserialized one.
+        void CheckPayload() const;
+
+        // Writes every pixel of the rectangle into its place in 'image'.
+        void CopyTo(ImageBuffer& image) const;
+
+        friend class access;
+        template<class Archive>
+        void serialize(Archive & ar, const unsigned int version)
+        {
+            ar & left;
+            ar & top;
+            ar & width;
+            ar & height;
+            ar & useFloatColors;
+            if (useFloatColors)
+            {
+                ar & floatColors;
+            }
+            else
+            {
+                ar & doubleColors;
+            }
+            ar & ambiguityBits;
+            ar & maxColorValue;
+        }
+
+    private:
+
+        PixelData GetPixelAtIndex(size_t index) const;
+
+        size_t left;
+        size_t top;
+        size_t width;
+        size_t height;
+
+        bool useFloatColors;
+        std::vector<double> doubleColors;
+        std::vector<float> floatColors;
+        std::vector<unsigned char> ambiguityBits;
+
+        double maxColorValue;
+    };
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef _PIXEL_TILE_H_
+#define _PIXEL_TILE_H_
+
+#include "Serialization.h"
+
+#include <utility>
+#include <vector>
+
+namespace RayTracer
+{
+    /**
+     * Lists the cells of a width x height grid in Morton (Z) order, as (column, row) pairs: the grid is split
+     * into quadrants, each quadrant visited in full, top left, top right, bottom left, bottom right, before the next.
+     * Cells that follow each other in this order are next to each other in the grid far more often than in row order.
+     */
+    void MortonOrder(size_t width, size_t height, std::vector<std::pair<size_t, size_t>>& cells);
+
+    /**
+     * A rectangle of an image to be rendered, the unit of work handed to a worker: columns [left, left + width)
+     * and rows [top, top + height), named by its corners rather than by a list of its pixels. The rectangle is
+     * traced in square tiles of tileSize pixels, both the tiles and the pixels within each tile in Morton order,
+     * so that rays traced one after the other are close together and mostly meet the same parts of the scene.
+     * The computed pixels come back as a PixelRect over the same rectangle.
+     */
+    class PixelTile
+    {
+    public:
+
+        PixelTile();
+
+        PixelTile(size_t _left, size_t _top, size_t _width, size_t _height, size_t _tileSize);
+
+        size_t GetLeft() const { return left; }
+        size_t GetTop() const { return top; }
+        size_t GetWidth() const { return width; }
+        size_t GetHeight() const { return height; }
+        size_t GetTileSize() const { return tileSize; }
+
+        size_t GetNumPixels() const
+        {
+            return width * height;
+        }
+
+        /**
+         * The tiles of the rectangle in the order they are traced, each as the column and row of its top left pixel
+         * relative to the rectangle. The tiles along the right and bottom edges may be smaller than tileSize.
+         */
+        void GetTiles(std::vector<std::pair<size_t, size_t>>& tileCorners) const;
+
+        friend class access;
+        template<class Archive>
+        void serialize(Archive & ar, const unsigned int version)
+        {
+            ar & left;
+            ar & top;
+            ar & width;
+            ar & height;
+            ar & tileSize;
+        }
+
+    private:
+
+        size_t left;
+        size_t top;
+        size_t width;
+        size_t height;
+        size_t tileSize;
+    };
+}
+
+#endif
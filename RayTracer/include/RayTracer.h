@@ -2,6 +2,8 @@
 #define _RAY_TRACER_H_
 
 #include "Scene.h"
+#include "PixelRect.h"
+#include "PixelTile.h"
 
 #include "Cuboid.h"
 #include "Cylinder.h"
@@ -9,6 +11,7 @@
 #include "Chessboard.h"
 #include "Dodecahedron.h"
 #include "Icosahedron.h"
+#include "Instance.h"
 #include "Sphere.h"
 #include "Spheroid.h"
 #include "ThinDisk.h"
@@ -0,0 +1,88 @@
+#ifndef _RENDER_THREAD_POOL_H_
+#define _RENDER_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace RayTracer
+{
+    /**
+     * A fixed set of threads that run batches of independent rendering tasks (e.g. image tiles).
+     * Every thread owns a queue of task indexes.  A batch is dealt out to the queues in contiguous runs, so each thread starts
+     * on its own region of the image; a thread that empties its queue steals from the far end of another thread's queue,
+     * so a region full of expensive pixels (glass, mirrors) is shared out instead of keeping one thread busy long after the rest are done.
+     *
+     * The thread that calls Run() takes part as thread 0, so a pool of one thread starts no threads at all and runs every task in order.
+     */
+    class RenderThreadPool
+    {
+    public:
+
+        // The task receives the index of the task and the index of the thread running it, in [0, GetThreadCount()).
+        typedef std::function<void(size_t taskIndex, size_t threadIndex)> Task;
+
+        // A threadCount of 0 means one thread per hardware thread.
+        explicit RenderThreadPool(size_t threadCount = 0);
+
+        ~RenderThreadPool();
+
+        size_t GetThreadCount() const
+        {
+            return queueList.size();
+        }
+
+        /**
+         * Runs task(taskIndex, threadIndex) once for every taskIndex in [0, taskCount) and returns when all of them are done.
+         * If a task throws, the tasks that have not started yet are skipped and the first exception is rethrown here.
+         * Only one batch can run at a time.
+         */
+        void Run(size_t taskCount, const Task& task);
+
+        // The number of threads used when a pool is constructed with a threadCount of 0.
+        static size_t DefaultThreadCount();
+
+    private:
+
+        RenderThreadPool(const RenderThreadPool&);
+        RenderThreadPool& operator = (const RenderThreadPool&);
+
+        struct TaskQueue
+        {
+            std::mutex mutex;
+            std::deque<size_t> taskIndexList;
+        };
+
+        void WorkerThread(size_t threadIndex);
+
+        // Runs tasks from this thread's own queue, then steals from the others until every queue is empty.
+        void RunTasks(size_t threadIndex);
+
+        bool PopOwnTask(size_t threadIndex, size_t& taskIndex);
+        bool StealTask(size_t threadIndex, size_t& taskIndex);
+
+        std::vector<std::unique_ptr<TaskQueue>> queueList;
+        std::vector<std::thread> threadList;
+
+        // The following members are guarded by 'mutex'.
+        std::mutex mutex;
+        std::condition_variable batchStarted;
+        std::condition_variable batchFinished;
+        const Task* currentTask;
+        size_t batchNumber;
+        size_t busyThreadCount;
+        bool isStopping;
+        std::exception_ptr firstError;
+
+        // Set when a task throws, so that the remaining tasks of the batch are abandoned.
+        std::atomic<bool> isBatchFailed;
+    };
+}
+
+#endif
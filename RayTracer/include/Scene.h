@@ -5,14 +5,21 @@
 #include "LightSource.h"
 #include "ImageBuffer.h"
 #include "SolidObject.h"
+#include "BoundingVolumeHierarchy.h"
+#include "TraceContext.h"
 #include "PixelCoordinates.h"
+#include "PixelRect.h"
 
 namespace RayTracer
 {
+    class RenderThreadPool;
+
 	/**
      * The Scene object renders a collection of SolidObjects and ightSources that illuminate them.
      * SolidObjects are added one by one using the method AddSolidObject.
      * Likewise, LightSources are added using AddLightSource.
+     * Tracing rays never modifies the Scene: all scratch memory comes from the TraceContext passed in by the caller,
+     * so once the scene is set up, several threads may render from it at the same time, each with its own TraceContext.
      */
 	class Scene
 	{
@@ -58,28 +65,86 @@ namespace RayTracer
          */
         double ambientRefraction;
 
-        // Help performance by avoiding constant construction/destruction of intersection lists.
-        mutable std::vector<Intersection> cachedIntersectionList;
-
         std::vector<DebugPoint> debugPointList;
         boost::shared_ptr<DebugPoint> activeDebugPoint;
 
+        /**
+         * Acceleration structure over solidObjectList, rebuilt at the start of every render.
+         * It is derived data, so it is never serialized.
+         */
+        mutable BoundingVolumeHierarchy boundingVolumeHierarchy;
+
+        // When false, every ray is tested against every solid; used to compare against the hierarchy.
+        bool useBoundingVolumeHierarchy;
+
+        // The number of threads SaveImage renders with; 0 means one per hardware thread. Not serialized: it belongs to the machine, not the scene.
+        size_t renderThreadCount;
+
 	public:
 
 		explicit Scene(const Color& _backgroundColor = Color())
 			: backgroundColor(_backgroundColor)
 			, ambientRefraction(REFRACTION_VACUUM)	
+			, useBoundingVolumeHierarchy(true)
+			, renderThreadCount(0)
 		{
             activeDebugPoint = boost::shared_ptr<DebugPoint>(new DebugPoint());
 		}
 
         ImageBuffer CreateImageBuffer(size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor);
 
-        PixelData GetPixelAt(size_t iPos, size_t jPos, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor);
+        // Traces a single oversampled pixel. Safe to call from several threads at once, provided each passes its own 'context'.
+        PixelData GetPixelAt(size_t iPos, size_t jPos, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor, TraceContext& context) const;
 
-        void HandleAmbigousPixels(ImageBuffer& buffer, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor);
+        void HandleAmbigousPixels(ImageBuffer& buffer, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor) const;
 
-        void CreateImage(const std::string& imageName, ImageBuffer& buffer, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor);
+        void CreateImage(const std::string& imageName, ImageBuffer& buffer, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor) const;
+
+        // Writes an image whose pixels are already at final resolution, scaling the brightness by maxColorValue as CreateImage above does.
+        void CreateImage(const std::string& imageName, const ImageBuffer& pixels, double maxColorValue) const;
+
+        /**
+         * Anti-aliasing on the worker: traces the oversampled pixels behind the final pixels [left, left + width) x [top, top + height),
+         * heals the ambiguous ones and averages them down, so that only final pixels have to be sent back.
+         * Healing looks at neighboring oversampled pixels, so a halo one oversampled pixel wide is traced around the rectangle
+         * (where it lies inside the image) but not returned; the pixels come out exactly as HandleAmbigousPixels and CreateImage
+         * would make them from the whole image. The rectangle also carries the largest color value among its oversampled pixels,
+         * which is what CreateImage scales the brightness by.
+         * The oversampled pixels are traced on 'threadPool', each thread with its own entry of 'contextList', in tiles
+         * of tileSize x tileSize final pixels taken in Morton order (see TraceTile).
+         */
+        PixelRect RenderDownsampledRect(
+            size_t left,
+            size_t top,
+            size_t width,
+            size_t height,
+            size_t pixelsWide,
+            size_t pixelsHigh,
+            double zoom,
+            size_t antiAliasFactor,
+            size_t tileSize,
+            RenderThreadPool& threadPool,
+            std::vector<TraceContext>& contextList,
+            bool useFloatColors) const;
+
+        /**
+         * Traces the pixels [left, left + width) x [top, top + height) of 'buffer' in Morton order, where pixel (i, j)
+         * of the buffer is the oversampled pixel (iOffset + i, jOffset + j) of the image. Rays traced one after the other
+         * are then close together, so they mostly meet the same solids and bounding boxes, still in the cache.
+         */
+        void TraceTile(
+            ImageBuffer& buffer,
+            size_t iOffset,
+            size_t jOffset,
+            size_t left,
+            size_t top,
+            size_t width,
+            size_t height,
+            size_t pixelsWide,
+            size_t pixelsHigh,
+            double zoom,
+            size_t antiAliasFactor,
+            TraceContext& context) const;
 
         friend class access;
         template<class Archive>
@@ -92,13 +157,16 @@ namespace RayTracer
             ar & lightSourceList;
             // double
             ar & ambientRefraction;
-            // std::vector<Intersection>
-            ar & cachedIntersectionList;
             // DebugPointList
             ar & debugPointList;
             // DebugPoint*
             ar & activeDebugPoint;
 
+            // A loaded scene has a brand new set of solids, and it is about to be rendered, so index them right away.
+            if (Archive::is_loading::value)
+            {
+                BuildBoundingVolumeHierarchy();
+            }
         }
 
 		virtual ~Scene()
@@ -113,6 +181,7 @@ namespace RayTracer
         SolidObject& AddSolidObject(boost::shared_ptr<SolidObject> solidObject)
 		{
 			solidObjectList.push_back(solidObject);
+            boundingVolumeHierarchy.Clear();
             return *solidObject;
 		}
 
@@ -128,6 +197,7 @@ namespace RayTracer
 		 * The zoom factor specifies magnification level: use 1.0 to start with, and try larger/smaller values to increase/decrease magnification.
 		 * antiAliasFactor specifies what multiplier to use for oversampling.  Note that this causes run time and memory usage to increase O(N^2), so it is best 
          * to use a value between 1 (fastest but most "jaggy") to 4 (16 times slower but results in much smoother images).
+		 * The image is rendered in tiles spread over the number of threads set by SetRenderThreadCount.
 		 */
         void SaveImage(
 			const char *outPngFileName,
@@ -152,40 +222,71 @@ namespace RayTracer
 			debugPointList.push_back(DebugPoint(iPixel, jPixel));
 		}
 
+        /**
+         * Builds the bounding volume hierarchy over the current solids.
+         * SaveImage and loading a serialized scene do this on their own; callers that trace individual pixels with GetPixelAt
+         * must call this again if they add, move or rotate solids afterwards.  Until it is built, rays are tested against every solid.
+         * This must not be called while other threads are tracing rays through the scene.
+         */
+        void BuildBoundingVolumeHierarchy() const
+        {
+            boundingVolumeHierarchy.Build(solidObjectList);
+        }
+
+        // Enables (the default) or disables the bounding volume hierarchy. Both settings render identical images.
+        void SetUseBoundingVolumeHierarchy(bool enable)
+        {
+            useBoundingVolumeHierarchy = enable;
+        }
+
+        /**
+         * Sets how many threads SaveImage uses to render.  The default of 0 uses one thread per hardware thread; 1 renders on the calling thread only.
+         * Every thread count produces exactly the same image.
+         */
+        void SetRenderThreadCount(size_t threadCount)
+        {
+            renderThreadCount = threadCount;
+        }
+
 	private:
 		void ClearSolidObjectList();
 
 		int FindClosestIntersection(
 			const Vector& vantage,
 			const Vector& direction,
-			Intersection& intersection) const;
+			Intersection& intersection,
+			TraceContext& context) const;
 
 		bool HasClearLineOfSight(
 			const Vector& point1,
-			const Vector& point2) const;
+			const Vector& point2,
+			TraceContext& context) const;
 
 		Color TraceRay(
 			const Vector& vantage,
 			const Vector& direction,
 			double refractiveIndex,
 			Color rayIntensity,
-			int recursionDepth) const;
+			int recursionDepth,
+			TraceContext& context) const;
 
 		Color CalculateLighting(
 			const Intersection& intersection,
 			const Vector& direction,
 			double refractiveIndex,
 			Color rayIntensity,
-			int recursionDepth) const;
+			int recursionDepth,
+			TraceContext& context) const;
 
-		Color CalculateMatte(const Intersection& intersection) const;
+		Color CalculateMatte(const Intersection& intersection, TraceContext& context) const;
 
 		Color CalculateReflection(
 			const Intersection& intersection,
 			const Vector& incidentDir,
 			double refractiveIndex,
 			Color rayIntensity,
-			int recursionDepth) const;
+			int recursionDepth,
+			TraceContext& context) const;
 
 		Color CalculateRefraction(
 			const Intersection& intersection,
@@ -193,9 +294,10 @@ namespace RayTracer
 			double sourceRefractiveIndex,
 			Color rayIntensity,
 			int recursionDepth,
-			double& outReflectionFactor) const;
+			double& outReflectionFactor,
+			TraceContext& context) const;
 
-        boost::shared_ptr<SolidObject> PrimaryContainer(const Vector& point) const;
+        boost::shared_ptr<SolidObject> PrimaryContainer(const Vector& point, TraceContext& context) const;
 
 		double PolarizedReflection(
 			double n1,              // source material's index of refraction
@@ -205,6 +307,9 @@ namespace RayTracer
 
 		void ResolveAmbiguousPixel(ImageBuffer& buffer, size_t i, size_t j) const;
 
+        // Averages the antiAliasFactor x antiAliasFactor oversampled pixels whose top left one is (iFirst, jFirst).
+        static Color DownsamplePixel(const ImageBuffer& buffer, size_t iFirst, size_t jFirst, size_t antiAliasFactor);
+
         /**
 		 * Convert a floating point color component value, 
 		 * based on the maximum component value,
@@ -3,6 +3,8 @@
 
 #include <boost/archive/text_iarchive.hpp>                                                                                                                                                                     
 #include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/base_object.hpp>
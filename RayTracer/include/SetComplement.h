@@ -33,16 +33,34 @@ namespace RayTracer
 			other = NULL;
 		}
 
-		virtual bool Contains(const Vector& point) const
+		virtual bool Contains(const Vector& point, TraceContext& context) const
 		{
 			// This is the core of the set complement: toggling the value of any point containment.
-			return !other->Contains(point);
+			return !other->Contains(point, context);
+		}
+
+		virtual BoundingBox GetBoundingBox() const
+		{
+			// The complement reports the same surface points as the nested solid, but it has to be treated as unbounded:
+			// every point outside the nested solid is inside the complement.
+			return BoundingBox();
 		}
 
 		virtual void AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
+
+		virtual bool HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const
+		{
+			// The complement has the same surface as the nested solid; only the normals are flipped.
+			return other->HasIntersectionCloserThan(vantage, direction, maxDistanceSquared, context);
+		}
 
 		virtual SolidObject& Translate(double dx, double dy, double dz)
 		{
@@ -27,14 +27,23 @@ namespace RayTracer
 		virtual void AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
 
-		virtual bool Contains(const Vector& point) const
+		virtual bool HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const;
+
+		virtual bool Contains(const Vector& point, TraceContext& context) const
 		{
 			// A point is inside the set intersection if it is inside both of the nested solids.
-			return Left().Contains(point) && Right().Contains(point);
+			return Left().Contains(point, context) && Right().Contains(point, context);
 		}
 
+		virtual BoundingBox GetBoundingBox() const;
+
 	private:
      
 		void AppendOverlappingIntersections(
@@ -42,13 +51,16 @@ namespace RayTracer
 			const Vector& direction,
 			const SolidObject& aSolid,
 			const SolidObject& bSolid,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
 
 		bool HasOverlappingIntersection(
 			const Vector& vantage,
 			const Vector& direction,
 			const SolidObject& aSolid,
-			const SolidObject& bSolid) const;
+			const SolidObject& bSolid,
+			double maxDistanceSquared,
+			TraceContext& context) const;
 	};
 }
 
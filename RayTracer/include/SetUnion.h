@@ -24,12 +24,31 @@ namespace RayTracer
 		virtual void AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
 
-		virtual bool Contains(const Vector& point) const
+		virtual bool HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const
+		{
+			// Every intersection with either nested solid is an intersection with the union.
+			return
+				Left().HasIntersectionCloserThan(vantage, direction, maxDistanceSquared, context) ||
+				Right().HasIntersectionCloserThan(vantage, direction, maxDistanceSquared, context);
+		}
+
+		virtual bool Contains(const Vector& point, TraceContext& context) const
 		{
 			// A point is inside the set union if it is in either of the nested solids.
-			return Left().Contains(point) || Right().Contains(point);
+			return Left().Contains(point, context) || Right().Contains(point, context);
+		}
+
+		virtual BoundingBox GetBoundingBox() const
+		{
+			// Every intersection comes from one of the nested solids, so the union of their boxes encloses them all.
+			return Left().GetBoundingBox().Include(Right().GetBoundingBox());
 		}
 	};
 }
@@ -5,9 +5,12 @@
 #include "Taggable.h"
 #include "Vector.h"
 #include "Intersection.h"
+#include "BoundingBox.h"
 
 namespace RayTracer
 {
+	class TraceContext;
+
 	class SolidObject: public Taggable
 	{
 	public:
@@ -22,11 +25,16 @@ namespace RayTracer
 		{
 		}
 
-		// Appends to 'intersectionList' all the intersections found starting at the specified vantage point in the direction of the direction vector.
+        /**
+		 * Appends to 'intersectionList' all the intersections found starting at the specified vantage point in the direction of the direction vector.
+		 * Any scratch memory needed along the way is borrowed from 'context', never stored in the solid, so that
+		 * several threads may query the same solid at once as long as each passes its own TraceContext.
+		 */
 		virtual void AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const = 0;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const = 0;
 
 		/**
          * Searches for any intersections with this solid from the vantage point in the given direction.  
@@ -40,11 +48,30 @@ namespace RayTracer
         int FindClosestIntersection(
 			const Vector& vantage,
 			const Vector& direction,
-			Intersection &intersection) const
+			Intersection &intersection,
+			TraceContext& context) const;
+
+        /**
+		 * Returns true if this solid has at least one intersection with the ray starting at 'vantage' in the given direction
+		 * whose squared distance from the vantage point is less than maxDistanceSquared.
+		 * This is the question shadow rays ask, and it does not need the closest intersection, surface normals or an intersection list.
+		 * The default implementation collects all intersections; derived classes should override it with a test that returns
+		 * as soon as any qualifying intersection is found.  Overrides must accept exactly the intersections AppendAllIntersections reports.
+		 */
+        virtual bool HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const;
+
+        /**
+		 * Returns an axis-aligned box, in camera space, that encloses every point where a ray can intersect this solid.
+		 * The default is an unbounded box, which is always correct but prevents the Scene from skipping this solid for rays that miss it.
+		 * Derived classes should override this whenever they can tell where their surface ends.
+		 */
+        virtual BoundingBox GetBoundingBox() const
 		{
-			cachedIntersectionList.clear();
-			AppendAllIntersections(vantage, direction, cachedIntersectionList);
-			return PickClosestIntersection(cachedIntersectionList, intersection);
+			return BoundingBox();
 		}
 
         /**
@@ -52,7 +79,7 @@ namespace RayTracer
 		 * that enter or exit the solid in a given direction from the point.
 		 * Derived classes can often implement a more efficient algorithm to override this default algorithm.
          */
-		virtual bool Contains(const Vector& point) const;
+		virtual bool Contains(const Vector& point, TraceContext& context) const;
 
         /**
 		 * Returns the optical properties (reflection and refraction) at a given point on the surface of this solid.
@@ -179,8 +206,6 @@ namespace RayTracer
             ar & uniformOptics;
             ar & refractiveIndex;
             ar & const_cast<bool&>(isFullyEnclosed);
-            ar & cachedIntersectionList;
-            ar & enclosureList;
         }
 
 	protected:
@@ -211,13 +236,6 @@ namespace RayTracer
 		 * Many derived classes will override the Contains() method and therefore make this flag irrelevant.
 		 */
         const bool isFullyEnclosed;
-
-        /**
-		 * The following members are an optimization to minimize the overhead and fragmentation caused by repeated 
-		 * memory allocations creating and destroying std::vector contents.
-		 */
-        mutable std::vector<Intersection> cachedIntersectionList;
-		mutable std::vector<Intersection> enclosureList;
 	};
 }
 
@@ -85,12 +85,6 @@ namespace RayTracer
 			double a,
 			double b);
 
-		/**
-         * The following list is for caching and filtering  intersections with the left and right nested solids.
-		 * It is mutable to allow modification from const methods.
-		 */
-        mutable std::vector<Intersection> tempIntersectionList;
-
 	private:
        
 		SolidObject* left;
@@ -48,15 +48,33 @@ namespace RayTracer
         virtual void AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
+
+		virtual bool HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const
+		{
+			// Rotation preserves lengths, so distances measured in object space can be compared with the camera space limit as they are.
+			return ObjectSpace_HasIntersectionCloserThan(
+				ObjectPointFromCameraPoint(vantage),
+				ObjectDirFromCameraDir(direction),
+				maxDistanceSquared,
+				context);
+		}
 
 		virtual SolidObject& RotateX(double angleInDegrees);
 		virtual SolidObject& RotateY(double angleInDegrees);
 		virtual SolidObject& RotateZ(double angleInDegrees);
 
-		virtual bool Contains(const Vector& point) const
+        // Converts the box reported by ObjectSpace_GetBoundingBox into a camera space box that encloses it at the current orientation.
+		virtual BoundingBox GetBoundingBox() const;
+
+		virtual bool Contains(const Vector& point, TraceContext& context) const
 		{
-			return ObjectSpace_Contains(ObjectPointFromCameraPoint(point));
+			return ObjectSpace_Contains(ObjectPointFromCameraPoint(point), context);
 		}
 
 		virtual Optics SurfaceOptics(
@@ -73,18 +91,36 @@ namespace RayTracer
 		/*
          * The following method is called by AppendAllIntersections, but with 'vantage' and 'direction' vectors transformed from <x,y,z> camera space into <r,s,t> object space.
 		 * Intersection objects are returned in terms of object coordinates, and they are automatically translated back into camera coordinates by the caller.
+		 * 'context' is the one passed to AppendAllIntersections, for object spaces that are themselves made of other solids (see Instance).
 		 */
         virtual void ObjectSpace_AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const = 0;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const = 0;
         
+        // The object space counterpart of HasIntersectionCloserThan, called with transformed 'vantage' and 'direction' vectors.
+        virtual bool ObjectSpace_HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const = 0;
+
         /**
 		 * Returns true if the specified point in object space is on or inside the solid object.
 		 * Actually, well-behaved derived classes should provide a tolerance for points slightly outside the object's boundaries and return true then also.
 		 * This tolerance handles small floating point rounding  errors that may cause a point that is supposed to be  considered part of the solid to be incorrectly excluded.
 		 */
-        virtual bool ObjectSpace_Contains(const Vector& point) const = 0;
+        virtual bool ObjectSpace_Contains(const Vector& point, TraceContext& context) const = 0;
+
+        /**
+		 * Returns a box in <r,s,t> object space that encloses every intersection ObjectSpace_AppendAllIntersections can report.
+		 * The default is an unbounded box.
+		 */
+        virtual BoundingBox ObjectSpace_GetBoundingBox() const
+		{
+			return BoundingBox();
+		}
 
 		virtual Optics ObjectSpace_SurfaceOptics(
 			const Vector& surfacePoint,
@@ -18,9 +18,16 @@ namespace RayTracer
 		virtual void AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
 
-		virtual bool Contains(const Vector& point) const
+		virtual bool HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const;
+
+		virtual bool Contains(const Vector& point, TraceContext& context) const
 		{
 			/*
              * Add a little bit to the actual radius to be more tolerant
@@ -32,6 +39,12 @@ namespace RayTracer
 			return (point - Center()).MagnitudeSquared() <= (r * r);
 		}
 
+		virtual BoundingBox GetBoundingBox() const
+		{
+			const Vector extent(radius, radius, radius);
+			return BoundingBox(Center() - extent, Center() + extent);
+		}
+
 		// The nice thing about a sphere is that rotating it has no effect on its appearance!
 		virtual SolidObject& RotateX(double angleInDegrees)
 		{
@@ -38,9 +38,16 @@ namespace RayTracer
 		virtual void ObjectSpace_AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
 
-		virtual bool ObjectSpace_Contains(const Vector& point) const
+		virtual bool ObjectSpace_HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const;
+
+		virtual bool ObjectSpace_Contains(const Vector& point, TraceContext& context) const
 		{
 			const double xr = point.x / a;
 			const double yr = point.y / b;
@@ -48,6 +55,11 @@ namespace RayTracer
 			return xr*xr + yr*yr + zr*zr <= 1.0 + EPSILON;
 		}
 
+		virtual BoundingBox ObjectSpace_GetBoundingBox() const
+		{
+			return BoundingBox(Vector(-a, -b, -c), Vector(+a, +b, +c));
+		}
+
 	private:
       
 		const double  a;      // radius along the x-axis
@@ -24,7 +24,6 @@ namespace RayTracer
             ar & boost::serialization::base_object<SolidObject_Reorientable>(*this);
             ar & r1;
             ar & r1;
-            ar & tempIntersectionList;
         }
 
 	protected:
@@ -32,9 +31,16 @@ namespace RayTracer
 		virtual void ObjectSpace_AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
 
-		virtual bool ObjectSpace_Contains(const Vector& point) const
+		virtual bool ObjectSpace_HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const;
+
+		virtual bool ObjectSpace_Contains(const Vector& point, TraceContext& context) const
 		{
 			if(fabs(point.z) <= EPSILON)
 			{
@@ -47,6 +53,13 @@ namespace RayTracer
 			return false;
 		}
 
+		// Intersections are accepted up to a squared radius of r2*r2 + EPSILON, all on the plane z = 0.
+		virtual BoundingBox ObjectSpace_GetBoundingBox() const
+		{
+			const double radius = sqrt(r2*r2 + EPSILON);
+			return BoundingBox(Vector(-radius, -radius, 0.0), Vector(+radius, +radius, 0.0));
+		}
+
 	private:
 
         // The radius of the hole at the center of the ring.
@@ -54,12 +67,6 @@ namespace RayTracer
 
         // The outer radius of the ring.
 		double  r2;     
-        
-        /**
-		 * A temporary intersection list, cached inside this object to avoid repeated memory allocations.
-		 * Marked mutable to allow const functions to cache lists whose memory may be reused as needed.
-		 */
-        mutable std::vector<Intersection> tempIntersectionList;
 	};
 }
 
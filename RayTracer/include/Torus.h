@@ -32,9 +32,18 @@ namespace RayTracer
         virtual void ObjectSpace_AppendAllIntersections(
             const Vector& vantage,
             const Vector& direction,
-            std::vector<Intersection>& intersectionList) const;
+            std::vector<Intersection>& intersectionList,
+            TraceContext& context) const;
 
-        virtual bool ObjectSpace_Contains(const Vector& point) const;
+        virtual bool ObjectSpace_HasIntersectionCloserThan(
+            const Vector& vantage,
+            const Vector& direction,
+            double maxDistanceSquared,
+            TraceContext& context) const;
+
+        virtual bool ObjectSpace_Contains(const Vector& point, TraceContext& context) const;
+
+        virtual BoundingBox ObjectSpace_GetBoundingBox() const;
 
         int SolveIntersections(
             const Vector& vantage,
@@ -0,0 +1,102 @@
+#ifndef _TRACE_CONTEXT_H_
+#define _TRACE_CONTEXT_H_
+
+#include "SolidObject.h"
+
+#include <deque>
+#include <vector>
+
+namespace RayTracer
+{
+    /**
+     * Scratch memory for tracing rays through a Scene.
+     * Rendering only reads the Scene and its solids; every list that tracing a ray has to fill in lives here instead.
+     * Each thread that traces rays must use its own TraceContext, and then any number of threads can share one Scene without locking.
+     * A context keeps its memory between rays, so reusing the same context for a whole image avoids repeated allocations.
+     */
+    class TraceContext
+    {
+    public:
+
+        TraceContext()
+            : depth(0)
+        {
+        }
+
+        /**
+         * Borrows an empty intersection list from a TraceContext for as long as this object lives.
+         * Borrowing nests: a solid may borrow a list and, while iterating over it, call into nested solids
+         * (e.g. Contains() of a CSG operand) that borrow lists of their own.
+         */
+        class ScratchIntersectionList
+        {
+        public:
+
+            explicit ScratchIntersectionList(TraceContext& _context)
+                : context(_context)
+                , list(_context.AcquireList())
+            {
+            }
+
+            ~ScratchIntersectionList()
+            {
+                context.ReleaseList();
+            }
+
+            std::vector<Intersection>& List() const
+            {
+                return list;
+            }
+
+        private:
+
+            ScratchIntersectionList(const ScratchIntersectionList&);
+            ScratchIntersectionList& operator = (const ScratchIntersectionList&);
+
+            TraceContext& context;
+            std::vector<Intersection>& list;
+        };
+
+        // The span of an intersection list that one solid appended; used by BoundingVolumeHierarchy to restore scene order.
+        struct SolidIntersectionRange
+        {
+            size_t solidIndex;
+            size_t begin;
+            size_t end;
+
+            bool operator < (const SolidIntersectionRange& other) const
+            {
+                return solidIndex < other.solidIndex;
+            }
+        };
+
+        std::vector<SolidIntersectionRange> solidIntersectionRangeList;
+
+    private:
+
+        TraceContext(const TraceContext&);
+        TraceContext& operator = (const TraceContext&);
+
+        std::vector<Intersection>& AcquireList()
+        {
+            if (depth == listStack.size())
+            {
+                listStack.push_back(std::vector<Intersection>());
+            }
+            std::vector<Intersection>& list = listStack[depth++];
+            list.clear();
+            return list;
+        }
+
+        void ReleaseList()
+        {
+            --depth;
+        }
+
+        // A deque, so that growing the stack never moves lists that are still borrowed.
+        std::deque<std::vector<Intersection>> listStack;
+        size_t depth;
+    };
+}
+
+#endif
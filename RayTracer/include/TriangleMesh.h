@@ -2,8 +2,15 @@
 #define _TRIANGLE_MESH_H_
 
 #include "stdafx.h"
+#include "BoxTree.h"
 #include "SolidObject.h"
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
 namespace RayTracer
 {
     /**
@@ -12,6 +19,8 @@ namespace RayTracer
      * to append a series of vertex points,
      * followed by AddTriangle() to refer to the indices
      * of previously added points.
+     * Rays are tested against the triangles through a BoxTree over them, built
+     * with the first ray after the triangles were added, moved or rotated.
      */
 	class TriangleMesh: public SolidObject
 	{
@@ -21,6 +30,9 @@ namespace RayTracer
 			const Vector& center = Vector(),
 			bool _isFullyEnclosed = true)
 			: SolidObject(center, _isFullyEnclosed)
+			, boundingBox(BoundingBox::Empty())
+			, isTriangleTreeBuilt(false)
+			, useTriangleTree(true)
 		{
 			SetTag("TriangleMesh");
 		}
@@ -28,7 +40,14 @@ namespace RayTracer
 		virtual void AppendAllIntersections(
 			const Vector& vantage,
 			const Vector& direction,
-			std::vector<Intersection>& intersectionList) const;
+			std::vector<Intersection>& intersectionList,
+			TraceContext& context) const;
+
+		virtual bool HasIntersectionCloserThan(
+			const Vector& vantage,
+			const Vector& direction,
+			double maxDistanceSquared,
+			TraceContext& context) const;
 
 		virtual SolidObject& Translate(double dx, double dy, double dz);
 		virtual SolidObject& RotateX(double angleInDegrees);
@@ -56,6 +75,45 @@ namespace RayTracer
 			}
 
 			pointList.push_back(Vector(x, y, z));
+			boundingBox.Include(pointList.back());
+		}
+
+		size_t GetNumTriangles() const
+		{
+			return triangleList.size();
+		}
+
+		// The vertices of a triangle, in the counterclockwise order it was added with.
+		void GetTriangle(size_t triangleIndex, Vector& a, Vector& b, Vector& c) const
+		{
+			const Triangle& triangle = triangleList.at(triangleIndex);
+			a = pointList[triangle.a];
+			b = pointList[triangle.b];
+			c = pointList[triangle.c];
+		}
+
+		virtual BoundingBox GetBoundingBox() const
+		{
+			return boundingBox;
+		}
+
+		// Enables (the default) or disables the tree over the triangles. Both settings find exactly the same intersections.
+		void SetUseTriangleTree(bool enable)
+		{
+			useTriangleTree = enable;
+		}
+
+        /**
+		 * Returns the index of 'optics' in this mesh's material table, adding it unless an equal material is
+		 * there already. Triangles refer to their optics by this index rather than each holding a copy, so a mesh
+		 * whose faces share a few materials stores and serializes each of them once.
+		 * The table is looked up through materialIndex, so a mesh with a material per face is still built in O(n log n).
+		 */
+		size_t AddMaterial(const Optics& optics);
+
+		size_t GetNumMaterials() const
+		{
+			return materialList.size();
 		}
 
         /*
@@ -117,15 +175,32 @@ namespace RayTracer
         {
             pointList.clear();
             triangleList.clear();
+            geometryList.clear();
+            materialList.clear();
+            materialIndex.clear();
         }
 
+        // Parses mesh files straight into pointList and triangleList.
+        friend class MeshImporter;
+
         friend class access;
         template<class Archive>
         void serialize(Archive & ar, const unsigned int version)
         {
             ar & boost::serialization::base_object<SolidObject>(*this);
             ar & pointList;
+            ar & materialList;
             ar & triangleList;
+
+            /**
+             * The box and the triangle geometry are derived from the points, so they are rebuilt on loading rather than stored.
+             * Saving leaves the mesh untouched, so a mesh may be saved while other threads render it.
+             */
+            if (Archive::is_loading::value)
+            {
+                UpdateGeometry();
+                UpdateMaterialIndex();
+            }
         }
 
 	protected:
@@ -137,52 +212,17 @@ namespace RayTracer
 			}
 		}
 
-        /**
-		 * Attempts to find an intersection of the given direction 
-		 * passing through the given vantage point with the plane 
-		 * that passes through the triangle (A, B, C).
-		 * If an intersection can be found, returns true and sets 
-		 * the output parameters:
-		 *
-		 *     u = The scalar multiple such that the intersection 
-		 *         point = (u*direction + vantage).
-		 *
-		 *     v = The component of the vector difference B-A, 
-		 *         starting at A, of the intersection point.
-		 *
-		 *     w = The component of the vector difference C-A, 
-		 *         starting at A, of the intersection point.
-		 *
-		 * Returns false and leaves u, v, w undefined if an 
-		 * intersection cannot be found.
-		 * Note that it is possible that calling AttemptPlaneIntersection 
-		 * may succeed with one ordering of the plane points (A, B, C), 
-		 * but may fail on another ordering.
-         */
-		static bool AttemptPlaneIntersection(
-			const Vector& vantage,
-			const Vector& direction,
-			const Vector& A,
-			const Vector& B,
-			const Vector& C,
-			double &u,
-			double &v,
-			double &w)
-		{
-			return Algebra::SolveLinearEquations(
-				direction.x, A.x - B.x, A.x - C.x, -(A.x - vantage.x),
-				direction.y, A.y - B.y, A.y - C.y, -(A.y - vantage.y),
-				direction.z, A.z - B.z, A.z - C.z, -(A.z - vantage.z),
-				u,
-				v,
-				w);
-		}
-
 		Vector GetPointFromIndex(int pointIndex) const
 		{
 			return pointList[pointIndex];
 		}
 
+		// Recalculates boundingBox and geometryList from scratch after the points have been moved, and drops the triangle tree.
+		void UpdateGeometry();
+
+		// The tree over the triangles, built here by whichever thread asks first after the triangles last changed.
+		const BoxTree& GetTriangleTree() const;
+
 	private:
 
         struct Triangle
@@ -191,15 +231,15 @@ namespace RayTracer
             int b;  // index into pointList for second vertex of the triangle
             int c;  // index into pointList for third  vertex of the triangle
 
-            Optics optics;      // surface color of the triangle
+            std::uint32_t material;    // index into materialList of the surface color of the triangle
 
             Triangle(
                 int _a = 0, int _b = 0, int _c = 0, 
-                const Optics& _optics = Optics(Color(0.0, 0.0, 0.0), Color(0.0, 0.0, 0.0), 1.0))
+                std::uint32_t _material = 0)
                 : a(_a)
                 , b(_b)
                 , c(_c)
-                , optics(_optics)
+                , material(_material)
             {
             }
 
@@ -210,18 +250,72 @@ namespace RayTracer
                 ar & a;
                 ar & b;
                 ar & c;
-                ar & optics;
+                ar & material;
             }
         };
 
-        // Returns a unit vector at right angles to the triangle, using right-hand rule with respect to A,B,C ordering.
-        Vector NormalVector(const Triangle& triangle) const;
+        /**
+         * What the ray test needs of one triangle, computed once from its points instead of on every ray:
+         * vertex A, the edges from A to B and from A to C, and the unit vector at right angles to the
+         * triangle, using right-hand rule with respect to A,B,C ordering, which points out of the solid.
+         */
+        struct TriangleGeometry
+        {
+            Vector vertex;
+            Vector edgeAB;
+            Vector edgeAC;
+            Vector normal;
+        };
+
+        static TriangleGeometry MakeTriangleGeometry(const Vector& a, const Vector& b, const Vector& c);
+
+        /**
+         * Moller-Trumbore test of the given direction passing through the given vantage point against one triangle.
+         * If the ray meets the triangle, inside or on its border, at least EPSILON along the direction, returns true
+         * and sets 'u' such that the intersection point = (u*direction + vantage).
+         */
+        static bool IntersectTriangle(
+            const TriangleGeometry& geometry,
+            const Vector& vantage,
+            const Vector& direction,
+            double& u);
 
         // A list of all the vertex points used to define triangles. A given point may be referenced by one or more triangles.
         std::vector<Vector>       pointList;
 
-        // A list of all the triangles, each of which refers to 3 distinct points in pointList.
+        // The distinct optics of the triangles. A given material may be referenced by any number of triangles.
+        std::vector<Optics>      materialList;
+
+        /**
+         * The index in materialList of each material, keyed on every field Optics::operator== compares, in the same order.
+         * It is derived from materialList, so it is never serialized but rebuilt on loading.
+         */
+        typedef std::array<double, 7> MaterialKey;
+        std::map<MaterialKey, size_t> materialIndex;
+
+        static MaterialKey MakeMaterialKey(const Optics& optics);
+        void UpdateMaterialIndex();
+
+        // A list of all the triangles, each of which refers to 3 distinct points in pointList and to a material in materialList.
         std::vector<Triangle>    triangleList;
+
+        // The geometry of triangleList[i] at index i, kept up to date by AddTriangle, Translate and the rotation methods.
+        std::vector<TriangleGeometry> geometryList;
+
+        // The box enclosing pointList, kept up to date by AddPoint, Translate and the rotation methods.
+        BoundingBox              boundingBox;
+
+        /**
+         * Acceleration structure over triangleList; its item indexes are indexes into triangleList.
+         * It is derived data, so it is never serialized. Adding, moving or rotating triangles only marks it
+         * out of date, so building a mesh one triangle at a time does not rebuild the tree for every triangle.
+         */
+        mutable BoxTree                 triangleTree;
+        mutable std::atomic<bool>       isTriangleTreeBuilt;
+        mutable std::mutex              triangleTreeMutex;
+
+        // When false, every ray is tested against every triangle; used to compare against the tree.
+        bool                            useTriangleTree;
 	};
 }
 #endif
\ No newline at end of file
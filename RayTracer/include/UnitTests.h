@@ -29,6 +29,15 @@ namespace RayTracer
         void KaleidoscopeTest();
         void MultipleSphereTest();
         void ChessBoardTest();
+        void BoundingVolumeHierarchyBenchmark();
+        void ParallelRenderTest();
+        void DownsampledRenderTest();
+        void TiledRenderTest();
+        void TriangleMeshIntersectionTest();
+        void TriangleMeshBenchmark();
+        void MeshImportTest();
+        void InstancingTest();
+        void SerializationBenchmark();
         void UnitTests();
     }
 }
@@ -0,0 +1,218 @@
+#include "BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+
+/**
+ * Implements class BoundingVolumeHierarchy, a BoxTree over the solids of a Scene traversed front-to-back.
+ */
+namespace RayTracer
+{
+    namespace
+    {
+        /**
+         * Each solid's box is padded by this much so that a surface point computed with a little roundoff error
+         * never lands just outside its box.
+         */
+        const double BOX_PADDING = EPSILON;
+
+        /**
+         * PickClosestIntersection treats intersections within EPSILON of each other as ties.
+         * A subtree is only skipped when its box starts farther than the closest intersection so far plus this margin,
+         * so every intersection that could tie with the closest one still makes it into the candidate list.
+         */
+        const double CLOSEST_TIE_MARGIN = 4.0 * EPSILON;
+    }
+
+    void BoundingVolumeHierarchy::Clear()
+    {
+        isBuilt = false;
+        solidList.clear();
+        tree.Clear();
+        unboundedObjectList.clear();
+    }
+
+    void BoundingVolumeHierarchy::Build(const std::vector<boost::shared_ptr<SolidObject>>& solidObjectList)
+    {
+        Clear();
+
+        // Solids that cannot go into the tree keep an empty box, which the tree leaves out.
+        std::vector<BoundingBox> boxList(solidObjectList.size(), BoundingBox::Empty());
+        for (size_t index = 0; index < solidObjectList.size(); ++index)
+        {
+            const SolidObject* solid = solidObjectList[index].get();
+            solidList.push_back(solid);
+
+            const BoundingBox box = solid->GetBoundingBox();
+            if (box.IsEmpty())
+            {
+                // The solid has no surface at all, so no ray can ever hit it.
+                continue;
+            }
+            if (!box.IsFinite())
+            {
+                unboundedObjectList.push_back(index);
+                continue;
+            }
+
+            boxList[index] = BoundingBox(box).Expand(BOX_PADDING);
+        }
+
+        tree.Build(boxList);
+
+        isBuilt = true;
+    }
+
+    void BoundingVolumeHierarchy::AppendClosestCandidates(
+        const Vector& vantage,
+        const Vector& direction,
+        std::vector<Intersection>& intersectionList,
+        TraceContext& context) const
+    {
+        std::vector<TraceContext::SolidIntersectionRange>& hitRangeList = context.solidIntersectionRangeList;
+        hitRangeList.clear();
+        const size_t firstAppended = intersectionList.size();
+        const double directionMagnitudeSquared = direction.MagnitudeSquared();
+        double closestDistanceSquared = BoundingBox::Infinity();
+
+        auto appendSolid = [&](size_t objectIndex)
+        {
+            const size_t before = intersectionList.size();
+            solidList[objectIndex]->AppendAllIntersections(vantage, direction, intersectionList, context);
+            const size_t after = intersectionList.size();
+            if (after != before)
+            {
+                for (size_t i = before; i < after; ++i)
+                {
+                    closestDistanceSquared = std::min(closestDistanceSquared, intersectionList[i].distanceSquared);
+                }
+                TraceContext::SolidIntersectionRange range = { objectIndex, before, after };
+                hitRangeList.push_back(range);
+            }
+        };
+
+        for (size_t objectIndex : unboundedObjectList)
+        {
+            appendSolid(objectIndex);
+        }
+
+        if (!tree.IsEmpty())
+        {
+            const std::vector<BoxTree::Node>& nodeList = tree.GetNodeList();
+            const Vector inverseDirection = BoxTree::InverseDirection(direction);
+
+            struct StackEntry
+            {
+                size_t nodeIndex;
+                double uEnter;
+            };
+            StackEntry stack[BoxTree::TRAVERSAL_STACK_SIZE];
+            size_t stackSize = 0;
+
+            double uEnter;
+            if (nodeList[0].box.IntersectsRay(vantage, inverseDirection, BoundingBox::Infinity(), uEnter))
+            {
+                stack[stackSize].nodeIndex = 0;
+                stack[stackSize].uEnter = uEnter;
+                ++stackSize;
+            }
+
+            while (stackSize > 0)
+            {
+                --stackSize;
+                const BoxTree::Node& node = nodeList[stack[stackSize].nodeIndex];
+                const double u = stack[stackSize].uEnter;
+
+                // The box may have been pushed before a closer intersection was found; check again.
+                if (u * u * directionMagnitudeSquared > closestDistanceSquared + CLOSEST_TIE_MARGIN)
+                {
+                    continue;
+                }
+
+                if (node.itemCount > 0)
+                {
+                    for (size_t i = node.firstItem; i < node.firstItem + node.itemCount; ++i)
+                    {
+                        appendSolid(tree.GetItemIndex(i));
+                    }
+                    continue;
+                }
+
+                // Visit the nearer child first by pushing it last.
+                const size_t firstChild = tree.GetFirstChild(node);
+                double uFirst, uSecond;
+                const bool hitFirst = nodeList[firstChild].box.IntersectsRay(vantage, inverseDirection, BoundingBox::Infinity(), uFirst);
+                const bool hitSecond = nodeList[node.secondChild].box.IntersectsRay(vantage, inverseDirection, BoundingBox::Infinity(), uSecond);
+
+                if (hitFirst && hitSecond)
+                {
+                    const bool firstIsNearer = (uFirst <= uSecond);
+                    stack[stackSize].nodeIndex = firstIsNearer ? node.secondChild : firstChild;
+                    stack[stackSize].uEnter = firstIsNearer ? uSecond : uFirst;
+                    ++stackSize;
+                    stack[stackSize].nodeIndex = firstIsNearer ? firstChild : node.secondChild;
+                    stack[stackSize].uEnter = firstIsNearer ? uFirst : uSecond;
+                    ++stackSize;
+                }
+                else if (hitFirst)
+                {
+                    stack[stackSize].nodeIndex = firstChild;
+                    stack[stackSize].uEnter = uFirst;
+                    ++stackSize;
+                }
+                else if (hitSecond)
+                {
+                    stack[stackSize].nodeIndex = node.secondChild;
+                    stack[stackSize].uEnter = uSecond;
+                    ++stackSize;
+                }
+            }
+        }
+
+        /**
+         * PickClosestIntersection breaks near-ties by list order, so put the candidates back into scene order
+         * before handing them over.  Usually only one or two solids were hit and they are already in order.
+         */
+        if (!std::is_sorted(hitRangeList.begin(), hitRangeList.end()))
+        {
+            std::sort(hitRangeList.begin(), hitRangeList.end());
+
+            const TraceContext::ScratchIntersectionList reorderedIntersectionList(context);
+            for (const TraceContext::SolidIntersectionRange& range : hitRangeList)
+            {
+                reorderedIntersectionList.List().insert(
+                    reorderedIntersectionList.List().end(),
+                    intersectionList.begin() + range.begin,
+                    intersectionList.begin() + range.end);
+            }
+            std::copy(
+                reorderedIntersectionList.List().begin(),
+                reorderedIntersectionList.List().end(),
+                intersectionList.begin() + firstAppended);
+        }
+    }
+
+    bool BoundingVolumeHierarchy::HasIntersectionCloserThan(
+        const Vector& vantage,
+        const Vector& direction,
+        double maxDistanceSquared,
+        TraceContext& context) const
+    {
+        for (size_t objectIndex : unboundedObjectList)
+        {
+            if (solidList[objectIndex]->HasIntersectionCloserThan(vantage, direction, maxDistanceSquared, context))
+            {
+                return true;
+            }
+        }
+
+        // Only boxes that the ray enters before the maximum distance can hold a closer intersection.
+        return tree.VisitItemsAlongRay(
+            vantage,
+            BoxTree::InverseDirection(direction),
+            sqrt(maxDistanceSquared / direction.MagnitudeSquared()),
+            [&](size_t objectIndex)
+            {
+                return solidList[objectIndex]->HasIntersectionCloserThan(vantage, direction, maxDistanceSquared, context);
+            });
+    }
+}
@@ -0,0 +1,195 @@
+#include "BoxTree.h"
+
+#include <algorithm>
+
+/**
+ * Implements class BoxTree, a binary tree of axis-aligned boxes built with a binned surface area heuristic.
+ */
+namespace RayTracer
+{
+    namespace
+    {
+        const size_t SAH_BIN_COUNT = 12;
+        const size_t MAX_LEAF_SIZE = 8;
+
+        // Past this depth nodes are split at the median, which bounds the depth of the tree (and of the traversal stack).
+        const int MAX_SAH_DEPTH = 64;
+
+        // The relative cost of visiting a node compared to intersecting one item.
+        const double TRAVERSAL_COST = 1.0;
+
+        double Component(const Vector& v, int axis)
+        {
+            return (axis == 0) ? v.x : ((axis == 1) ? v.y : v.z);
+        }
+    }
+
+    void BoxTree::Build(const std::vector<BoundingBox>& itemBoxList)
+    {
+        Clear();
+
+        std::vector<BuildEntry> entryList;
+        entryList.reserve(itemBoxList.size());
+        for (size_t index = 0; index < itemBoxList.size(); ++index)
+        {
+            if (itemBoxList[index].IsEmpty())
+            {
+                continue;
+            }
+
+            BuildEntry entry;
+            entry.box = itemBoxList[index];
+            entry.centroid = entry.box.Centroid();
+            entry.itemIndex = index;
+            entryList.push_back(entry);
+        }
+
+        if (!entryList.empty())
+        {
+            nodeList.reserve(2 * entryList.size());
+            itemIndexList.reserve(entryList.size());
+            BuildNode(entryList, 0, entryList.size(), 0);
+        }
+    }
+
+    size_t BoxTree::BuildNode(std::vector<BuildEntry>& entryList, size_t begin, size_t end, int depth)
+    {
+        const size_t nodeIndex = nodeList.size();
+        nodeList.push_back(Node());
+
+        BoundingBox box = BoundingBox::Empty();
+        BoundingBox centroidBox = BoundingBox::Empty();
+        for (size_t i = begin; i < end; ++i)
+        {
+            box.Include(entryList[i].box);
+            centroidBox.Include(entryList[i].centroid);
+        }
+        nodeList[nodeIndex].box = box;
+
+        const size_t count = end - begin;
+
+        // Split along the axis where the centroids are spread the farthest.
+        const Vector spread = centroidBox.maxCorner - centroidBox.minCorner;
+        int axis = 0;
+        if (spread.y > spread.x)
+        {
+            axis = 1;
+        }
+        if (spread.z > Component(spread, axis))
+        {
+            axis = 2;
+        }
+        const double axisMin = Component(centroidBox.minCorner, axis);
+        const double axisSpread = Component(spread, axis);
+
+        size_t middle = begin;
+        if (count > 1 && axisSpread > 0.0)
+        {
+            if (depth < MAX_SAH_DEPTH)
+            {
+                // Binned surface area heuristic: try a split between each pair of adjacent bins and keep the cheapest.
+                BoundingBox binBox[SAH_BIN_COUNT];
+                size_t binCount[SAH_BIN_COUNT] = { 0 };
+                for (size_t b = 0; b < SAH_BIN_COUNT; ++b)
+                {
+                    binBox[b] = BoundingBox::Empty();
+                }
+
+                const double binScale = SAH_BIN_COUNT / axisSpread;
+                for (size_t i = begin; i < end; ++i)
+                {
+                    size_t b = static_cast<size_t>((Component(entryList[i].centroid, axis) - axisMin) * binScale);
+                    if (b >= SAH_BIN_COUNT)
+                    {
+                        b = SAH_BIN_COUNT - 1;
+                    }
+                    ++binCount[b];
+                    binBox[b].Include(entryList[i].box);
+                }
+
+                // Sweep from the right to know the cost of every right-hand side in advance.
+                double rightArea[SAH_BIN_COUNT];
+                size_t rightCount[SAH_BIN_COUNT];
+                BoundingBox accumulated = BoundingBox::Empty();
+                size_t accumulatedCount = 0;
+                for (size_t b = SAH_BIN_COUNT - 1; b > 0; --b)
+                {
+                    accumulated.Include(binBox[b]);
+                    accumulatedCount += binCount[b];
+                    rightArea[b] = accumulated.SurfaceArea();
+                    rightCount[b] = accumulatedCount;
+                }
+
+                const double parentArea = box.SurfaceArea();
+                double bestCost = static_cast<double>(count);
+                size_t bestSplit = 0;
+                accumulated = BoundingBox::Empty();
+                accumulatedCount = 0;
+                for (size_t b = 1; b < SAH_BIN_COUNT; ++b)
+                {
+                    accumulated.Include(binBox[b - 1]);
+                    accumulatedCount += binCount[b - 1];
+                    if (accumulatedCount == 0 || rightCount[b] == 0)
+                    {
+                        continue;
+                    }
+                    const double cost = TRAVERSAL_COST +
+                        (accumulated.SurfaceArea() * accumulatedCount + rightArea[b] * rightCount[b]) / parentArea;
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestSplit = b;
+                    }
+                }
+
+                if (bestSplit > 0)
+                {
+                    const BuildEntry* splitPoint = std::partition(
+                        entryList.data() + begin,
+                        entryList.data() + end,
+                        [&](const BuildEntry& entry)
+                        {
+                            size_t b = static_cast<size_t>((Component(entry.centroid, axis) - axisMin) * binScale);
+                            return b < bestSplit;
+                        });
+                    middle = splitPoint - entryList.data();
+                }
+            }
+
+            if ((middle == begin || middle == end) && (count > MAX_LEAF_SIZE || depth >= MAX_SAH_DEPTH))
+            {
+                // The heuristic prefers a leaf, but the leaf would be too big (or the tree too deep): split at the median.
+                middle = begin + count / 2;
+                std::nth_element(
+                    entryList.begin() + begin,
+                    entryList.begin() + middle,
+                    entryList.begin() + end,
+                    [axis](const BuildEntry& a, const BuildEntry& b)
+                    {
+                        return Component(a.centroid, axis) < Component(b.centroid, axis);
+                    });
+            }
+        }
+
+        if (middle == begin || middle == end)
+        {
+            // Make a leaf.
+            nodeList[nodeIndex].firstItem = itemIndexList.size();
+            nodeList[nodeIndex].itemCount = count;
+            nodeList[nodeIndex].secondChild = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                itemIndexList.push_back(entryList[i].itemIndex);
+            }
+            return nodeIndex;
+        }
+
+        BuildNode(entryList, begin, middle, 1 + depth);
+        const size_t secondChild = BuildNode(entryList, middle, end, 1 + depth);
+
+        nodeList[nodeIndex].firstItem = 0;
+        nodeList[nodeIndex].itemCount = 0;
+        nodeList[nodeIndex].secondChild = secondChild;
+        return nodeIndex;
+    }
+}
@@ -7,7 +7,8 @@ namespace RayTracer
 	void Cuboid::ObjectSpace_AppendAllIntersections(
 		const Vector& vantage,
 		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
 	{
 		double u;
 		Intersection intersection;
@@ -22,7 +23,7 @@ namespace RayTracer
 			{
 				displacement = u * direction;
 				intersection.point = vantage + displacement;
-				if(ObjectSpace_Contains(intersection.point))
+				if(ObjectSpace_Contains(intersection.point, context))
 				{
 					intersection.distanceSquared = displacement.MagnitudeSquared();
 					intersection.surfaceNormal = Vector(+1.0, 0.0, 0.0);
@@ -38,7 +39,7 @@ namespace RayTracer
 			{
 				displacement = u * direction;
 				intersection.point = vantage + displacement;
-				if(ObjectSpace_Contains(intersection.point))
+				if(ObjectSpace_Contains(intersection.point, context))
 				{
 					intersection.distanceSquared = displacement.MagnitudeSquared();
 					intersection.surfaceNormal = Vector(-1.0, 0.0, 0.0);
@@ -58,7 +59,7 @@ namespace RayTracer
 			{
 				displacement = u * direction;
 				intersection.point = vantage + displacement;
-				if(ObjectSpace_Contains(intersection.point))
+				if(ObjectSpace_Contains(intersection.point, context))
 				{
 					intersection.distanceSquared = displacement.MagnitudeSquared();
 					intersection.surfaceNormal = Vector(0.0, +1.0, 0.0);
@@ -74,7 +75,7 @@ namespace RayTracer
 			{
 				displacement = u * direction;
 				intersection.point = vantage + displacement;
-				if(ObjectSpace_Contains(intersection.point))
+				if(ObjectSpace_Contains(intersection.point, context))
 				{
 					intersection.distanceSquared = displacement.MagnitudeSquared();
 					intersection.surfaceNormal = Vector(0.0, -1.0, 0.0);
@@ -94,7 +95,7 @@ namespace RayTracer
 			{
 				displacement = u * direction;
 				intersection.point = vantage + displacement;
-				if(ObjectSpace_Contains(intersection.point))
+				if(ObjectSpace_Contains(intersection.point, context))
 				{
 					intersection.distanceSquared = displacement.MagnitudeSquared();
 					intersection.surfaceNormal = Vector(0.0, 0.0, +1.0);
@@ -110,7 +111,7 @@ namespace RayTracer
 			{
 				displacement = u * direction;
 				intersection.point = vantage + displacement;
-				if(ObjectSpace_Contains(intersection.point))
+				if(ObjectSpace_Contains(intersection.point, context))
 				{
 					intersection.distanceSquared = displacement.MagnitudeSquared();
 					intersection.surfaceNormal = Vector(0.0, 0.0, -1.0);
@@ -121,4 +122,40 @@ namespace RayTracer
 			}
 		}
 	}
+
+	bool Cuboid::ObjectSpace_HasIntersectionCloserThan(
+		const Vector& vantage,
+		const Vector& direction,
+		double maxDistanceSquared,
+		TraceContext& context) const
+	{
+		if(fabs(direction.x) > EPSILON)
+		{
+			if(IsFaceHitCloserThan((a - vantage.x) / direction.x, vantage, direction, maxDistanceSquared, context) ||
+				IsFaceHitCloserThan((-a - vantage.x) / direction.x, vantage, direction, maxDistanceSquared, context))
+			{
+				return true;
+			}
+		}
+
+		if(fabs(direction.y) > EPSILON)
+		{
+			if(IsFaceHitCloserThan((b - vantage.y) / direction.y, vantage, direction, maxDistanceSquared, context) ||
+				IsFaceHitCloserThan((-b - vantage.y) / direction.y, vantage, direction, maxDistanceSquared, context))
+			{
+				return true;
+			}
+		}
+
+		if(fabs(direction.z) > EPSILON)
+		{
+			if(IsFaceHitCloserThan((c - vantage.z) / direction.z, vantage, direction, maxDistanceSquared, context) ||
+				IsFaceHitCloserThan((-c - vantage.z) / direction.z, vantage, direction, maxDistanceSquared, context))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
 }
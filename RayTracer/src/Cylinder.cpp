@@ -7,7 +7,8 @@ namespace RayTracer
 	void Cylinder::ObjectSpace_AppendAllIntersections(
 		const Vector& vantage,
 		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
 	{
 		// Look for intersections with the disks on the top and/or bottom of the cylinder.
 		if(fabs(direction.z) > EPSILON)
@@ -49,6 +50,54 @@ namespace RayTracer
 		}
 	}
 
+	bool Cylinder::ObjectSpace_HasIntersectionCloserThan(
+		const Vector& vantage,
+		const Vector& direction,
+		double maxDistanceSquared,
+		TraceContext& context) const
+	{
+		// The top and bottom disks, tested exactly as in AppendDiskIntersection.
+		if(fabs(direction.z) > EPSILON)
+		{
+			const double zDisk[2] = { +b, -b };
+			for(int i = 0; i < 2; ++i)
+			{
+				const double u = (zDisk[i] - vantage.z) / direction.z;
+				if(u > EPSILON)
+				{
+					const Vector displacement = u * direction;
+					const Vector point = vantage + displacement;
+					if((point.x*point.x + point.y*point.y <= a*a) && (displacement.MagnitudeSquared() < maxDistanceSquared))
+					{
+						return true;
+					}
+				}
+			}
+		}
+
+		// The curved lateral surface.
+		double u[2];
+		const int numRoots =
+            Algebra::SolveQuadraticEquation(
+			    direction.x*direction.x + direction.y*direction.y,
+			    2.0*(vantage.x*direction.x + vantage.y*direction.y),
+			    vantage.x*vantage.x + vantage.y*vantage.y - a*a,
+			    u);
+
+		for(int i = 0; i < numRoots; ++i)
+		{
+			if(u[i] > EPSILON)
+			{
+				const Vector displacement = u[i] * direction;
+				if((fabs(vantage.z + displacement.z) <= b) && (displacement.MagnitudeSquared() < maxDistanceSquared))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
 	void Cylinder::AppendDiskIntersection(const Vector& vantage, const Vector& direction, double zDisk, std::vector<Intersection>& intersectionList) const
 	{
 		const double u = (zDisk - vantage.z) / direction.z;
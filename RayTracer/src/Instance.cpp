@@ -0,0 +1,44 @@
+#include "Instance.h"
+
+namespace RayTracer
+{
+	void Instance::ObjectSpace_AppendAllIntersections(
+		const Vector& vantage,
+		const Vector& direction,
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
+	{
+		const Vector& geometryCenter = geometry->Center();
+
+		const size_t sizeBeforeAppend = intersectionList.size();
+
+		geometry->AppendAllIntersections(vantage + geometryCenter, direction, intersectionList, context);
+
+		for(size_t index = sizeBeforeAppend; index < intersectionList.size(); ++index)
+		{
+			Intersection& intersection = intersectionList[index];
+
+			// An instance nested in the geometry has already recorded where its own geometry was hit.
+			if(!intersection.hasSolidPoint)
+			{
+				intersection.solidPoint = intersection.point;
+				intersection.hasSolidPoint = true;
+			}
+
+			// The caller takes the point on from object space to camera space; normals need no offset.
+			intersection.point = intersection.point - geometryCenter;
+		}
+	}
+
+	BoundingBox Instance::ObjectSpace_GetBoundingBox() const
+	{
+		const BoundingBox geometryBox = geometry->GetBoundingBox();
+		if(geometryBox.IsEmpty() || !geometryBox.IsFinite())
+		{
+			return geometryBox;
+		}
+
+		const Vector& geometryCenter = geometry->Center();
+		return BoundingBox(geometryBox.minCorner - geometryCenter, geometryBox.maxCorner - geometryCenter);
+	}
+}
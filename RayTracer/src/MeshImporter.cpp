@@ -0,0 +1,816 @@
+#include "MeshImporter.h"
+#include "RenderThreadPool.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+/**
+ * Implements class MeshImporter, which maps OBJ and binary PLY files into memory and parses them
+ * in chunks on a RenderThreadPool.
+ */
+namespace RayTracer
+{
+    namespace
+    {
+        /**
+         * A file is cut into CHUNKS_PER_THREAD chunks per thread, so that a thread that drew an easy chunk can pick up another,
+         * but no chunk is smaller than MIN_CHUNK_BYTES of text, or MIN_CHUNK_ITEMS points or faces, which are not worth a task.
+         */
+        const size_t CHUNKS_PER_THREAD = 4;
+        const size_t MIN_CHUNK_BYTES = 1 << 20;
+        const size_t MIN_CHUNK_ITEMS = 1 << 16;
+
+        // The longest number, in characters, that an OBJ file may hold.
+        const size_t MAX_NUMBER_LENGTH = 63;
+
+        size_t ChunkCount(size_t size, size_t minChunkSize, const RenderThreadPool& threadPool)
+        {
+            return std::max<size_t>(1, std::min(CHUNKS_PER_THREAD * threadPool.GetThreadCount(), size / minChunkSize));
+        }
+
+        bool IsBlank(char c)
+        {
+            return (c == ' ') || (c == '\t') || (c == '\r');
+        }
+
+        /**
+         * Moves 'position' past the next token of the line that ends at lineEnd and returns the token in [token, position).
+         * Returns false if the line has no more tokens or the rest is a comment.
+         */
+        bool NextToken(const char*& position, const char* lineEnd, const char*& token)
+        {
+            while ((position < lineEnd) && IsBlank(*position))
+            {
+                ++position;
+            }
+            if ((position == lineEnd) || (*position == '#'))
+            {
+                return false;
+            }
+
+            token = position;
+            while ((position < lineEnd) && !IsBlank(*position))
+            {
+                ++position;
+            }
+            return true;
+        }
+
+        bool IsToken(const char* token, const char* tokenEnd, const char* text)
+        {
+            const size_t length = std::strlen(text);
+            return (static_cast<size_t>(tokenEnd - token) == length) && (std::memcmp(token, text, length) == 0);
+        }
+
+        const char* LineEnd(const char* line, const char* end)
+        {
+            const void* newline = std::memchr(line, '\n', end - line);
+            return newline ? static_cast<const char*>(newline) : end;
+        }
+
+        // The mapped file is not null-terminated, so each number is copied out before it is converted.
+        double ParseDouble(const char* token, const char* tokenEnd)
+        {
+            const size_t length = tokenEnd - token;
+            if ((length == 0) || (length > MAX_NUMBER_LENGTH))
+            {
+                throw ImagerException("Bad number in mesh file.");
+            }
+
+            char text[MAX_NUMBER_LENGTH + 1];
+            std::memcpy(text, token, length);
+            text[length] = '\0';
+
+            char* parsedEnd;
+            const double value = std::strtod(text, &parsedEnd);
+            if (parsedEnd != text + length)
+            {
+                throw ImagerException("Bad number in mesh file.");
+            }
+            return value;
+        }
+
+        // Parses the point index at the start of an OBJ face entry such as "7", "7/3", "7//5" or "-2/1/1".
+        long ParseObjIndex(const char* token, const char* tokenEnd)
+        {
+            const char* indexEnd = std::find(token, tokenEnd, '/');
+            const size_t length = indexEnd - token;
+            if ((length == 0) || (length > MAX_NUMBER_LENGTH))
+            {
+                throw ImagerException("Bad face in OBJ file.");
+            }
+
+            char text[MAX_NUMBER_LENGTH + 1];
+            std::memcpy(text, token, length);
+            text[length] = '\0';
+
+            char* parsedEnd;
+            const long index = std::strtol(text, &parsedEnd, 10);
+            if ((parsedEnd != text + length) || (index == 0))
+            {
+                throw ImagerException("Bad face in OBJ file.");
+            }
+            return index;
+        }
+
+        /**
+         * Cuts [begin, end) into about chunkCount pieces that each start at the beginning of a line.
+         * Returns the start of every piece, followed by 'end'.
+         */
+        std::vector<const char*> SplitAtLines(const char* begin, const char* end, size_t chunkCount)
+        {
+            std::vector<const char*> boundaryList(1, begin);
+            for (size_t chunk = 1; chunk < chunkCount; ++chunk)
+            {
+                const char* cut = std::max(begin + (end - begin) * chunk / chunkCount, boundaryList.back());
+                cut = LineEnd(cut, end);
+                if (cut < end)
+                {
+                    boundaryList.push_back(cut + 1);
+                }
+            }
+            boundaryList.push_back(end);
+            boundaryList.erase(std::unique(boundaryList.begin(), boundaryList.end()), boundaryList.end());
+            return boundaryList;
+        }
+
+        // Where one chunk of the file puts what it holds, once the chunks before it have been counted.
+        struct ChunkPlacement
+        {
+            ChunkPlacement()
+                : pointCount(0)
+                , triangleCount(0)
+                , firstPoint(0)
+                , firstTriangle(0)
+            {
+            }
+
+            size_t pointCount;
+            size_t triangleCount;
+            size_t firstPoint;
+            size_t firstTriangle;
+        };
+
+        // Gives every chunk its first point and first triangle, and returns the total number of each.
+        void PlaceChunks(std::vector<ChunkPlacement>& placementList, size_t& pointCount, size_t& triangleCount)
+        {
+            pointCount = 0;
+            triangleCount = 0;
+            for (ChunkPlacement& placement : placementList)
+            {
+                placement.firstPoint = pointCount;
+                placement.firstTriangle = triangleCount;
+                pointCount += placement.pointCount;
+                triangleCount += placement.triangleCount;
+            }
+
+            // Triangles refer to their points by int.
+            if (pointCount > static_cast<size_t>(INT_MAX))
+            {
+                throw ImagerException("Mesh file has too many points.");
+            }
+        }
+
+        enum PlyType
+        {
+            PLY_INT8,
+            PLY_UINT8,
+            PLY_INT16,
+            PLY_UINT16,
+            PLY_INT32,
+            PLY_UINT32,
+            PLY_FLOAT32,
+            PLY_FLOAT64
+        };
+
+        struct PlyProperty
+        {
+            std::string name;
+            PlyType type;
+
+            // A list is a count of type countType followed by that many values of type 'type'.
+            bool isList;
+            PlyType countType;
+        };
+
+        struct PlyElement
+        {
+            std::string name;
+            size_t count;
+            std::vector<PlyProperty> propertyList;
+        };
+
+        PlyType ParsePlyType(const std::string& name)
+        {
+            if (name == "char" || name == "int8")
+            {
+                return PLY_INT8;
+            }
+            if (name == "uchar" || name == "uint8")
+            {
+                return PLY_UINT8;
+            }
+            if (name == "short" || name == "int16")
+            {
+                return PLY_INT16;
+            }
+            if (name == "ushort" || name == "uint16")
+            {
+                return PLY_UINT16;
+            }
+            if (name == "int" || name == "int32")
+            {
+                return PLY_INT32;
+            }
+            if (name == "uint" || name == "uint32")
+            {
+                return PLY_UINT32;
+            }
+            if (name == "float" || name == "float32")
+            {
+                return PLY_FLOAT32;
+            }
+            if (name == "double" || name == "float64")
+            {
+                return PLY_FLOAT64;
+            }
+            throw ImagerException("Unknown property type in PLY file.");
+        }
+
+        size_t PlyTypeSize(PlyType type)
+        {
+            switch (type)
+            {
+                case PLY_INT8:
+                case PLY_UINT8:
+                    return 1;
+
+                case PLY_INT16:
+                case PLY_UINT16:
+                    return 2;
+
+                case PLY_INT32:
+                case PLY_UINT32:
+                case PLY_FLOAT32:
+                    return 4;
+
+                default:
+                    return 8;
+            }
+        }
+
+        bool IsLittleEndianHost()
+        {
+            const std::uint16_t one = 1;
+            unsigned char firstByte;
+            std::memcpy(&firstByte, &one, 1);
+            return firstByte == 1;
+        }
+
+        /**
+         * Reads one binary PLY value of the given type, swapping its bytes if the file's byte order is not the host's.
+         * Every type the format has, even a 32-bit index, fits a double exactly.
+         */
+        double ReadPlyValue(const char* data, PlyType type, bool swapBytes)
+        {
+            unsigned char bytes[8];
+            const size_t size = PlyTypeSize(type);
+            std::memcpy(bytes, data, size);
+            if (swapBytes)
+            {
+                std::reverse(bytes, bytes + size);
+            }
+
+            switch (type)
+            {
+                case PLY_INT8:    { std::int8_t value;   std::memcpy(&value, bytes, size); return value; }
+                case PLY_UINT8:   { std::uint8_t value;  std::memcpy(&value, bytes, size); return value; }
+                case PLY_INT16:   { std::int16_t value;  std::memcpy(&value, bytes, size); return value; }
+                case PLY_UINT16:  { std::uint16_t value; std::memcpy(&value, bytes, size); return value; }
+                case PLY_INT32:   { std::int32_t value;  std::memcpy(&value, bytes, size); return value; }
+                case PLY_UINT32:  { std::uint32_t value; std::memcpy(&value, bytes, size); return value; }
+                case PLY_FLOAT32: { float value;         std::memcpy(&value, bytes, size); return value; }
+                default:          { double value;        std::memcpy(&value, bytes, size); return value; }
+            }
+        }
+
+        /**
+         * Walks over one record of 'element' starting at 'data', calling visitList(property, count, firstValue)
+         * for each of its list properties, and returns where the next record starts.
+         */
+        template<typename VisitList>
+        const char* WalkPlyRecord(const PlyElement& element, const char* data, const char* end, bool swapBytes, VisitList visitList)
+        {
+            for (const PlyProperty& property : element.propertyList)
+            {
+                if (!property.isList)
+                {
+                    const size_t valueSize = PlyTypeSize(property.type);
+                    if (static_cast<size_t>(end - data) < valueSize)
+                    {
+                        throw ImagerException("PLY file ends in the middle of its data.");
+                    }
+                    data += valueSize;
+                    continue;
+                }
+
+                const size_t countSize = PlyTypeSize(property.countType);
+                if (static_cast<size_t>(end - data) < countSize)
+                {
+                    throw ImagerException("PLY file ends in the middle of its data.");
+                }
+                const double count = ReadPlyValue(data, property.countType, swapBytes);
+                data += countSize;
+
+                if ((count < 0.0) || (static_cast<size_t>(end - data) < static_cast<size_t>(count) * PlyTypeSize(property.type)))
+                {
+                    throw ImagerException("PLY file ends in the middle of its data.");
+                }
+                visitList(property, static_cast<size_t>(count), data);
+                data += static_cast<size_t>(count) * PlyTypeSize(property.type);
+            }
+
+            return data;
+        }
+
+        // The size of every record of an element without list properties, or 0 if it has any.
+        size_t FixedRecordSize(const PlyElement& element)
+        {
+            size_t size = 0;
+            for (const PlyProperty& property : element.propertyList)
+            {
+                if (property.isList)
+                {
+                    return 0;
+                }
+                size += PlyTypeSize(property.type);
+            }
+            return size;
+        }
+
+        bool IsFaceIndexList(const PlyProperty& property)
+        {
+            return property.isList && (property.name == "vertex_indices" || property.name == "vertex_index");
+        }
+    }
+
+    boost::shared_ptr<TriangleMesh> MeshImporter::Load(
+        const std::string& filename,
+        const Optics& optics,
+        MeshImportReport& report,
+        bool isFullyEnclosed)
+    {
+        RenderThreadPool threadPool;
+        return Load(filename, optics, report, isFullyEnclosed, threadPool);
+    }
+
+    boost::shared_ptr<TriangleMesh> MeshImporter::Load(
+        const std::string& filename,
+        const Optics& optics,
+        MeshImportReport& report,
+        bool isFullyEnclosed,
+        RenderThreadPool& threadPool)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        report = MeshImportReport();
+
+        std::string extension = filename.substr(std::min(filename.rfind('.'), filename.size()));
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if (extension != ".obj" && extension != ".ply")
+        {
+            throw ImagerException("Mesh files must be .obj or .ply files.");
+        }
+
+        std::vector<Vector> pointList;
+        std::vector<Triangle> triangleList;
+        {
+            boost::interprocess::mapped_region region;
+            try
+            {
+                const boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+                boost::interprocess::mapped_region(file, boost::interprocess::read_only).swap(region);
+            }
+            catch (const boost::interprocess::interprocess_exception&)
+            {
+                throw ImagerException("Cannot map mesh file into memory.");
+            }
+
+            const char* begin = static_cast<const char*>(region.get_address());
+            const char* end = begin + region.get_size();
+            report.fileBytes = region.get_size();
+
+            if (extension == ".obj")
+            {
+                ParseObj(begin, end, threadPool, pointList, triangleList);
+            }
+            else
+            {
+                ParsePly(begin, end, threadPool, pointList, triangleList);
+            }
+
+            // The file is still mapped here, next to the lists parsed out of it.
+            report.peakMemoryBytes = report.fileBytes + pointList.capacity() * sizeof(Vector) + triangleList.capacity() * sizeof(Triangle);
+        }
+
+        // AddTriangle would not accept these either.
+        const size_t parsedTriangleCount = triangleList.size();
+        triangleList.erase(
+            std::remove_if(triangleList.begin(), triangleList.end(), [](const Triangle& tri)
+            {
+                return (tri.a == tri.b) || (tri.a == tri.c) || (tri.b == tri.c);
+            }),
+            triangleList.end());
+        report.skippedTriangleCount = parsedTriangleCount - triangleList.size();
+
+        BoundingBox box = BoundingBox::Empty();
+        for (const Vector& point : pointList)
+        {
+            box.Include(point);
+        }
+
+        boost::shared_ptr<TriangleMesh> mesh(new TriangleMesh(box.IsEmpty() ? Vector() : box.Centroid(), isFullyEnclosed));
+        mesh->pointList.swap(pointList);
+        mesh->triangleList.swap(triangleList);
+        mesh->UpdateGeometry();
+
+        // Every triangle was parsed with material 0.
+        mesh->AddMaterial(optics);
+
+        report.pointCount = mesh->pointList.size();
+        report.triangleCount = mesh->triangleList.size();
+        report.meshMemoryBytes =
+            mesh->pointList.capacity() * sizeof(Vector) +
+            mesh->triangleList.capacity() * sizeof(Triangle) +
+            mesh->geometryList.capacity() * sizeof(TriangleMesh::TriangleGeometry);
+
+        // Leaving out degenerate triangles and handing the lists to the mesh moves them in place, without a copy.
+        report.peakMemoryBytes = std::max(report.peakMemoryBytes, report.meshMemoryBytes);
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        return mesh;
+    }
+
+    void MeshImporter::ParseObj(
+        const char* begin,
+        const char* end,
+        RenderThreadPool& threadPool,
+        std::vector<Vector>& pointList,
+        std::vector<Triangle>& triangleList)
+    {
+        const std::vector<const char*> boundaryList = SplitAtLines(begin, end, ChunkCount(end - begin, MIN_CHUNK_BYTES, threadPool));
+        std::vector<ChunkPlacement> placementList(boundaryList.size() - 1);
+
+        // First pass: count the points and the triangles of every chunk.
+        threadPool.Run(placementList.size(), [&](size_t chunk, size_t)
+        {
+            ChunkPlacement& placement = placementList[chunk];
+            for (const char* line = boundaryList[chunk]; line < boundaryList[chunk + 1]; )
+            {
+                const char* lineEnd = LineEnd(line, boundaryList[chunk + 1]);
+                const char* position = line;
+                const char* token;
+                line = lineEnd + 1;
+
+                if (!NextToken(position, lineEnd, token))
+                {
+                    continue;
+                }
+                if (IsToken(token, position, "v"))
+                {
+                    ++placement.pointCount;
+                }
+                else if (IsToken(token, position, "f"))
+                {
+                    size_t faceSize = 0;
+                    while (NextToken(position, lineEnd, token))
+                    {
+                        ++faceSize;
+                    }
+                    if (faceSize < 3)
+                    {
+                        throw ImagerException("OBJ face with fewer than three points.");
+                    }
+                    placement.triangleCount += faceSize - 2;
+                }
+            }
+        });
+
+        size_t pointCount, triangleCount;
+        PlaceChunks(placementList, pointCount, triangleCount);
+        pointList.resize(pointCount);
+        triangleList.resize(triangleCount);
+
+        // Second pass: parse every chunk into its own stretch of the lists.
+        threadPool.Run(placementList.size(), [&](size_t chunk, size_t)
+        {
+            size_t point = placementList[chunk].firstPoint;
+            size_t triangle = placementList[chunk].firstTriangle;
+            std::vector<int> faceList;
+
+            for (const char* line = boundaryList[chunk]; line < boundaryList[chunk + 1]; )
+            {
+                const char* lineEnd = LineEnd(line, boundaryList[chunk + 1]);
+                const char* position = line;
+                const char* token;
+                line = lineEnd + 1;
+
+                if (!NextToken(position, lineEnd, token))
+                {
+                    continue;
+                }
+                if (IsToken(token, position, "v"))
+                {
+                    double coordinate[3];
+                    for (double& value : coordinate)
+                    {
+                        if (!NextToken(position, lineEnd, token))
+                        {
+                            throw ImagerException("OBJ vertex with fewer than three coordinates.");
+                        }
+                        value = ParseDouble(token, position);
+                    }
+                    pointList[point++] = Vector(coordinate[0], coordinate[1], coordinate[2]);
+                }
+                else if (IsToken(token, position, "f"))
+                {
+                    // Indices count from 1; negative ones count back from the last point defined so far.
+                    faceList.clear();
+                    while (NextToken(position, lineEnd, token))
+                    {
+                        const long index = ParseObjIndex(token, position);
+                        const long pointIndex = (index > 0) ? (index - 1) : (static_cast<long>(point) + index);
+                        if ((pointIndex < 0) || (pointIndex >= static_cast<long>(pointCount)))
+                        {
+                            throw ImagerException("OBJ face refers to a point that does not exist.");
+                        }
+                        faceList.push_back(static_cast<int>(pointIndex));
+                    }
+
+                    for (size_t corner = 1; corner + 1 < faceList.size(); ++corner)
+                    {
+                        triangleList[triangle++] = Triangle(faceList[0], faceList[corner], faceList[corner + 1]);
+                    }
+                }
+            }
+        });
+    }
+
+    void MeshImporter::ParsePly(
+        const char* begin,
+        const char* end,
+        RenderThreadPool& threadPool,
+        std::vector<Vector>& pointList,
+        std::vector<Triangle>& triangleList)
+    {
+        // The header is text, up to and including the "end_header" line.
+        static const char endHeader[] = "end_header";
+        const char* headerEnd = std::search(begin, end, endHeader, endHeader + sizeof(endHeader) - 1);
+        if (headerEnd == end)
+        {
+            throw ImagerException("PLY file has no end_header line.");
+        }
+        const char* data = LineEnd(headerEnd, end);
+        if (data == end)
+        {
+            throw ImagerException("PLY file has no data.");
+        }
+        ++data;
+
+        std::istringstream header(std::string(begin, headerEnd));
+        std::string line;
+        std::getline(header, line);
+        if (line.compare(0, 3, "ply") != 0)
+        {
+            throw ImagerException("Not a PLY file.");
+        }
+
+        bool isBigEndian = false;
+        std::vector<PlyElement> elementList;
+        while (std::getline(header, line))
+        {
+            std::istringstream words(line);
+            std::string keyword;
+            words >> keyword;
+
+            if (keyword == "format")
+            {
+                std::string format;
+                words >> format;
+                if (format == "ascii")
+                {
+                    throw ImagerException("Only binary PLY files are supported.");
+                }
+                if (format != "binary_little_endian" && format != "binary_big_endian")
+                {
+                    throw ImagerException("Unknown PLY format.");
+                }
+                isBigEndian = (format == "binary_big_endian");
+            }
+            else if (keyword == "element")
+            {
+                PlyElement element;
+                words >> element.name >> element.count;
+                elementList.push_back(element);
+            }
+            else if (keyword == "property")
+            {
+                if (elementList.empty())
+                {
+                    throw ImagerException("PLY property outside of any element.");
+                }
+
+                PlyProperty property;
+                std::string type;
+                words >> type;
+                property.isList = (type == "list");
+                if (property.isList)
+                {
+                    std::string countType;
+                    words >> countType >> type;
+                    property.countType = ParsePlyType(countType);
+                }
+                property.type = ParsePlyType(type);
+                words >> property.name;
+                elementList.back().propertyList.push_back(property);
+            }
+        }
+
+        const bool swapBytes = (isBigEndian == IsLittleEndianHost());
+
+        // Walk the elements in file order until both the vertices and the faces have been read.
+        bool hasVertices = false;
+        bool hasFaces = false;
+        for (const PlyElement& element : elementList)
+        {
+            if (hasVertices && hasFaces)
+            {
+                break;
+            }
+
+            const size_t recordSize = FixedRecordSize(element);
+
+            if (element.name == "vertex")
+            {
+                if (recordSize == 0)
+                {
+                    throw ImagerException("PLY vertices with list properties are not supported.");
+                }
+
+                size_t offset[3] = { 0, 0, 0 };
+                PlyType type[3] = { PLY_FLOAT32, PLY_FLOAT32, PLY_FLOAT32 };
+                bool found[3] = { false, false, false };
+                const char* axisName[3] = { "x", "y", "z" };
+                size_t propertyOffset = 0;
+                for (const PlyProperty& property : element.propertyList)
+                {
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        if (property.name == axisName[axis])
+                        {
+                            offset[axis] = propertyOffset;
+                            type[axis] = property.type;
+                            found[axis] = true;
+                        }
+                    }
+                    propertyOffset += PlyTypeSize(property.type);
+                }
+                if (!found[0] || !found[1] || !found[2])
+                {
+                    throw ImagerException("PLY vertices have no x, y or z.");
+                }
+
+                if ((element.count > static_cast<size_t>(INT_MAX)) || (static_cast<size_t>(end - data) / recordSize < element.count))
+                {
+                    throw ImagerException("PLY file ends in the middle of its data.");
+                }
+
+                // Every vertex has the same size, so the chunks are just ranges of vertices.
+                pointList.resize(element.count);
+                const char* vertexData = data;
+                const size_t chunkCount = ChunkCount(element.count, MIN_CHUNK_ITEMS, threadPool);
+                threadPool.Run(chunkCount, [&](size_t chunk, size_t)
+                {
+                    const size_t first = element.count * chunk / chunkCount;
+                    const size_t last = element.count * (chunk + 1) / chunkCount;
+                    for (size_t vertex = first; vertex < last; ++vertex)
+                    {
+                        const char* record = vertexData + vertex * recordSize;
+                        pointList[vertex] = Vector(
+                            ReadPlyValue(record + offset[0], type[0], swapBytes),
+                            ReadPlyValue(record + offset[1], type[1], swapBytes),
+                            ReadPlyValue(record + offset[2], type[2], swapBytes));
+                    }
+                });
+
+                data += element.count * recordSize;
+                hasVertices = true;
+            }
+            else if (element.name == "face")
+            {
+                if (std::find_if(element.propertyList.begin(), element.propertyList.end(), IsFaceIndexList) == element.propertyList.end())
+                {
+                    throw ImagerException("PLY faces have no vertex_indices.");
+                }
+
+                /**
+                 * Faces differ in size, so one quick walk over their point counts finds where each chunk of faces
+                 * starts in the file and in the triangle list; the chunks are then parsed in parallel.
+                 */
+                const size_t chunkCount = ChunkCount(element.count, MIN_CHUNK_ITEMS, threadPool);
+                std::vector<const char*> chunkStartList;
+                std::vector<ChunkPlacement> placementList(chunkCount);
+
+                size_t triangleCount = 0;
+                for (size_t face = 0; face < element.count; ++face)
+                {
+                    if (face == element.count * chunkStartList.size() / chunkCount)
+                    {
+                        chunkStartList.push_back(data);
+                        placementList[chunkStartList.size() - 1].firstTriangle = triangleCount;
+                    }
+
+                    data = WalkPlyRecord(element, data, end, swapBytes, [&](const PlyProperty& property, size_t count, const char*)
+                    {
+                        if (IsFaceIndexList(property))
+                        {
+                            if (count < 3)
+                            {
+                                throw ImagerException("PLY face with fewer than three points.");
+                            }
+                            triangleCount += count - 2;
+                        }
+                    });
+                }
+
+                triangleList.resize(triangleCount);
+                threadPool.Run(chunkStartList.size(), [&](size_t chunk, size_t)
+                {
+                    const size_t first = element.count * chunk / chunkCount;
+                    const size_t last = element.count * (chunk + 1) / chunkCount;
+                    const char* record = chunkStartList[chunk];
+                    size_t triangle = placementList[chunk].firstTriangle;
+                    std::vector<int> faceList;
+
+                    for (size_t face = first; face < last; ++face)
+                    {
+                        record = WalkPlyRecord(element, record, end, swapBytes, [&](const PlyProperty& property, size_t count, const char* values)
+                        {
+                            if (!IsFaceIndexList(property))
+                            {
+                                return;
+                            }
+
+                            // Indices out of the range of int become -1, which the check below rejects.
+                            faceList.clear();
+                            for (size_t corner = 0; corner < count; ++corner)
+                            {
+                                const double index = ReadPlyValue(values + corner * PlyTypeSize(property.type), property.type, swapBytes);
+                                faceList.push_back(((index >= 0.0) && (index <= INT_MAX)) ? static_cast<int>(index) : -1);
+                            }
+                            for (size_t corner = 1; corner + 1 < count; ++corner)
+                            {
+                                triangleList[triangle++] = Triangle(faceList[0], faceList[corner], faceList[corner + 1]);
+                            }
+                        });
+                    }
+                });
+
+                hasFaces = true;
+            }
+            else if (recordSize > 0)
+            {
+                if (static_cast<size_t>(end - data) / recordSize < element.count)
+                {
+                    throw ImagerException("PLY file ends in the middle of its data.");
+                }
+                data += element.count * recordSize;
+            }
+            else
+            {
+                for (size_t record = 0; record < element.count; ++record)
+                {
+                    data = WalkPlyRecord(element, data, end, swapBytes, [](const PlyProperty&, size_t, const char*) {});
+                }
+            }
+        }
+
+        // Faces may come before the vertices, so their indices are checked once both are known.
+        const int pointCount = static_cast<int>(pointList.size());
+        for (const Triangle& tri : triangleList)
+        {
+            if ((tri.a < 0) || (tri.a >= pointCount) || (tri.b < 0) || (tri.b >= pointCount) || (tri.c < 0) || (tri.c >= pointCount))
+            {
+                throw ImagerException("PLY face refers to a point that does not exist.");
+            }
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#include "PixelRect.h"
+
+/**
+ * Implements class PixelRect, the compact form in which the computed pixels
+ * of one rectangle of an image travel from a worker to the server.
+ */
+namespace RayTracer
+{
+    PixelRect::PixelRect()
+        : left(0)
+        , top(0)
+        , width(0)
+        , height(0)
+        , useFloatColors(false)
+        , maxColorValue(0.0)
+    {
+    }
+
+    PixelRect::PixelRect(
+        size_t _left,
+        size_t _top,
+        size_t _width,
+        size_t _height,
+        const std::vector<PixelData>& pixels,
+        bool _useFloatColors)
+        : left(_left)
+        , top(_top)
+        , width(_width)
+        , height(_height)
+        , useFloatColors(_useFloatColors)
+        , maxColorValue(0.0)
+    {
+        const size_t numPixels = GetNumPixels();
+        if (pixels.size() != numPixels)
+        {
+            throw ImagerException("Pixel list does not match the size of the rectangle.");
+        }
+
+        if (useFloatColors)
+        {
+            floatColors.resize(3 * numPixels);
+        }
+        else
+        {
+            doubleColors.resize(3 * numPixels);
+        }
+        ambiguityBits.assign((numPixels + 7) / 8, 0);
+
+        for (size_t index = 0; index < numPixels; ++index)
+        {
+            const PixelData& pixel = pixels[index];
+            if (useFloatColors)
+            {
+                floatColors[3*index + 0] = static_cast<float>(pixel.color.red);
+                floatColors[3*index + 1] = static_cast<float>(pixel.color.green);
+                floatColors[3*index + 2] = static_cast<float>(pixel.color.blue);
+            }
+            else
+            {
+                doubleColors[3*index + 0] = pixel.color.red;
+                doubleColors[3*index + 1] = pixel.color.green;
+                doubleColors[3*index + 2] = pixel.color.blue;
+            }
+
+            if (pixel.isAmbiguous)
+            {
+                ambiguityBits[index / 8] |= static_cast<unsigned char>(1 << (index % 8));
+            }
+        }
+    }
+
+    PixelData PixelRect::GetPixel(size_t i, size_t j) const
+    {
+        if ((i < left) || (i >= left + width) || (j < top) || (j >= top + height))
+        {
+            throw ImagerException("Pixel coordinate(s) outside of the rectangle");
+        }
+        return GetPixelAtIndex((j - top) * width + (i - left));
+    }
+
+    void PixelRect::CheckPayload() const
+    {
+        const size_t numPixels = GetNumPixels();
+        if ((useFloatColors ? floatColors.size() : doubleColors.size()) != 3 * numPixels || ambiguityBits.size() != (numPixels + 7) / 8)
+        {
+            throw ImagerException("Pixel rectangle payload does not match its size");
+        }
+    }
+
+    void PixelRect::CopyTo(ImageBuffer& image) const
+    {
+        // A deserialized rectangle may come from anywhere, so check it against the image and the payload once, up front.
+        if ((left + width > image.GetPixelsWide()) || (top + height > image.GetPixelsHigh()))
+        {
+            throw ImagerException("Pixel rectangle does not fit in the image");
+        }
+        CheckPayload();
+
+        size_t index = 0;
+        for (size_t j = top; j < top + height; ++j)
+        {
+            for (size_t i = left; i < left + width; ++i)
+            {
+                image.Pixel(i, j) = GetPixelAtIndex(index++);
+            }
+        }
+    }
+
+    PixelData PixelRect::GetPixelAtIndex(size_t index) const
+    {
+        PixelData pixel;
+        if (useFloatColors)
+        {
+            pixel.color = Color(floatColors[3*index + 0], floatColors[3*index + 1], floatColors[3*index + 2]);
+        }
+        else
+        {
+            pixel.color = Color(doubleColors[3*index + 0], doubleColors[3*index + 1], doubleColors[3*index + 2]);
+        }
+        pixel.isAmbiguous = (ambiguityBits[index / 8] & (1 << (index % 8))) != 0;
+        return pixel;
+    }
+}
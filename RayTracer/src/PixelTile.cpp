@@ -0,0 +1,89 @@
+#include "PixelTile.h"
+#include "ImagerException.h"
+
+#include <cstdint>
+
+/**
+ * Implements class PixelTile, the rectangle of an image a worker is asked
+ * to render, and the Morton order its tiles and pixels are traced in.
+ */
+namespace RayTracer
+{
+    namespace
+    {
+        // Keeps the even bits of 'code', packed together: the column of a Morton code, or of the code shifted right once, the row.
+        size_t CompactEvenBits(std::uint64_t code)
+        {
+            code &= 0x5555555555555555ull;
+            code = (code | (code >> 1)) & 0x3333333333333333ull;
+            code = (code | (code >> 2)) & 0x0f0f0f0f0f0f0f0full;
+            code = (code | (code >> 4)) & 0x00ff00ff00ff00ffull;
+            code = (code | (code >> 8)) & 0x0000ffff0000ffffull;
+            code = (code | (code >> 16)) & 0x00000000ffffffffull;
+            return static_cast<size_t>(code);
+        }
+    }
+
+    void MortonOrder(size_t width, size_t height, std::vector<std::pair<size_t, size_t>>& cells)
+    {
+        cells.clear();
+        cells.reserve(width * height);
+
+        // Walk the codes of the smallest square grid of a power of 2 side that holds the whole grid, skipping the cells outside it.
+        size_t side = 1;
+        while (side < width || side < height)
+        {
+            side *= 2;
+        }
+
+        const std::uint64_t numCodes = static_cast<std::uint64_t>(side) * side;
+        for (std::uint64_t code = 0; code < numCodes && cells.size() < width * height; ++code)
+        {
+            const size_t column = CompactEvenBits(code);
+            const size_t row = CompactEvenBits(code >> 1);
+            if (column < width && row < height)
+            {
+                cells.push_back(std::make_pair(column, row));
+            }
+        }
+    }
+
+    PixelTile::PixelTile()
+        : left(0)
+        , top(0)
+        , width(0)
+        , height(0)
+        , tileSize(1)
+    {
+    }
+
+    PixelTile::PixelTile(size_t _left, size_t _top, size_t _width, size_t _height, size_t _tileSize)
+        : left(_left)
+        , top(_top)
+        , width(_width)
+        , height(_height)
+        , tileSize(_tileSize)
+    {
+        if (tileSize == 0)
+        {
+            throw ImagerException("Tile size must be positive.");
+        }
+    }
+
+    void PixelTile::GetTiles(std::vector<std::pair<size_t, size_t>>& tileCorners) const
+    {
+        // A deserialized tile may come from anywhere
+        if (tileSize == 0)
+        {
+            throw ImagerException("Tile size must be positive.");
+        }
+
+        MortonOrder((width + tileSize - 1) / tileSize, (height + tileSize - 1) / tileSize, tileCorners);
+
+        for (auto& tileCorner : tileCorners)
+        {
+            tileCorner.first *= tileSize;
+            tileCorner.second *= tileSize;
+        }
+    }
+}
@@ -0,0 +1,185 @@
+#include "RenderThreadPool.h"
+
+/**
+ * Implements class RenderThreadPool, a pool of threads with one task queue each,
+ * which balance their work by stealing from each other's queues.
+ */
+namespace RayTracer
+{
+    RenderThreadPool::RenderThreadPool(size_t threadCount)
+        : currentTask(nullptr)
+        , batchNumber(0)
+        , busyThreadCount(0)
+        , isStopping(false)
+        , isBatchFailed(false)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = DefaultThreadCount();
+        }
+
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            queueList.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+        }
+
+        // Thread 0 is whichever thread calls Run().
+        for (size_t i = 1; i < threadCount; ++i)
+        {
+            threadList.push_back(std::thread(&RenderThreadPool::WorkerThread, this, i));
+        }
+    }
+
+    RenderThreadPool::~RenderThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guardLock(mutex);
+            isStopping = true;
+        }
+        batchStarted.notify_all();
+
+        for (std::thread& thread : threadList)
+        {
+            thread.join();
+        }
+    }
+
+    size_t RenderThreadPool::DefaultThreadCount()
+    {
+        const size_t hardwareThreads = std::thread::hardware_concurrency();
+        return (hardwareThreads > 0) ? hardwareThreads : 1;
+    }
+
+    void RenderThreadPool::Run(size_t taskCount, const Task& task)
+    {
+        if (taskCount == 0)
+        {
+            return;
+        }
+
+        // Deal the tasks out in contiguous runs, so that neighbouring tiles start out on the same thread.
+        const size_t threadCount = GetThreadCount();
+        for (size_t threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        {
+            const size_t begin = (taskCount * threadIndex) / threadCount;
+            const size_t end = (taskCount * (threadIndex + 1)) / threadCount;
+
+            TaskQueue& queue = *queueList[threadIndex];
+            std::lock_guard<std::mutex> queueLock(queue.mutex);
+            queue.taskIndexList.clear();
+            for (size_t taskIndex = begin; taskIndex < end; ++taskIndex)
+            {
+                queue.taskIndexList.push_back(taskIndex);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guardLock(mutex);
+            currentTask = &task;
+            firstError = nullptr;
+            isBatchFailed = false;
+            busyThreadCount = threadList.size();
+            ++batchNumber;
+        }
+        batchStarted.notify_all();
+
+        RunTasks(0);
+
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> guardLock(mutex);
+            batchFinished.wait(guardLock, [this] { return busyThreadCount == 0; });
+            currentTask = nullptr;
+            error = firstError;
+            firstError = nullptr;
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    void RenderThreadPool::WorkerThread(size_t threadIndex)
+    {
+        size_t lastBatchNumber = 0;
+
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> guardLock(mutex);
+                batchStarted.wait(guardLock, [&] { return isStopping || batchNumber != lastBatchNumber; });
+                if (isStopping)
+                {
+                    return;
+                }
+                lastBatchNumber = batchNumber;
+            }
+
+            RunTasks(threadIndex);
+
+            {
+                std::lock_guard<std::mutex> guardLock(mutex);
+                if (--busyThreadCount == 0)
+                {
+                    batchFinished.notify_all();
+                }
+            }
+        }
+    }
+
+    void RenderThreadPool::RunTasks(size_t threadIndex)
+    {
+        size_t taskIndex;
+        while (!isBatchFailed && (PopOwnTask(threadIndex, taskIndex) || StealTask(threadIndex, taskIndex)))
+        {
+            try
+            {
+                (*currentTask)(taskIndex, threadIndex);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guardLock(mutex);
+                if (!firstError)
+                {
+                    firstError = std::current_exception();
+                }
+                isBatchFailed = true;
+            }
+        }
+    }
+
+    bool RenderThreadPool::PopOwnTask(size_t threadIndex, size_t& taskIndex)
+    {
+        TaskQueue& queue = *queueList[threadIndex];
+        std::lock_guard<std::mutex> queueLock(queue.mutex);
+        if (queue.taskIndexList.empty())
+        {
+            return false;
+        }
+        taskIndex = queue.taskIndexList.front();
+        queue.taskIndexList.pop_front();
+        return true;
+    }
+
+    bool RenderThreadPool::StealTask(size_t threadIndex, size_t& taskIndex)
+    {
+        /**
+         * Take from the back of the victim's queue: those tasks are the farthest from what the victim is working on now.
+         * No tasks are added while a batch runs, so once every queue has been found empty the batch is finished for this thread.
+         */
+        const size_t threadCount = GetThreadCount();
+        for (size_t offset = 1; offset < threadCount; ++offset)
+        {
+            TaskQueue& queue = *queueList[(threadIndex + offset) % threadCount];
+            std::lock_guard<std::mutex> queueLock(queue.mutex);
+            if (!queue.taskIndexList.empty())
+            {
+                taskIndex = queue.taskIndexList.back();
+                queue.taskIndexList.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+}
@@ -1,12 +1,17 @@
 #include "lodepng.h"
 
 #include "Scene.h"
+#include "PixelTile.h"
+#include "RenderThreadPool.h"
+
+#include <algorithm>
 
 namespace RayTracer
 {
 	// Empties out the solidObjectList and destroys/frees  the SolidObjects that were in it.
     void Scene::ClearSolidObjectList()
 	{
+        boundingVolumeHierarchy.Clear();
         solidObjectList.clear();
 	}
 
@@ -20,6 +25,9 @@ namespace RayTracer
 	 */
     const double MIN_OPTICAL_INTENSITY = 0.001;
 
+	// The width and height, in oversampled pixels, of the square tiles SaveImage hands out to its render threads.
+	const size_t RENDER_TILE_SIZE = 32;
+
 	inline bool IsSignificant(const Color& color)
 	{
 		return
@@ -28,11 +36,11 @@ namespace RayTracer
 			(color.blue >= MIN_OPTICAL_INTENSITY);
 	}
 
-	Color Scene::TraceRay(const Vector& vantage, const Vector& direction, double refractiveIndex, Color rayIntensity, int recursionDepth) const
+	Color Scene::TraceRay(const Vector& vantage, const Vector& direction, double refractiveIndex, Color rayIntensity, int recursionDepth, TraceContext& context) const
 	{
 		Intersection intersection;
 
-		const int numClosest = FindClosestIntersection(vantage, direction, intersection);
+		const int numClosest = FindClosestIntersection(vantage, direction, intersection, context);
 		switch(numClosest)
 		{
             /**
@@ -47,7 +55,7 @@ namespace RayTracer
              * Determine the lighting using that single intersection.
              */
             case 1:
-                return CalculateLighting(intersection, direction, refractiveIndex, rayIntensity, 1 + recursionDepth);
+                return CalculateLighting(intersection, direction, refractiveIndex, rayIntensity, 1 + recursionDepth, context);
 
             /**
              * There is an ambiguity: more than one intersection has the same minimum distance.
@@ -59,7 +67,7 @@ namespace RayTracer
 	}
 
 	// Determines the color of an intersection, based on illumination it receives via scattering, glossy reflection, and refraction (lensing).
-	Color Scene::CalculateLighting(const Intersection& intersection, const Vector& direction, double refractiveIndex, Color rayIntensity, int recursionDepth) const
+	Color Scene::CalculateLighting(const Intersection& intersection, const Vector& direction, double refractiveIndex, Color rayIntensity, int recursionDepth, TraceContext& context) const
 	{
 		Color colorSum(0.0, 0.0, 0.0);
 
@@ -107,7 +115,7 @@ namespace RayTracer
 				const SolidObject& solid = *intersection.solid;
 
 				// Determine the optical properties at the specified point on whatever solid object the ray intersected with.
-				const Optics optics = solid.SurfaceOptics(intersection.point,intersection.context);
+				const Optics optics = solid.SurfaceOptics(intersection.hasSolidPoint ? intersection.solidPoint : intersection.point, intersection.context);
 
                 /**
 				 * Opacity of a surface point is the fraction 0..1 of the light ray available for matte and gloss.
@@ -122,7 +130,7 @@ namespace RayTracer
 						opacity *
 						optics.GetMatteColor() *
 						rayIntensity *
-						CalculateMatte(intersection);
+						CalculateMatte(intersection, context);
 
 					colorSum += matteColor;
 
@@ -155,7 +163,8 @@ namespace RayTracer
 						refractiveIndex,
 						transparency * rayIntensity,
 						recursionDepth,
-						refractiveReflectionFactor  // output parameter
+						refractiveReflectionFactor, // output parameter
+						context
 					);
 				}
 
@@ -186,7 +195,8 @@ namespace RayTracer
 						direction,
 						refractiveIndex,
 						reflectionColor,
-						recursionDepth);
+						recursionDepth,
+						context);
 
 					colorSum += matteColor;
 				}
@@ -208,7 +218,7 @@ namespace RayTracer
 	}
 
 	// Determines the contribution of the illumination of a point based on matte (scatter) reflection based on light incident to a point on the surface of a solid object.
-	Color Scene::CalculateMatte(const Intersection& intersection) const
+	Color Scene::CalculateMatte(const Intersection& intersection, TraceContext& context) const
 	{
         /**
 		 * Start at the location where the camera ray hit  a surface and trace toward all light sources.
@@ -220,7 +230,7 @@ namespace RayTracer
         for (auto& source : lightSourceList)
 		{
 			// See if we can draw a line from the intersection point toward the light source without hitting any surfaces.
-			if(HasClearLineOfSight(intersection.point, source->location))
+			if(HasClearLineOfSight(intersection.point, source->location, context))
 			{
                 /**
 				 * Since there is nothing between this point on the object's surface and the given light source, add this light source's 
@@ -257,7 +267,8 @@ namespace RayTracer
 		const Vector& incidentDir,
 		double refractiveIndex,
 		Color rayIntensity,
-		int recursionDepth) const
+		int recursionDepth,
+		TraceContext& context) const
 	{
 		/**
          * Find the direction of the reflected ray based on the incident ray  direction and the surface normal vector.  
@@ -269,7 +280,7 @@ namespace RayTracer
 		const Vector reflectDir = incidentDir - (perp * normal);
 
 		// Follow the ray in the new direction from the intersection point.
-		return TraceRay(intersection.point, reflectDir, refractiveIndex, rayIntensity, recursionDepth);
+		return TraceRay(intersection.point, reflectDir, refractiveIndex, rayIntensity, recursionDepth, context);
 	}
 
 	Color Scene::CalculateRefraction(
@@ -278,7 +289,8 @@ namespace RayTracer
 		double sourceRefractiveIndex,
 		Color rayIntensity,
 		int recursionDepth,
-		double& outReflectionFactor) const
+		double& outReflectionFactor,
+		TraceContext& context) const
 	{
 		// Convert direction to a unit vector so that relation between angle and dot product is simpler.
 		const Vector dirUnit = direction.UnitVector();
@@ -333,7 +345,7 @@ namespace RayTracer
          */
 		const double SMALL_SHIFT = 0.001;
 		const Vector testPoint = intersection.point + SMALL_SHIFT*dirUnit;
-		auto container = PrimaryContainer(testPoint);
+		auto container = PrimaryContainer(testPoint, context);
 		const double targetRefractiveIndex =
 			(container != nullptr) ?
 			container->GetRefractiveIndex() :
@@ -434,7 +446,7 @@ namespace RayTracer
         const Color nextRayIntensity = (1.0 - outReflectionFactor) * rayIntensity;
 
 		// Follow the ray in the new direction from the intersection point.
-		return TraceRay(intersection.point, refractDir, targetRefractiveIndex, nextRayIntensity, recursionDepth);
+		return TraceRay(intersection.point, refractDir, targetRefractiveIndex, nextRayIntensity, recursionDepth, context);
 	}
 
 	double Scene::PolarizedReflection(
@@ -532,11 +544,18 @@ namespace RayTracer
 	 * it means the 'intersection' parameter has been filled in with the
 	 * closest intersection (or one of the equally closest intersections).
 	 */
-    int Scene::FindClosestIntersection(const Vector& vantage, const Vector& direction, Intersection& intersection) const
+    int Scene::FindClosestIntersection(const Vector& vantage, const Vector& direction, Intersection& intersection, TraceContext& context) const
 	{
 		// Build a list of all intersections from all objects.
-        cachedIntersectionList.clear();     // empty any previous contents
-        
+        const TraceContext::ScratchIntersectionList intersectionList(context);
+
+        if (useBoundingVolumeHierarchy && boundingVolumeHierarchy.IsBuilt())
+        {
+            // Only collect intersections from solids whose bounding boxes the ray reaches before the closest hit.
+            boundingVolumeHierarchy.AppendClosestCandidates(vantage, direction, intersectionList.List(), context);
+            return PickClosestIntersection(intersectionList.List(), intersection);
+        }
+
         auto iter = solidObjectList.begin();
         auto end = solidObjectList.end();
 		for(; iter != end; ++iter)
@@ -545,19 +564,25 @@ namespace RayTracer
 			solid.AppendAllIntersections(
 				vantage,
 				direction,
-				cachedIntersectionList);
+				intersectionList.List(),
+				context);
 		}
-		return PickClosestIntersection(cachedIntersectionList, intersection);
+		return PickClosestIntersection(intersectionList.List(), intersection);
 	}
 
 
 	// Returns true if nothing blocks a line drawn between point1 and point2.
-	bool Scene::HasClearLineOfSight(const Vector& point1, const Vector& point2) const
+	bool Scene::HasClearLineOfSight(const Vector& point1, const Vector& point2, TraceContext& context) const
 	{
 		// Subtract point2 from point1 to obtain the direction from point1 to point2, along with the square of the distance between the two points.
 		const Vector dir = point2 - point1;
 		const double gapDistanceSquared = dir.MagnitudeSquared();
 
+        if (useBoundingVolumeHierarchy && boundingVolumeHierarchy.IsBuilt())
+        {
+            return !boundingVolumeHierarchy.HasIntersectionCloserThan(point1, dir, gapDistanceSquared, context);
+        }
+
 		// Iterate through all the solid objects in this scene.
         auto iter = solidObjectList.begin();
         auto end = solidObjectList.end();
@@ -566,18 +591,11 @@ namespace RayTracer
 			// If any object blocks the line of sight, we can return false immediately.
 			const SolidObject& solid = *(*iter);
 
-			// Find the closest intersection from point1 in the direction toward point2.
-			Intersection closest;
-			if(0 != solid.FindClosestIntersection(point1, dir, closest))
+			// An intersection is only a blocker if it is closer to point1 than point2 is.
+			if(solid.HasIntersectionCloserThan(point1, dir, gapDistanceSquared, context))
 			{
-				// We found the closest intersection, but it is only a blocker if it is closer to point1 than point2 is.
-				// If the closest intersection is farther away than point2, there is nothing on this object blocking the line of sight.
-
-				if(closest.distanceSquared < gapDistanceSquared)
-				{
-					// We found a surface that is definitely blocking the line of sight.  No need to keep looking!
-					return false;
-				}
+				// We found a surface that is definitely blocking the line of sight.  No need to keep looking!
+				return false;
 			}
 		}
 
@@ -597,7 +615,7 @@ namespace RayTracer
         return buffer;
     }
 
-    PixelData Scene::GetPixelAt(size_t iPos, size_t jPos, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor)
+    PixelData Scene::GetPixelAt(size_t iPos, size_t jPos, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor, TraceContext& context) const
     {
         // Oversample the image using the anti-aliasing factor.
         const size_t largePixelsWide = antiAliasFactor * pixelsWide;
@@ -617,7 +635,7 @@ namespace RayTracer
         try
         {
             // Trace a ray from the camera toward the given direction to figure out what color to assign to this pixel.
-            pixel.color = TraceRay(camera, direction, ambientRefraction, fullIntensity, 0);
+            pixel.color = TraceRay(camera, direction, ambientRefraction, fullIntensity, 0, context);
         }
         catch (AmbiguousIntersectionException)
         {
@@ -627,7 +645,7 @@ namespace RayTracer
         return pixel;
     }
 
-    void Scene::HandleAmbigousPixels(ImageBuffer& buffer, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor)
+    void Scene::HandleAmbigousPixels(ImageBuffer& buffer, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor) const
     {
         // Oversample the image using the anti-aliasing factor.
         const size_t largePixelsWide = antiAliasFactor * pixelsWide;
@@ -662,7 +680,7 @@ namespace RayTracer
         }
     }
 
-    void Scene::CreateImage(const std::string& imageName, ImageBuffer& buffer, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor)
+    void Scene::CreateImage(const std::string& imageName, ImageBuffer& buffer, size_t pixelsWide, size_t pixelsHigh, double zoom, size_t antiAliasFactor) const
     {
         /**
         * We want to scale the arbitrary range of color component values to the range 0..255 allowed by PNG format.
@@ -670,7 +688,25 @@ namespace RayTracer
         */
         const double max = buffer.MaxColorValue();
 
-        // Downsample the image buffer to an integer array of RGBA  values that LodePNG understands.
+        // Downsample the image buffer to its final resolution.
+        ImageBuffer pixels(pixelsWide, pixelsHigh, backgroundColor);
+        for (size_t j = 0; j < pixelsHigh; ++j)
+        {
+            for (size_t i = 0; i < pixelsWide; ++i)
+            {
+                pixels.Pixel(i, j).color = DownsamplePixel(buffer, antiAliasFactor*i, antiAliasFactor*j, antiAliasFactor);
+            }
+        }
+
+        CreateImage(imageName, pixels, max);
+    }
+
+    void Scene::CreateImage(const std::string& imageName, const ImageBuffer& pixels, double maxColorValue) const
+    {
+        const size_t pixelsWide = pixels.GetPixelsWide();
+        const size_t pixelsHigh = pixels.GetPixelsHigh();
+
+        // Convert the image buffer to an integer array of RGBA  values that LodePNG understands.
         const unsigned char OPAQUE_ALPHA_VALUE = 255;
         const unsigned BYTES_PER_PIXEL = 4;
 
@@ -679,27 +715,16 @@ namespace RayTracer
 
         std::vector<unsigned char> rgbaBuffer(RGBA_BUFFER_SIZE);
         unsigned rgbaIndex = 0;
-        const double patchSize = antiAliasFactor * antiAliasFactor;
         for (size_t j = 0; j < pixelsHigh; ++j)
         {
             for (size_t i = 0; i < pixelsWide; ++i)
             {
-                Color sum(0.0, 0.0, 0.0);
-                for (size_t di = 0; di < antiAliasFactor; ++di)
-                {
-                    for (size_t dj = 0; dj < antiAliasFactor; ++dj)
-                    {
-                        sum += buffer.Pixel(
-                            antiAliasFactor*i + di,
-                            antiAliasFactor*j + dj).color;
-                    }
-                }
-                sum /= patchSize;
+                const Color& color = pixels.Pixel(i, j).color;
 
                 // Convert to integer red, green, blue, alpha values, all of which must be in the range 0..255.
-                rgbaBuffer[rgbaIndex++] = ConvertPixelValue(sum.red, max);
-                rgbaBuffer[rgbaIndex++] = ConvertPixelValue(sum.green, max);
-                rgbaBuffer[rgbaIndex++] = ConvertPixelValue(sum.blue, max);
+                rgbaBuffer[rgbaIndex++] = ConvertPixelValue(color.red, maxColorValue);
+                rgbaBuffer[rgbaIndex++] = ConvertPixelValue(color.green, maxColorValue);
+                rgbaBuffer[rgbaIndex++] = ConvertPixelValue(color.blue, maxColorValue);
                 rgbaBuffer[rgbaIndex++] = OPAQUE_ALPHA_VALUE;
             }
         }
@@ -716,6 +741,136 @@ namespace RayTracer
         }
     }
 
+    PixelRect Scene::RenderDownsampledRect(
+        size_t left,
+        size_t top,
+        size_t width,
+        size_t height,
+        size_t pixelsWide,
+        size_t pixelsHigh,
+        double zoom,
+        size_t antiAliasFactor,
+        size_t tileSize,
+        RenderThreadPool& threadPool,
+        std::vector<TraceContext>& contextList,
+        bool useFloatColors) const
+    {
+        if ((left + width > pixelsWide) || (top + height > pixelsHigh))
+        {
+            throw ImagerException("Rectangle does not fit in the image");
+        }
+        if (tileSize == 0)
+        {
+            throw ImagerException("Tile size must be positive.");
+        }
+
+        // The oversampled pixels behind the rectangle, plus the halo where it lies inside the image.
+        const size_t largePixelsWide = antiAliasFactor * pixelsWide;
+        const size_t largePixelsHigh = antiAliasFactor * pixelsHigh;
+        const size_t iBegin = (left > 0) ? (antiAliasFactor * left - 1) : 0;
+        const size_t jBegin = (top > 0) ? (antiAliasFactor * top - 1) : 0;
+        const size_t iEnd = std::min(antiAliasFactor * (left + width) + 1, largePixelsWide);
+        const size_t jEnd = std::min(antiAliasFactor * (top + height) + 1, largePixelsHigh);
+
+        // Pixel (0, 0) of the buffer is the oversampled pixel (iBegin, jBegin) of the image.
+        ImageBuffer buffer(iEnd - iBegin, jEnd - jBegin, backgroundColor);
+
+        // The tiles are handed to the render threads in Morton order too, so the threads work on neighboring tiles at the same time.
+        const size_t largeTileSize = antiAliasFactor * tileSize;
+        std::vector<std::pair<size_t, size_t>> tiles;
+        MortonOrder((buffer.GetPixelsWide() + largeTileSize - 1) / largeTileSize, (buffer.GetPixelsHigh() + largeTileSize - 1) / largeTileSize, tiles);
+
+        threadPool.Run(tiles.size(), [&](size_t tileIndex, size_t threadIndex)
+        {
+            const size_t tileLeft = tiles[tileIndex].first * largeTileSize;
+            const size_t tileTop = tiles[tileIndex].second * largeTileSize;
+
+            TraceTile(buffer, iBegin, jBegin, tileLeft, tileTop,
+                std::min(largeTileSize, buffer.GetPixelsWide() - tileLeft), std::min(largeTileSize, buffer.GetPixelsHigh() - tileTop),
+                pixelsWide, pixelsHigh, zoom, antiAliasFactor, contextList[threadIndex]);
+        });
+
+        /**
+         * Heal the ambiguous pixels of the rectangle itself. Healing only averages neighbors that are not ambiguous,
+         * so it does not depend on the order the pixels are healed in, and every neighbor it may need is in the buffer.
+         */
+        const size_t iOwnBegin = antiAliasFactor * left - iBegin;
+        const size_t jOwnBegin = antiAliasFactor * top - jBegin;
+        const size_t iOwnEnd = iOwnBegin + antiAliasFactor * width;
+        const size_t jOwnEnd = jOwnBegin + antiAliasFactor * height;
+
+        double maxColorValue = 0.0;
+        for (size_t i = iOwnBegin; i < iOwnEnd; ++i)
+        {
+            for (size_t j = jOwnBegin; j < jOwnEnd; ++j)
+            {
+                if (buffer.Pixel(i, j).isAmbiguous)
+                {
+                    ResolveAmbiguousPixel(buffer, i, j);
+                }
+
+                // Same as ImageBuffer::MaxColorValue, over the rectangle only.
+                const Color& color = buffer.Pixel(i, j).color;
+                color.Validate();
+                maxColorValue = std::max(maxColorValue, std::max(color.red, std::max(color.green, color.blue)));
+            }
+        }
+
+        std::vector<PixelData> pixels(width * height);
+        for (size_t j = 0; j < height; ++j)
+        {
+            for (size_t i = 0; i < width; ++i)
+            {
+                pixels[j * width + i].color = DownsamplePixel(buffer, iOwnBegin + antiAliasFactor*i, jOwnBegin + antiAliasFactor*j, antiAliasFactor);
+            }
+        }
+
+        PixelRect rect(left, top, width, height, pixels, useFloatColors);
+        rect.SetMaxColorValue(maxColorValue);
+        return rect;
+    }
+
+    void Scene::TraceTile(
+        ImageBuffer& buffer,
+        size_t iOffset,
+        size_t jOffset,
+        size_t left,
+        size_t top,
+        size_t width,
+        size_t height,
+        size_t pixelsWide,
+        size_t pixelsHigh,
+        double zoom,
+        size_t antiAliasFactor,
+        TraceContext& context) const
+    {
+        std::vector<std::pair<size_t, size_t>> pixels;
+        MortonOrder(width, height, pixels);
+
+        for (const auto& pixel : pixels)
+        {
+            const size_t i = left + pixel.first;
+            const size_t j = top + pixel.second;
+
+            buffer.Pixel(i, j) = GetPixelAt(iOffset + i, jOffset + j, pixelsWide, pixelsHigh, zoom, antiAliasFactor, context);
+        }
+    }
+
+    Color Scene::DownsamplePixel(const ImageBuffer& buffer, size_t iFirst, size_t jFirst, size_t antiAliasFactor)
+    {
+        Color sum(0.0, 0.0, 0.0);
+        for (size_t di = 0; di < antiAliasFactor; ++di)
+        {
+            for (size_t dj = 0; dj < antiAliasFactor; ++dj)
+            {
+                sum += buffer.Pixel(iFirst + di, jFirst + dj).color;
+            }
+        }
+        sum /= static_cast<double>(antiAliasFactor * antiAliasFactor);
+
+        return sum;
+    }
+
     /**
 	 * Generate an image of the scene and write it to the specified output PNG file.
 	 * outPngFileName is the name of the PNG file to write the image to.
@@ -739,151 +894,54 @@ namespace RayTracer
 		// Oversample the image using the anti-aliasing factor.
 		const size_t largePixelsWide = antiAliasFactor * pixelsWide;
 		const size_t largePixelsHigh = antiAliasFactor * pixelsHigh;
-		const size_t smallerDim =
-			((pixelsWide < pixelsHigh) ? pixelsWide : pixelsHigh);
-
-		const double largeZoom = antiAliasFactor * zoom * smallerDim;
 		ImageBuffer buffer(largePixelsWide, largePixelsHigh, backgroundColor);
 
-		// The camera is located at the origin.
-		Vector camera(0.0, 0.0, 0.0);
+        // Solids may have been moved since they were added, so always start from a fresh hierarchy.
+        if (useBoundingVolumeHierarchy)
+        {
+            BuildBoundingVolumeHierarchy();
+        }
 
         /**
-		 * The camera faces in the -z direction.
-		 * This allows the +x direction to be to the right, and the +y direction to be upward.
+		 * Split the oversampled image into square tiles and spread them over the render threads.
+		 * Every pixel is traced exactly as a single thread would trace it and is written only by the thread that renders its tile,
+		 * so the image does not depend on the number of threads or on which thread rendered which tile.
 		 */
-        Vector direction(0.0, 0.0, -1.0);
+        const size_t tileColumns = (largePixelsWide + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
+		const size_t tileRows = (largePixelsHigh + RENDER_TILE_SIZE - 1) / RENDER_TILE_SIZE;
 
-		const Color fullIntensity(1.0, 1.0, 1.0);
+		RenderThreadPool threadPool(renderThreadCount);
 
-        /**
-		 * We keep a list of (i,j) screen coordinates for pixels we are not able to trace definitive rays for.
-		 * Later we will come back and fix these pixels.
-         */
-        std::vector<PixelCoordinates> ambigousPixel;
+		// Each render thread traces its rays with its own scratch memory.
+		std::vector<TraceContext> contextList(threadPool.GetThreadCount());
 
-		for(size_t i = 0; i < largePixelsWide; ++i)
+		threadPool.Run(tileColumns * tileRows, [&](size_t tileIndex, size_t threadIndex)
 		{
-			direction.x = (i - largePixelsWide / 2.0) / largeZoom;
-			for(size_t j = 0; j < largePixelsHigh; ++j)
-			{
-				direction.y = (largePixelsHigh / 2.0 - j) / largeZoom;
+			const size_t iBegin = (tileIndex % tileColumns) * RENDER_TILE_SIZE;
+			const size_t jBegin = (tileIndex / tileColumns) * RENDER_TILE_SIZE;
+			const size_t iEnd = std::min(iBegin + RENDER_TILE_SIZE, largePixelsWide);
+			const size_t jEnd = std::min(jBegin + RENDER_TILE_SIZE, largePixelsHigh);
 
-            #if RAYTRACE_DEBUG_POINTS
-
-				using namespace std;
-
-				// Assume no active debug point unless we find one below.
-				activeDebugPoint = NULL;
-
-				DebugPointList::const_iterator iter = debugPointList.begin();
-				DebugPointList::const_iterator end = debugPointList.end();
-				for(; iter != end; ++iter)
-				{
-					if((iter->iPixel == i) && (iter->jPixel == j))
-					{
-						cout << endl;
-						cout << "Hit breakpoint at (";
-						cout << i << ", " << j << ")" << endl;
-						activeDebugPoint = &(*iter);
-						break;
-					}
-				}
-
-            #endif
-
-				PixelData& pixel = buffer.Pixel(i, j);
-				try
-				{
-					// Trace a ray from the camera toward the given direction to figure out what color to assign to this pixel.
-					pixel.color = TraceRay(
-						camera,
-						direction,
-						ambientRefraction,
-						fullIntensity,
-						0);
-				}
-				catch(AmbiguousIntersectionException)
+			for(size_t i = iBegin; i < iEnd; ++i)
+			{
+				for(size_t j = jBegin; j < jEnd; ++j)
 				{
                     /**
-					 * Getting here means that somewhere in the recursive code for tracing rays, there were multiple 
-					 * intersections that had minimum distance from a vantage point.  
-                     * This can be really bad,  for example causing a ray of light to reflect  inward into a solid.
-                     *
-					 * Mark the pixel as ambiguous, so that any other ambiguous pixels nearby know not to use it.
+					 * Ambiguous pixels (multiple intersections at the same minimum distance) come back marked as such,
+					 * so that the healing pass below knows not to use them and can fill them in from their neighbors.
 					 */
-                    pixel.isAmbiguous = true;
-
-					// Keep a list of all ambiguous pixel coordinates so that we can rapidly enumerate through them in the disambiguation pass.
-                    ambigousPixel.push_back(PixelCoordinates(i, j));
+                    buffer.Pixel(i, j) = GetPixelAt(i, j, pixelsWide, pixelsHigh, zoom, antiAliasFactor, contextList[threadIndex]);
 				}
 			}
-		}
-
-    #if RAYTRACE_DEBUG_POINTS
-		// Leave no chance of a dangling pointer into debug points.
-		activeDebugPoint = NULL;
-    #endif
-
-		// Go back and "heal" ambiguous pixels as best we can.
-        auto iter = ambigousPixel.begin();
-        auto end = ambigousPixel.end();
-		for(; iter != end; ++iter)
-		{
-			const PixelCoordinates& p = *iter;
-			ResolveAmbiguousPixel(buffer, p.i, p.j);
-		}
+		});
 
         /**
-		 * We want to scale the arbitrary range of color component values to the range 0..255 allowed by PNG format.  
-         * We therefore find the maximum red, green, or blue value anywhere in the image.
+		 * Go back and "heal" ambiguous pixels as best we can.
+		 * Healing looks at neighboring pixels, which may belong to other tiles, so it runs only after every tile is done.
 		 */
-        const double max = buffer.MaxColorValue();
+        HandleAmbigousPixels(buffer, pixelsWide, pixelsHigh, zoom, antiAliasFactor);
 
-		// Downsample the image buffer to an integer array of RGBA  values that LodePNG understands.
-		const unsigned char OPAQUE_ALPHA_VALUE = 255;
-		const unsigned BYTES_PER_PIXEL = 4;
-
-		// The number of bytes in buffer to be passed to LodePNG.
-		const unsigned RGBA_BUFFER_SIZE = pixelsWide * pixelsHigh * BYTES_PER_PIXEL;
-
-		std::vector<unsigned char> rgbaBuffer(RGBA_BUFFER_SIZE);
-		unsigned rgbaIndex = 0;
-		const double patchSize = antiAliasFactor * antiAliasFactor;
-		for(size_t j = 0; j < pixelsHigh; ++j)
-		{
-			for(size_t i = 0; i < pixelsWide; ++i)
-			{
-				Color sum(0.0, 0.0, 0.0);
-				for(size_t di = 0; di < antiAliasFactor; ++di)
-				{
-					for(size_t dj = 0; dj < antiAliasFactor; ++dj)
-					{
-						sum += buffer.Pixel(
-							antiAliasFactor*i + di,
-							antiAliasFactor*j + dj).color;
-					}
-				}
-				sum /= patchSize;
-
-				// Convert to integer red, green, blue, alpha values, all of which must be in the range 0..255.
-				rgbaBuffer[rgbaIndex++] = ConvertPixelValue(sum.red, max);
-				rgbaBuffer[rgbaIndex++] = ConvertPixelValue(sum.green, max);
-				rgbaBuffer[rgbaIndex++] = ConvertPixelValue(sum.blue, max);
-				rgbaBuffer[rgbaIndex++] = OPAQUE_ALPHA_VALUE;
-			}
-		}
-
-		// Write the PNG file
-		const unsigned error = lodepng::encode(outPngFileName, rgbaBuffer, pixelsWide, pixelsHigh);
-
-		// If there was an encoding error, throw an exception.
-		if(error != 0)
-		{
-			std::string message = "PNG encoder error: ";
-			message += lodepng_error_text(error);
-			throw ImagerException(message.c_str());
-		}
+		CreateImage(outPngFileName, buffer, pixelsWide, pixelsHigh, zoom, antiAliasFactor);
 	}
 
     /**
@@ -895,11 +953,11 @@ namespace RayTracer
 	 * objects should control the index of refraction for any
 	 * overlapping volumes of space.
      */
-	boost::shared_ptr<SolidObject> Scene::PrimaryContainer(const Vector& point) const
+	boost::shared_ptr<SolidObject> Scene::PrimaryContainer(const Vector& point, TraceContext& context) const
 	{
 		for(auto solid : solidObjectList)
 		{
-            if (solid->Contains(point))
+            if (solid->Contains(point, context))
 			{
                 return solid;
 			}
@@ -7,10 +7,11 @@ namespace RayTracer
 	void SetComplement::AppendAllIntersections(
 		const Vector& vantage,
 		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
 	{
 		const size_t sizeBeforeAppend = intersectionList.size();
-		other->AppendAllIntersections(vantage, direction, intersectionList);
+		other->AppendAllIntersections(vantage, direction, intersectionList, context);
 
         /**
 		 * We need to toggle the direction of the surface normal vector, inverting what used to be thought of as the inside of the solid to being the outside of the complement.
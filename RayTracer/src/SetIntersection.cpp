@@ -1,6 +1,7 @@
 
 
 #include "SetIntersection.h"
+#include "TraceContext.h"
 
 /**
  * Implements SetIntersection, a class that creates a new solid based
@@ -14,54 +15,85 @@ namespace RayTracer
 		const Vector&       direction,
 		const SolidObject&  aSolid,
 		const SolidObject&  bSolid,
-		std::vector<Intersection>&   intersectionList) const
+		std::vector<Intersection>&   intersectionList,
+		TraceContext&       context) const
 
 	{
 		// Find all the intersections of aSolid with the ray emanating  from the vantage point.
-		tempIntersectionList.clear();
-		aSolid.AppendAllIntersections(vantage, direction, tempIntersectionList);
+		const TraceContext::ScratchIntersectionList tempIntersectionList(context);
+		aSolid.AppendAllIntersections(vantage, direction, tempIntersectionList.List(), context);
 
 		// For each intersection, append to intersectionList  if the point is inside bSolid.
-		std::vector<Intersection>::const_iterator iter = tempIntersectionList.begin();
-		std::vector<Intersection>::const_iterator end = tempIntersectionList.end();
+		std::vector<Intersection>::const_iterator iter = tempIntersectionList.List().begin();
+		std::vector<Intersection>::const_iterator end = tempIntersectionList.List().end();
 		for(; iter != end; ++iter)
 		{
-			if(bSolid.Contains(iter->point))
+			if(bSolid.Contains(iter->point, context))
 			{
 				intersectionList.push_back(*iter);
 			}
 		}
 	}
 
+	BoundingBox SetIntersection::GetBoundingBox() const
+	{
+        /**
+		 * Intersections survive only if they lie on one nested solid and inside the other, so they are confined to the overlap of the two boxes.
+		 * Contains() implementations tolerate points slightly outside the solid, by up to sqrt(EPSILON) where the tolerance applies
+		 * to a squared distance, so each box is grown by that much before taking the overlap.
+		 * SetDifference nests a SetComplement, whose box is unbounded, so its box is just that of the left solid.
+		 */
+        const double containmentTolerance = sqrt(EPSILON);
+		BoundingBox box = Left().GetBoundingBox().Expand(containmentTolerance);
+		return box.Intersect(Right().GetBoundingBox().Expand(containmentTolerance));
+	}
+
 	void SetIntersection::AppendAllIntersections(
 		const Vector& vantage,
 		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
 	{
 		AppendOverlappingIntersections(
-			vantage, direction, Left(), Right(), intersectionList);
+			vantage, direction, Left(), Right(), intersectionList, context);
 
 		AppendOverlappingIntersections(
-			vantage, direction, Right(), Left(), intersectionList);
+			vantage, direction, Right(), Left(), intersectionList, context);
+	}
+
+	bool SetIntersection::HasIntersectionCloserThan(
+		const Vector& vantage,
+		const Vector& direction,
+		double maxDistanceSquared,
+		TraceContext& context) const
+	{
+		return
+			HasOverlappingIntersection(vantage, direction, Left(), Right(), maxDistanceSquared, context) ||
+			HasOverlappingIntersection(vantage, direction, Right(), Left(), maxDistanceSquared, context);
 	}
 
 	bool SetIntersection::HasOverlappingIntersection(
 		const Vector&       vantage,
 		const Vector&       direction,
 		const SolidObject&  aSolid,
-		const SolidObject&  bSolid) const
+		const SolidObject&  bSolid,
+		double              maxDistanceSquared,
+		TraceContext&       context) const
 	{
 		// Find all the intersections of aSolid with the ray emanating from vantage.
-		tempIntersectionList.clear();
-		aSolid.AppendAllIntersections(vantage, direction, tempIntersectionList);
+		const TraceContext::ScratchIntersectionList tempIntersectionList(context);
+		aSolid.AppendAllIntersections(vantage, direction, tempIntersectionList.List(), context);
 
 		// Iterate through all the intersections we found with aSolid.
-		std::vector<Intersection>::const_iterator iter = tempIntersectionList.begin();
-		std::vector<Intersection>::const_iterator end = tempIntersectionList.end();
+		std::vector<Intersection>::const_iterator iter = tempIntersectionList.List().begin();
+		std::vector<Intersection>::const_iterator end = tempIntersectionList.List().end();
 		for(; iter != end; ++iter)
 		{
-			// If bSolid contains any of the intersections with aSolid, then aSolid and bSolid definitely overlap at that point.
-			if(bSolid.Contains(iter->point))
+			/**
+			 * If bSolid contains any of the intersections with aSolid, then aSolid and bSolid definitely overlap at that point.
+			 * Only intersections within the distance limit count; checking that first also skips the more expensive Contains() call.
+			 */
+			if(iter->distanceSquared < maxDistanceSquared && bSolid.Contains(iter->point, context))
 			{
 				return true;
 			}
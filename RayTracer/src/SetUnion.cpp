@@ -7,12 +7,13 @@ namespace RayTracer
 	void SetUnion::AppendAllIntersections(
 		const Vector& vantage,
 		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
 	{
 		// Find all intersections with the left solid.
-		Left().AppendAllIntersections(vantage, direction, intersectionList);
+		Left().AppendAllIntersections(vantage, direction, intersectionList, context);
 
 		// Append all intersections with the right solid.
-		Right().AppendAllIntersections(vantage, direction, intersectionList);
+		Right().AppendAllIntersections(vantage, direction, intersectionList, context);
 	}
 }
\ No newline at end of file
@@ -1,10 +1,33 @@
 
 
 #include "SolidObject.h"
+#include "TraceContext.h"
 
 namespace RayTracer
 {
-	bool SolidObject::Contains(const Vector& point) const
+	int SolidObject::FindClosestIntersection(const Vector& vantage, const Vector& direction, Intersection &intersection, TraceContext& context) const
+	{
+		const TraceContext::ScratchIntersectionList scratch(context);
+		AppendAllIntersections(vantage, direction, scratch.List(), context);
+		return PickClosestIntersection(scratch.List(), intersection);
+	}
+
+	bool SolidObject::HasIntersectionCloserThan(const Vector& vantage, const Vector& direction, double maxDistanceSquared, TraceContext& context) const
+	{
+		const TraceContext::ScratchIntersectionList scratch(context);
+		AppendAllIntersections(vantage, direction, scratch.List(), context);
+
+		for(const Intersection& intersection : scratch.List())
+		{
+			if(intersection.distanceSquared < maxDistanceSquared)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool SolidObject::Contains(const Vector& point, TraceContext& context) const
 	{
 		// FIXFIXFIX:  This function does not handle the "corner case": multiple intersections found at the same point but for different facets of the solid.
 
@@ -16,14 +39,14 @@ namespace RayTracer
 			 */
             const Vector direction(0.0, 0.0, 1.0);
 
-			enclosureList.clear();
-			AppendAllIntersections(point, direction, enclosureList);
+			const TraceContext::ScratchIntersectionList enclosureList(context);
+			AppendAllIntersections(point, direction, enclosureList.List(), context);
 
 			int enterCount = 0;     // number of times we enter the solid
 			int exitCount = 0;     // number of times we exit the solid
 
-			std::vector<Intersection>::const_iterator iter = enclosureList.begin();
-			std::vector<Intersection>::const_iterator end = enclosureList.end();
+			std::vector<Intersection>::const_iterator iter = enclosureList.List().begin();
+			std::vector<Intersection>::const_iterator end = enclosureList.List().end();
 			for(; iter != end; ++iter)
 			{
 				const Intersection& intersection = *iter;
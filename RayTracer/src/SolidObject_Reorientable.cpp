@@ -52,15 +52,39 @@ namespace RayTracer
 		return *this;
 	}
 
+	BoundingBox SolidObject_Reorientable::GetBoundingBox() const
+	{
+		const BoundingBox objectBox = ObjectSpace_GetBoundingBox();
+		if(objectBox.IsEmpty() || !objectBox.IsFinite())
+		{
+			return objectBox;
+		}
+
+		const Vector objectCenter = objectBox.Centroid();
+		const Vector halfSize = (objectBox.maxCorner - objectBox.minCorner) / 2.0;
+
+        /**
+		 * Each camera axis is a mix of the object axes given by xDir, yDir, zDir, so the half-size of the rotated box
+		 * along a camera axis is the sum of the object half-sizes weighted by the absolute values of that mix.
+		 */
+        const Vector cameraHalfSize(
+			fabs(xDir.x)*halfSize.x + fabs(xDir.y)*halfSize.y + fabs(xDir.z)*halfSize.z,
+			fabs(yDir.x)*halfSize.x + fabs(yDir.y)*halfSize.y + fabs(yDir.z)*halfSize.z,
+			fabs(zDir.x)*halfSize.x + fabs(zDir.y)*halfSize.y + fabs(zDir.z)*halfSize.z);
+
+		const Vector cameraCenter = CameraPointFromObjectPoint(objectCenter);
+		return BoundingBox(cameraCenter - cameraHalfSize, cameraCenter + cameraHalfSize);
+	}
+
 	// Appends to 'intersectionList' a list of all the intersections  found starting at the specified vantage point in the specified direction.
-	void SolidObject_Reorientable::AppendAllIntersections(const Vector& vantage, const Vector& direction, std::vector<Intersection>& intersectionList) const
+	void SolidObject_Reorientable::AppendAllIntersections(const Vector& vantage, const Vector& direction, std::vector<Intersection>& intersectionList, TraceContext& context) const
 	{
 		const Vector objectVantage = ObjectPointFromCameraPoint(vantage);
 		const Vector objectRay = ObjectDirFromCameraDir(direction);
 
 		const size_t sizeBeforeAppend = intersectionList.size();
 
-		ObjectSpace_AppendAllIntersections(objectVantage, objectRay, intersectionList);
+		ObjectSpace_AppendAllIntersections(objectVantage, objectRay, intersectionList, context);
 
 		// Iterate only through the items we just appended, skipping over anything that was already in the list before this function was called.
 		for(size_t index = sizeBeforeAppend; index < intersectionList.size(); ++index)
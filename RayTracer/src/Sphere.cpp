@@ -9,7 +9,8 @@ namespace RayTracer
 	void Sphere::AppendAllIntersections(
 		const Vector& vantage,
 		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
 	{
         /**
 		 * Calculate the coefficients of the quadratic equation 
@@ -61,4 +62,37 @@ namespace RayTracer
 			}
 		}
 	}
+
+	bool Sphere::HasIntersectionCloserThan(
+		const Vector& vantage,
+		const Vector& direction,
+		double maxDistanceSquared,
+		TraceContext& context) const
+	{
+		// Same quadratic as AppendAllIntersections, but stop at the first root that is close enough.
+		const Vector displacement = vantage - Center();
+		const double a = direction.MagnitudeSquared();
+		const double b = 2.0 * DotProduct(direction, displacement);
+		const double c = displacement.MagnitudeSquared() - radius*radius;
+
+		const double radicand = b*b - 4.0*a*c;
+		if(radicand >= 0.0)
+		{
+			const double root = sqrt(radicand);
+			const double denom = 2.0 * a;
+			const double u[2] = {
+				(-b + root) / denom,
+				(-b - root) / denom
+			};
+
+			for(int i = 0; i < 2; ++i)
+			{
+				if(u[i] > EPSILON && (u[i] * direction).MagnitudeSquared() < maxDistanceSquared)
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
 }
\ No newline at end of file
@@ -2,10 +2,35 @@
 
 namespace RayTracer
 {
+	bool Spheroid::ObjectSpace_HasIntersectionCloserThan(
+		const Vector& vantage,
+		const Vector& direction,
+		double maxDistanceSquared,
+		TraceContext& context) const
+	{
+		double u[2];
+		const int numSolutions = Algebra::SolveQuadraticEquation(
+			b2*c2*direction.x*direction.x + a2*c2*direction.y*direction.y + a2*b2*direction.z*direction.z,
+			2.0*(b2*c2*vantage.x*direction.x + a2*c2*vantage.y*direction.y + a2*b2*vantage.z*direction.z),
+			b2*c2*vantage.x*vantage.x + a2*c2*vantage.y*vantage.y + a2*b2*vantage.z*vantage.z - a2*b2*c2,
+			u
+		);
+
+		for(int i = 0; i < numSolutions; ++i)
+		{
+			if(u[i] > EPSILON && (u[i] * direction).MagnitudeSquared() < maxDistanceSquared)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
 	void Spheroid::ObjectSpace_AppendAllIntersections(
 		const Vector& vantage,
 		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
 	{
 		double u[2];
 		const int numSolutions = Algebra::SolveQuadraticEquation(
@@ -5,7 +5,8 @@ namespace RayTracer
 	void ThinRing::ObjectSpace_AppendAllIntersections(
 		const Vector& vantage,
 		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
 	{
 		if(fabs(direction.z) > EPSILON)
 		{
@@ -36,4 +37,27 @@ namespace RayTracer
 			}
 		}
 	}
+
+	bool ThinRing::ObjectSpace_HasIntersectionCloserThan(
+		const Vector& vantage,
+		const Vector& direction,
+		double maxDistanceSquared,
+		TraceContext& context) const
+	{
+		if(fabs(direction.z) > EPSILON)
+		{
+			const double u = -vantage.z / direction.z;
+			if(u > EPSILON)
+			{
+				const double x = u*direction.x + vantage.x;
+				const double y = u*direction.y + vantage.y;
+				const double m = x*x + y*y;
+				return
+					(m <= r2*r2 + EPSILON) &&
+					(r1*r1 <= m + EPSILON) &&
+					((u * direction).MagnitudeSquared() < maxDistanceSquared);
+			}
+		}
+		return false;
+	}
 }
\ No newline at end of file
@@ -52,8 +52,15 @@ namespace RayTracer
 	void Torus::ObjectSpace_AppendAllIntersections(
 		const Vector& vantage,
 		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
 	{
+		// Solving the quartic is expensive; don't bother when the ray cannot come near the torus.
+		if(!ObjectSpace_GetBoundingBox().IsHitByRay(vantage, direction))
+		{
+			return;
+		}
+
 		double u[4];
 		const int numSolutions = SolveIntersections(vantage, direction, u);
 
@@ -69,6 +76,29 @@ namespace RayTracer
 		}
 	}
 
+	bool Torus::ObjectSpace_HasIntersectionCloserThan(
+		const Vector& vantage,
+		const Vector& direction,
+		double maxDistanceSquared,
+		TraceContext& context) const
+	{
+		if(!ObjectSpace_GetBoundingBox().IsHitByRay(vantage, direction))
+		{
+			return false;
+		}
+
+		double u[4];
+		const int numSolutions = SolveIntersections(vantage, direction, u);
+		for(int i = 0; i < numSolutions; ++i)
+		{
+			if((u[i] * direction).MagnitudeSquared() < maxDistanceSquared)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
 	Vector Torus::SurfaceNormal(const Vector& point) const
 	{
         /**
@@ -87,7 +117,17 @@ namespace RayTracer
 		return Vector(a*point.x, a*point.y, point.z).UnitVector();
 	}
 
-	bool Torus::ObjectSpace_Contains(const Vector& point) const
+	BoundingBox Torus::ObjectSpace_GetBoundingBox() const
+	{
+        /**
+		 * The torus lies flat on the xy plane. The box is grown by a small fraction of the tube radius
+		 * because roots from the quartic solver can be slightly off the true surface for grazing rays.
+		 */
+        const double outer = R + S;
+		return BoundingBox(Vector(-outer, -outer, -S), Vector(+outer, +outer, +S)).Expand(0.01 * S);
+	}
+
+	bool Torus::ObjectSpace_Contains(const Vector& point, TraceContext& context) const
 	{
         /**
 		 * See http://en.wikipedia.org/wiki/Torus "Geometry" section about
@@ -1,7 +1,15 @@
 #include "TriangleMesh.h"
 
+#include <algorithm>
+
 namespace RayTracer
 {
+	namespace
+	{
+		// Below this, the ray is taken as parallel to the plane of the triangle and misses it.
+		const double MIN_TRIANGLE_DETERMINANT = 1.0e-12;
+	}
+
     /**
 	 * Adds another triangular facet to this solid object.
 	 * aPointIndex, bPointIndex, cPointIndex are integer indices 
@@ -28,98 +36,267 @@ namespace RayTracer
 			// This is an error, because the triangle cannot include the same point twice (otherwise it has no area).
 			throw ImagerException("Not allowed to use the same point index twice within a triangle.");
 		}
-		triangleList.push_back(Triangle(aPointIndex, bPointIndex, cPointIndex, optics));
+		triangleList.push_back(Triangle(aPointIndex, bPointIndex, cPointIndex, static_cast<std::uint32_t>(AddMaterial(optics))));
+		geometryList.push_back(MakeTriangleGeometry(pointList[aPointIndex], pointList[bPointIndex], pointList[cPointIndex]));
+		isTriangleTreeBuilt = false;
 	}
 
-	void TriangleMesh::AppendAllIntersections(
-		const Vector& vantage,
-		const Vector& direction,
-		std::vector<Intersection>& intersectionList) const
+	size_t TriangleMesh::AddMaterial(const Optics& optics)
 	{
-		// Iterate through all the triangles in this solid object, looking for every intersection.
-		std::vector<Triangle>::const_iterator iter = triangleList.begin();
-		std::vector<Triangle>::const_iterator end = triangleList.end();
-		for(; iter != end; ++iter)
+		// Consecutive faces most often share their material, and then the lookup is skipped.
+		if(!materialList.empty() && materialList.back() == optics)
 		{
-			const Triangle& tri = *iter;
-			const Vector& aPoint = pointList[tri.a];
-			const Vector& bPoint = pointList[tri.b];
-			const Vector& cPoint = pointList[tri.c];
-
-            /**
-			 * The variables u, v, w are deliberately left 
-			 * uninitialized for efficiency; they are only 
-			 * assigned values if we find an intersection.
-			 */
-            double u, v, w;
-
-            /**
-			 * Sometimes we have to try more than one ordering of the points (A,B,C) 
-			 * in order to get a valid solution to the intersection equations.
-			 * Take advantage of C++ short-circuit boolean or "||" operator:
-			 * as soon as one of the function calls returns true, we don't call any more.
-			 */
-            if(AttemptPlaneIntersection(vantage, direction, aPoint, bPoint, cPoint, u, v, w) ||
-				AttemptPlaneIntersection(vantage, direction, bPoint, cPoint, aPoint, u, v, w) ||
-				AttemptPlaneIntersection(vantage, direction, cPoint, aPoint, bPoint, u, v, w))
+			return materialList.size() - 1;
+		}
+
+		const auto inserted = materialIndex.insert(std::make_pair(MakeMaterialKey(optics), materialList.size()));
+		if(inserted.second)
+		{
+			materialList.push_back(optics);
+		}
+
+		return inserted.first->second;
+	}
+
+	TriangleMesh::MaterialKey TriangleMesh::MakeMaterialKey(const Optics& optics)
+	{
+		const Color& matteColor = optics.GetMatteColor();
+		const Color& glossColor = optics.GetGlossColor();
+
+		const MaterialKey key = {{
+			matteColor.red, matteColor.green, matteColor.blue,
+			glossColor.red, glossColor.green, glossColor.blue,
+			optics.GetOpacity() }};
+
+		return key;
+	}
+
+	void TriangleMesh::UpdateMaterialIndex()
+	{
+		materialIndex.clear();
+		for(size_t index = 0; index < materialList.size(); ++index)
+		{
+			materialIndex.insert(std::make_pair(MakeMaterialKey(materialList[index]), index));
+		}
+	}
+
+	TriangleMesh::TriangleGeometry TriangleMesh::MakeTriangleGeometry(const Vector& a, const Vector& b, const Vector& c)
+	{
+		TriangleGeometry geometry;
+		geometry.vertex = a;
+		geometry.edgeAB = b - a;
+		geometry.edgeAC = c - a;
+
+        /**
+		 * The normal vector is the normalized (unit magnitude) vector cross product of
+		 * the vectors AB and BC.  Because A,B,C are always counterclockwise as seen
+		 * from outside the solid surface, the right-hand rule for cross products
+		 * causes the normal vector to point outward from the solid object.
+		 */
+		geometry.normal = CrossProduct(b - a, c - b).UnitVector();
+
+		return geometry;
+	}
+
+	void TriangleMesh::UpdateGeometry()
+	{
+		boundingBox = BoundingBox::Empty();
+		for(const Vector& point : pointList)
+		{
+			boundingBox.Include(point);
+		}
+
+		geometryList.clear();
+		geometryList.reserve(triangleList.size());
+		for(const Triangle& tri : triangleList)
+		{
+			geometryList.push_back(MakeTriangleGeometry(pointList[tri.a], pointList[tri.b], pointList[tri.c]));
+		}
+
+		isTriangleTreeBuilt = false;
+	}
+
+	const BoxTree& TriangleMesh::GetTriangleTree() const
+	{
+        /**
+		 * Every render thread may get here with its first ray; one of them builds the tree while the others wait.
+		 * Once built, the tree is only read, and checking the flag is all the locking a ray pays for.
+		 */
+		if(!isTriangleTreeBuilt.load(std::memory_order_acquire))
+		{
+			std::lock_guard<std::mutex> guardLock(triangleTreeMutex);
+			if(!isTriangleTreeBuilt.load(std::memory_order_relaxed))
 			{
-                /**
-				 * We found an intersection of the direction with the plane that passes through the points (A,B,C).
-				 * Figure out whether the intersection point is inside the triangle (A,B,C) or outside it.
-				 * We are interested only in intersections that are inside the triangle.
-				 * The trick here is that the values v,w are fractions that will be 0..1 along the
-				 * line segments AB and BC (or whichever ordered triple of points we found the solution for).
-				 * If we just checked that both v and w are in the range 0..1, we would be finding
-				 * intersections with a parallelogram ABCD, where D is the fourth point that completes the
-				 * parallelogram whose other vertices are ABC.
-				 * But checking instead that v + w <= 1.0 constrains the set of points
-				 * to the interior or border of the triangle ABC.
-				 */
-                if((v >= 0.0) && (w >= 0.0) && (v + w <= 1.0) && (u >= EPSILON))
+				// Padded like the mesh's own box, so that roundoff cannot put a hit on a triangle's edge just outside its box.
+				std::vector<BoundingBox> boxList;
+				boxList.reserve(triangleList.size());
+				for(const Triangle& tri : triangleList)
 				{
-                    /**
-					 * We have found an intersection with one of the triangular facets!
-					 * Also determine whether the intersection point is in "front" of the vantage (positively along the direction)
-					 * by checking for (u >= EPSILON).  Note that we allow for a little roundoff error by checking
-					 * against EPSILON instead of 0.0, because this method is called using vantage = a point on this surface,
-					 * in order to calculate surface lighting, and we don't want to act like the surface is shading itself!
-					 */
-                    if(u >= EPSILON)
-					{
-						// We have found a new intersection to be added to the list.
-						const Vector displacement = u * direction;
-
-						Intersection intersection;
-						intersection.distanceSquared = displacement.MagnitudeSquared();
-						intersection.point = vantage + displacement;
-						intersection.surfaceNormal = NormalVector(tri);
-						intersection.solid = this;
-						intersection.context = &tri;   // remember which triangle we hit, for SurfaceOptics().
-
-						intersectionList.push_back(intersection);
-					}
+					BoundingBox box = BoundingBox::Empty();
+					box.Include(pointList[tri.a]).Include(pointList[tri.b]).Include(pointList[tri.c]);
+					boxList.push_back(box.Expand(EPSILON));
 				}
+
+				triangleTree.Build(boxList);
+				isTriangleTreeBuilt.store(true, std::memory_order_release);
 			}
 		}
+
+		return triangleTree;
 	}
 
-	Vector TriangleMesh::NormalVector(const Triangle& triangle) const
+	bool TriangleMesh::IntersectTriangle(
+		const TriangleGeometry& geometry,
+		const Vector& vantage,
+		const Vector& direction,
+		double& u)
 	{
         /**
-		 * We could make this run faster if we cached the normal vector for each triangle,
-		 * but that will mean carefully remembering to update the cache every time the vertex values 
-		 * in pointList are changed.
-         *
-		 * The normal vector is the normalized (unit magnitude) vector cross product of
-		 * the vectors AB and BC.  Because A,B,C are always counterclockwise as seen 
-		 * from outside the solid surface, the right-hand rule for cross products 
-		 * causes the normal vector to point outward from the solid object.
+		 * We solve  vantage + u*direction = A + v*(B-A) + w*(C-A)  for (u, v, w) by Cramer's rule,
+		 * writing each 3x3 determinant as a scalar triple product. The two cross products are shared
+		 * by all three determinants, so the whole solve costs two cross products and four dot products.
+		 * The determinant is zero when the direction is parallel to the plane of the triangle.
 		 */
-        const Vector& a = pointList[triangle.a];
-		const Vector& b = pointList[triangle.b];
-		const Vector& c = pointList[triangle.c];
+		const Vector p = CrossProduct(direction, geometry.edgeAC);
+		const double determinant = DotProduct(geometry.edgeAB, p);
+		if(fabs(determinant) < MIN_TRIANGLE_DETERMINANT)
+		{
+			return false;
+		}
+
+		const double inverse = 1.0 / determinant;
+		const Vector t = vantage - geometry.vertex;
+
+        /**
+		 * v and w are fractions along the edges AB and AC. Checking both for 0..1 would find
+		 * intersections with the parallelogram ABDC; checking instead that v + w <= 1.0
+		 * constrains the set of points to the interior or border of the triangle ABC.
+		 */
+		const double v = DotProduct(t, p) * inverse;
+		if((v < 0.0) || (v > 1.0))
+		{
+			return false;
+		}
+
+		const Vector q = CrossProduct(t, geometry.edgeAB);
+		const double w = DotProduct(direction, q) * inverse;
+		if((w < 0.0) || (v + w > 1.0))
+		{
+			return false;
+		}
+
+        /**
+		 * Also determine whether the intersection point is in "front" of the vantage (positively along the direction)
+		 * by checking for (u >= EPSILON).  Note that we allow for a little roundoff error by checking
+		 * against EPSILON instead of 0.0, because this method is called using vantage = a point on this surface,
+		 * in order to calculate surface lighting, and we don't want to act like the surface is shading itself!
+		 */
+		u = DotProduct(geometry.edgeAC, q) * inverse;
+		return u >= EPSILON;
+	}
+
+	void TriangleMesh::AppendAllIntersections(
+		const Vector& vantage,
+		const Vector& direction,
+		std::vector<Intersection>& intersectionList,
+		TraceContext& context) const
+	{
+        /**
+		 * Skip the whole mesh when the ray misses its bounding box.
+		 * The box is grown by EPSILON so that a ray hitting exactly on an outer edge is not lost to roundoff.
+		 */
+        if(!BoundingBox(boundingBox).Expand(EPSILON).IsHitByRay(vantage, direction))
+		{
+			return;
+		}
+
+		const size_t firstAppended = intersectionList.size();
+
+		auto appendTriangle = [&](size_t index)
+		{
+			double u;
+			if(IntersectTriangle(geometryList[index], vantage, direction, u))
+			{
+				// We have found a new intersection to be added to the list.
+				const Vector displacement = u * direction;
+
+				Intersection intersection;
+				intersection.distanceSquared = displacement.MagnitudeSquared();
+				intersection.point = vantage + displacement;
+				intersection.surfaceNormal = geometryList[index].normal;
+				intersection.solid = this;
+				intersection.context = &triangleList[index];   // remember which triangle we hit, for SurfaceOptics().
+
+				intersectionList.push_back(intersection);
+			}
+
+			// Keep going: every intersection is wanted, not just the first one.
+			return false;
+		};
+
+		if(!useTriangleTree)
+		{
+			// Iterate through all the triangles in this solid object, looking for every intersection.
+			for(size_t index = 0; index < triangleList.size(); ++index)
+			{
+				appendTriangle(index);
+			}
+			return;
+		}
+
+		GetTriangleTree().VisitItemsAlongRay(vantage, BoxTree::InverseDirection(direction), BoundingBox::Infinity(), appendTriangle);
+
+        /**
+		 * The tree visits the triangles in no particular order. PickClosestIntersection breaks near-ties by list order,
+		 * so put the intersections back in the order the triangles were added, the order the linear scan finds them in.
+		 * There are rarely more than a handful, and they are often in order already.
+		 */
+		auto addedEarlier = [](const Intersection& first, const Intersection& second)
+		{
+			return static_cast<const Triangle*>(first.context) < static_cast<const Triangle*>(second.context);
+		};
+		if(!std::is_sorted(intersectionList.begin() + firstAppended, intersectionList.end(), addedEarlier))
+		{
+			std::sort(intersectionList.begin() + firstAppended, intersectionList.end(), addedEarlier);
+		}
+	}
+
+	bool TriangleMesh::HasIntersectionCloserThan(
+		const Vector& vantage,
+		const Vector& direction,
+		double maxDistanceSquared,
+		TraceContext& context) const
+	{
+		if(!BoundingBox(boundingBox).Expand(EPSILON).IsHitByRay(vantage, direction))
+		{
+			return false;
+		}
+
+		// Same per-triangle test as AppendAllIntersections, stopping at the first facet that is close enough.
+		auto isCloser = [&](size_t index)
+		{
+			double u;
+			return IntersectTriangle(geometryList[index], vantage, direction, u) && (u * direction).MagnitudeSquared() < maxDistanceSquared;
+		};
+
+		if(!useTriangleTree)
+		{
+			for(size_t index = 0; index < triangleList.size(); ++index)
+			{
+				if(isCloser(index))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
 
-		return CrossProduct(b - a, c - b).UnitVector();
+		// Only boxes that the ray enters before the maximum distance can hold a closer intersection.
+		return GetTriangleTree().VisitItemsAlongRay(
+			vantage,
+			BoxTree::InverseDirection(direction),
+			sqrt(maxDistanceSquared / direction.MagnitudeSquared()),
+			isCloser);
 	}
 
 	SolidObject& TriangleMesh::Translate(double dx, double dy, double dz)
@@ -136,6 +313,7 @@ namespace RayTracer
 			point.z += dz;
 		}
 
+		UpdateGeometry();
 		return *this;
 	}
 
@@ -156,6 +334,7 @@ namespace RayTracer
 			point.z = center.z + (a*dz + b*dy);
 		}
 
+		UpdateGeometry();
 		return *this;
 	}
 
@@ -176,6 +355,7 @@ namespace RayTracer
 			point.z = center.z + (a*dz - b*dx);
 		}
 
+		UpdateGeometry();
 		return *this;
 	}
 
@@ -196,6 +376,7 @@ namespace RayTracer
 			point.y = center.y + (a*dy + b*dx);
 		}
 
+		UpdateGeometry();
 		return *this;
 	}
 
@@ -205,6 +386,6 @@ namespace RayTracer
 	{
 		// Each triangular face may have different optics, so we take advantage of the fact that 'context' is set to point to whichever Triangle the ray intersected.
 		const Triangle& triangle = *static_cast<const Triangle *>(context);
-		return triangle.optics;
+		return materialList[triangle.material];
 	}
 }
@@ -1,4 +1,13 @@
 #include "UnitTests.h"
+#include "ArchiveFormat.h"
+#include "MeshImporter.h"
+#include "PixelTile.h"
+#include "RenderThreadPool.h"
+
+#include <chrono>
+#include <iterator>
+#include <random>
+#include <sstream>
 
 BOOST_CLASS_EXPORT_GUID(RayTracer::ChessBoard, "chess_board");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Color, "color");
@@ -7,6 +16,7 @@ BOOST_CLASS_EXPORT_GUID(RayTracer::Cuboid, "cuboid");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Cylinder, "cylinder");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Dodecahedron, "dodecahedron");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Icosahedron, "icosahedron");
+BOOST_CLASS_EXPORT_GUID(RayTracer::Instance, "instance");
 BOOST_CLASS_EXPORT_GUID(RayTracer::PixelData, "pixel_data");
 BOOST_CLASS_EXPORT_GUID(RayTracer::ImageBuffer, "image_buffer");
 BOOST_CLASS_EXPORT_GUID(RayTracer::Intersection, "intersection");
@@ -857,6 +867,890 @@ namespace RayTracer
             std::cout << "Wrote " << filename << std::endl;
         }
 
+        static std::string ReadWholeFile(const std::string& filename)
+        {
+            std::ifstream inStream(filename.c_str(), std::ios::binary);
+            return std::string(std::istreambuf_iterator<char>(inStream), std::istreambuf_iterator<char>());
+        }
+
+        void BoundingVolumeHierarchyBenchmark()
+        {
+            using namespace RayTracer;
+
+            /**
+             * Renders clouds of 10 to 100k random spheres with and without the bounding volume hierarchy.
+             * The linear scan is skipped for the largest scene, where it would take far too long.
+             */
+            const size_t sphereCounts[] = { 10, 100, 1000, 10000, 100000 };
+            const size_t maxLinearSphereCount = 10000;
+            const double cloudSize = 40.0;
+
+            for (size_t sphereCount : sphereCounts)
+            {
+                Scene scene(Color(0.0, 0.0, 0.0));
+
+                std::mt19937 generator(12345);
+                std::uniform_real_distribution<double> coordinate(-cloudSize / 2.0, +cloudSize / 2.0);
+                const double radius = 0.3 * cloudSize / std::cbrt(static_cast<double>(sphereCount));
+                for (size_t i = 0; i < sphereCount; ++i)
+                {
+                    const Vector center(coordinate(generator), coordinate(generator), coordinate(generator) - 80.0);
+                    boost::shared_ptr<SolidObject> sphere = boost::shared_ptr<SolidObject>(new Sphere(center, radius));
+                    sphere->SetFullMatte(Color(0.4 + 0.6 * (i % 3) / 2.0, 0.6, 0.9 - 0.6 * (i % 5) / 4.0));
+                    scene.AddSolidObject(sphere);
+                }
+
+                scene.AddLightSource(boost::shared_ptr<LightSource>(new LightSource(Vector(-45.0, +60.0, +50.0), Color(1.0, 1.0, 0.6, 1.0))));
+                scene.AddLightSource(boost::shared_ptr<LightSource>(new LightSource(Vector(+40.0, +20.0, -20.0), Color(0.4, 0.4, 1.0, 0.5))));
+
+                std::ostringstream bvhFilename;
+                bvhFilename << "bvh_" << sphereCount << ".png";
+
+                auto start = std::chrono::steady_clock::now();
+                scene.SaveImage(bvhFilename.str().c_str(), 320, 240, 1.0, 1);
+                const double bvhSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                std::cout << sphereCount << " spheres: hierarchy " << bvhSeconds << " s";
+
+                if (sphereCount <= maxLinearSphereCount)
+                {
+                    std::ostringstream linearFilename;
+                    linearFilename << "linear_" << sphereCount << ".png";
+
+                    scene.SetUseBoundingVolumeHierarchy(false);
+                    start = std::chrono::steady_clock::now();
+                    scene.SaveImage(linearFilename.str().c_str(), 320, 240, 1.0, 1);
+                    const double linearSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                    std::cout << ", linear " << linearSeconds << " s, speedup " << (linearSeconds / bvhSeconds);
+
+                    if (ReadWholeFile(bvhFilename.str()) != ReadWholeFile(linearFilename.str()))
+                    {
+                        std::cout << std::endl;
+                        throw ImagerException("Image rendered with the bounding volume hierarchy differs from the linear scan.");
+                    }
+                    std::cout << ", images identical";
+                }
+                std::cout << std::endl;
+            }
+        }
+
+        // The kaleidoscope mirrors around a glossy sphere: their reflections make some pixels far more expensive than others.
+        static void AddMirroredSphere(RayTracer::Scene& scene)
+        {
+            using namespace RayTracer;
+
+            AddKaleidoscopeMirrors(scene, 0.5, 10.0);
+
+            boost::shared_ptr<SolidObject> sphere = boost::shared_ptr<SolidObject>(new Sphere(Vector(0.0, 0.0, -40.0), 1.5));
+            sphere->SetMatteGlossBalance(0.4, Color(0.6, 0.8, 1.0), Color(1.0, 1.0, 1.0));
+            scene.AddSolidObject(sphere);
+
+            scene.AddLightSource(boost::shared_ptr<LightSource>(new LightSource(Vector(-45.0, +10.0, +50.0), Color(1.0, 1.0, 0.3, 1.0))));
+            scene.AddLightSource(boost::shared_ptr<LightSource>(new LightSource(Vector(+5.0, +90.0, -40.0), Color(0.5, 0.5, 1.5, 0.5))));
+        }
+
+        // Throws with 'message' unless both image files are identical byte for byte.
+        static void CheckSameImage(const std::string& filename, const std::string& otherFilename, const char* message)
+        {
+            if (ReadWholeFile(filename) != ReadWholeFile(otherFilename))
+            {
+                throw ImagerException(message);
+            }
+        }
+
+        void ParallelRenderTest()
+        {
+            using namespace RayTracer;
+
+            /**
+             * Renders the kaleidoscope mirrors, whose reflections make some tiles far more expensive than others,
+             * on one thread and then on every hardware thread. Both images must be identical byte for byte.
+             */
+            Scene scene(Color(0.0, 0.0, 0.0));
+            AddMirroredSphere(scene);
+
+            const size_t threadCounts[] = { 1, RenderThreadPool::DefaultThreadCount() };
+            const char* filenames[] = { "parallel_1.png", "parallel_n.png" };
+            double seconds[2];
+
+            for (size_t i = 0; i < 2; ++i)
+            {
+                scene.SetRenderThreadCount(threadCounts[i]);
+                const auto start = std::chrono::steady_clock::now();
+                scene.SaveImage(filenames[i], 600, 400, 2.0, 2);
+                seconds[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << "Wrote " << filenames[i] << " with " << threadCounts[i] << " thread(s) in " << seconds[i] << " s" << std::endl;
+            }
+
+            CheckSameImage(filenames[0], filenames[1], "Parallel render differs from serial render.");
+            std::cout << "Images identical, speedup " << (seconds[0] / seconds[1]) << std::endl;
+        }
+
+        void DownsampledRenderTest()
+        {
+            using namespace RayTracer;
+
+            /**
+             * Renders the kaleidoscope mirrors once as a whole and once as rectangles anti-aliased separately, the way workers do,
+             * with rectangle sizes that do not divide the image evenly. Both images must be identical byte for byte.
+             */
+            Scene scene(Color(0.0, 0.0, 0.0));
+            AddMirroredSphere(scene);
+
+            const size_t pixelsWide = 300;
+            const size_t pixelsHigh = 200;
+            const double zoom = 2.0;
+            const size_t antiAliasFactor = 3;
+
+            scene.SaveImage("downsample_whole.png", pixelsWide, pixelsHigh, zoom, antiAliasFactor);
+
+            RenderThreadPool threadPool;
+            std::vector<TraceContext> contextList(threadPool.GetThreadCount());
+
+            ImageBuffer pixels(pixelsWide, pixelsHigh, Color(0.0, 0.0, 0.0));
+            double maxColorValue = 0.0;
+
+            const size_t rectWide = 37;
+            const size_t rectHigh = 23;
+            for (size_t top = 0; top < pixelsHigh; top += rectHigh)
+            {
+                for (size_t left = 0; left < pixelsWide; left += rectWide)
+                {
+                    const PixelRect rect = scene.RenderDownsampledRect(
+                        left, top, std::min(rectWide, pixelsWide - left), std::min(rectHigh, pixelsHigh - top),
+                        pixelsWide, pixelsHigh, zoom, antiAliasFactor, 7, threadPool, contextList, false);
+
+                    rect.CopyTo(pixels);
+                    maxColorValue = std::max(maxColorValue, rect.GetMaxColorValue());
+                }
+            }
+
+            scene.CreateImage("downsample_rects.png", pixels, maxColorValue);
+
+            CheckSameImage("downsample_whole.png", "downsample_rects.png", "Image anti-aliased by rectangles differs from the image anti-aliased as a whole.");
+            std::cout << "Images identical" << std::endl;
+        }
+
+        void TiledRenderTest()
+        {
+            using namespace RayTracer;
+
+            /**
+             * Traces the oversampled pixels of the mirrored sphere in tiles, the way workers trace the rectangles
+             * they are handed: rectangles and tiles that do not divide the image evenly, each traced in Morton order.
+             * The image must be identical byte for byte to the one rendered as a whole.
+             */
+            std::vector<std::pair<size_t, size_t>> cells;
+            MortonOrder(3, 5, cells);
+            const std::pair<size_t, size_t> expectedStart[] = { {0, 0}, {1, 0}, {0, 1}, {1, 1}, {2, 0}, {2, 1} };
+            if (cells.size() != 15 || !std::equal(std::begin(expectedStart), std::end(expectedStart), cells.begin()))
+            {
+                throw ImagerException("Cells of the grid are not listed in Morton order.");
+            }
+
+            Scene scene(Color(0.0, 0.0, 0.0));
+            AddMirroredSphere(scene);
+
+            const size_t pixelsWide = 300;
+            const size_t pixelsHigh = 200;
+            const double zoom = 2.0;
+            const size_t antiAliasFactor = 2;
+            const size_t largePixelsWide = antiAliasFactor * pixelsWide;
+            const size_t largePixelsHigh = antiAliasFactor * pixelsHigh;
+
+            scene.SaveImage("tiled_whole.png", pixelsWide, pixelsHigh, zoom, antiAliasFactor);
+
+            TraceContext context;
+            ImageBuffer buffer(largePixelsWide, largePixelsHigh, Color(0.0, 0.0, 0.0));
+            std::vector<std::pair<size_t, size_t>> tiles;
+
+            const size_t rectWide = 170;
+            const size_t rectHigh = 130;
+            for (size_t left = 0; left < largePixelsWide; left += rectWide)
+            {
+                for (size_t top = 0; top < largePixelsHigh; top += rectHigh)
+                {
+                    const PixelTile rect(left, top, std::min(rectWide, largePixelsWide - left), std::min(rectHigh, largePixelsHigh - top), 24);
+
+                    rect.GetTiles(tiles);
+                    for (const auto& tile : tiles)
+                    {
+                        scene.TraceTile(buffer, 0, 0, rect.GetLeft() + tile.first, rect.GetTop() + tile.second,
+                            std::min(rect.GetTileSize(), rect.GetWidth() - tile.first), std::min(rect.GetTileSize(), rect.GetHeight() - tile.second),
+                            pixelsWide, pixelsHigh, zoom, antiAliasFactor, context);
+                    }
+                }
+            }
+
+            scene.HandleAmbigousPixels(buffer, pixelsWide, pixelsHigh, zoom, antiAliasFactor);
+            scene.CreateImage("tiled_rects.png", buffer, pixelsWide, pixelsHigh, zoom, antiAliasFactor);
+
+            CheckSameImage("tiled_whole.png", "tiled_rects.png", "Image traced in tiles differs from the image rendered as a whole.");
+            std::cout << "Images identical" << std::endl;
+        }
+
+        /**
+         * The ray test TriangleMesh used before its triangles kept their edges and normals: a general 3x3 solve,
+         * tried with up to three orderings of the vertices. Returns the 'u' of every facet hit.
+         */
+        static void ReferenceTriangleHits(const RayTracer::TriangleMesh& mesh, const RayTracer::Vector& vantage, const RayTracer::Vector& direction, std::vector<double>& hits)
+        {
+            using namespace RayTracer;
+
+            hits.clear();
+            for (size_t index = 0; index < mesh.GetNumTriangles(); ++index)
+            {
+                Vector points[3];
+                mesh.GetTriangle(index, points[0], points[1], points[2]);
+
+                for (int first = 0; first < 3; ++first)
+                {
+                    const Vector& A = points[first];
+                    const Vector& B = points[(first + 1) % 3];
+                    const Vector& C = points[(first + 2) % 3];
+
+                    double u, v, w;
+                    if (Algebra::SolveLinearEquations(
+                        direction.x, A.x - B.x, A.x - C.x, -(A.x - vantage.x),
+                        direction.y, A.y - B.y, A.y - C.y, -(A.y - vantage.y),
+                        direction.z, A.z - B.z, A.z - C.z, -(A.z - vantage.z),
+                        u, v, w))
+                    {
+                        if ((v >= 0.0) && (w >= 0.0) && (v + w <= 1.0) && (u >= EPSILON))
+                        {
+                            hits.push_back(u);
+                        }
+                        break;
+                    }
+                }
+            }
+
+            std::sort(hits.begin(), hits.end());
+        }
+
+        void TriangleMeshIntersectionTest()
+        {
+            using namespace RayTracer;
+
+            /**
+             * Fires random rays at the polyhedra of PolyhedraTest, moved and turned so that the precomputed
+             * triangle data has to follow the points, and compares every hit with the previous ray test.
+             */
+            Optics optics;
+
+            Icosahedron icosahedron(Vector(-2.0, 0.0, -50.0), 1.0, optics);
+            icosahedron.RotateY(-12.0);
+            icosahedron.RotateX(-7.0);
+            icosahedron.Translate(0.5, -0.25, 1.0);
+
+            Dodecahedron dodecahedron(Vector(+2.0, 0.0, -50.0), 1.0, optics);
+            dodecahedron.RotateX(-12.0);
+            dodecahedron.RotateY(-7.0);
+            dodecahedron.RotateZ(33.0);
+
+            const TriangleMesh* meshes[] = { &icosahedron, &dodecahedron };
+
+            std::mt19937 generator(2015);
+            std::uniform_real_distribution<double> spread(-1.5, 1.5);
+
+            TraceContext context;
+            std::vector<Intersection> intersections;
+            std::vector<double> expectedHits;
+            size_t numRays(0), numHits(0), numMismatches(0);
+
+            for (const TriangleMesh* mesh : meshes)
+            {
+                const Vector center = mesh->Center();
+
+                for (int ray = 0; ray < 20000; ++ray)
+                {
+                    // From a point around the solid toward another point around it, inside half of the time
+                    const Vector vantage = center + Vector(4.0 * spread(generator), 4.0 * spread(generator), 4.0 * spread(generator));
+                    const Vector target = center + Vector(spread(generator), spread(generator), spread(generator));
+                    const Vector direction = (target - vantage).UnitVector();
+
+                    intersections.clear();
+                    mesh->AppendAllIntersections(vantage, direction, intersections, context);
+                    ReferenceTriangleHits(*mesh, vantage, direction, expectedHits);
+
+                    std::vector<double> hits;
+                    for (const Intersection& intersection : intersections)
+                    {
+                        hits.push_back(sqrt(intersection.distanceSquared));
+
+                        // The normal is on the outside of the facet hit
+                        if (fabs(intersection.surfaceNormal.MagnitudeSquared() - 1.0) > 1.0e-9 || DotProduct(intersection.surfaceNormal, intersection.point - center) <= 0.0)
+                        {
+                            ++numMismatches;
+                        }
+                    }
+                    std::sort(hits.begin(), hits.end());
+
+                    ++numRays;
+                    numHits += hits.size();
+
+                    if (hits.size() != expectedHits.size())
+                    {
+                        ++numMismatches;
+                        continue;
+                    }
+
+                    for (size_t hit = 0; hit < hits.size(); ++hit)
+                    {
+                        if (fabs(hits[hit] - expectedHits[hit]) > 1.0e-9)
+                        {
+                            ++numMismatches;
+                        }
+                    }
+                }
+            }
+
+            std::cout << numRays << " rays, " << numHits << " hits, " << numMismatches << " mismatches" << std::endl;
+            if (numMismatches > 0)
+            {
+                throw ImagerException("Triangle mesh intersections differ from the reference ray test.");
+            }
+        }
+
+        /**
+         * A sphere of the given radius approximated by 'rings' bands of latitude and 2*rings wedges of longitude,
+         * about 4*rings*rings triangles in all. Every three entries of triangleList are the indices of a triangle's points
+         * in pointList, counterclockwise as seen from outside.
+         */
+        static void MakeSphereTriangles(const RayTracer::Vector& center, double radius, int rings, std::vector<RayTracer::Vector>& pointList, std::vector<int>& triangleList)
+        {
+            using namespace RayTracer;
+
+            const int wedges = 2 * rings;
+            pointList.clear();
+            triangleList.clear();
+
+            // The north pole, then each ring of latitude from north to south, then the south pole.
+            pointList.push_back(Vector(center.x, center.y + radius, center.z));
+            for (int ring = 1; ring < rings; ++ring)
+            {
+                const double latitude = PI * ring / rings;
+                for (int wedge = 0; wedge < wedges; ++wedge)
+                {
+                    const double longitude = 2.0 * PI * wedge / wedges;
+                    pointList.push_back(Vector(
+                        center.x + radius * sin(latitude) * cos(longitude),
+                        center.y + radius * cos(latitude),
+                        center.z + radius * sin(latitude) * sin(longitude)));
+                }
+            }
+            const int southPole = static_cast<int>(pointList.size());
+            pointList.push_back(Vector(center.x, center.y - radius, center.z));
+
+            auto ringPoint = [wedges](int ring, int wedge)
+            {
+                return 1 + (ring - 1) * wedges + (wedge % wedges);
+            };
+            auto addTriangle = [&](int a, int b, int c)
+            {
+                triangleList.push_back(a);
+                triangleList.push_back(b);
+                triangleList.push_back(c);
+            };
+
+            for (int wedge = 0; wedge < wedges; ++wedge)
+            {
+                addTriangle(0, ringPoint(1, wedge + 1), ringPoint(1, wedge));
+                for (int ring = 1; ring + 1 < rings; ++ring)
+                {
+                    // The same two triangles AddQuad would make.
+                    addTriangle(ringPoint(ring, wedge), ringPoint(ring, wedge + 1), ringPoint(ring + 1, wedge + 1));
+                    addTriangle(ringPoint(ring + 1, wedge + 1), ringPoint(ring + 1, wedge), ringPoint(ring, wedge));
+                }
+                addTriangle(southPole, ringPoint(rings - 1, wedge), ringPoint(rings - 1, wedge + 1));
+            }
+        }
+
+        static boost::shared_ptr<RayTracer::TriangleMesh> MakeSphereMesh(const RayTracer::Vector& center, double radius, int rings)
+        {
+            using namespace RayTracer;
+
+            std::vector<Vector> pointList;
+            std::vector<int> triangleList;
+            MakeSphereTriangles(center, radius, rings, pointList, triangleList);
+
+            boost::shared_ptr<TriangleMesh> mesh(new TriangleMesh(center));
+            for (size_t point = 0; point < pointList.size(); ++point)
+            {
+                mesh->AddPoint(static_cast<int>(point), pointList[point].x, pointList[point].y, pointList[point].z);
+            }
+
+            const Optics optics(Color(0.7, 0.8, 1.0));
+            for (size_t corner = 0; corner < triangleList.size(); corner += 3)
+            {
+                mesh->AddTriangle(triangleList[corner], triangleList[corner + 1], triangleList[corner + 2], optics);
+            }
+
+            return mesh;
+        }
+
+        void TriangleMeshBenchmark()
+        {
+            using namespace RayTracer;
+
+            /**
+             * Renders spheres of about 1k to 1M triangles with and without the tree over the triangles, and times
+             * containment queries on each. With the tree, doubling the triangles should only add a constant to the
+             * time per ray. The linear scan is skipped for the largest meshes, where it would take far too long.
+             */
+            const int ringCounts[] = { 16, 32, 64, 128, 256, 512 };
+            const size_t maxLinearTriangleCount = 20000;
+            const Vector center(0.0, 0.0, -30.0);
+            const double radius = 10.0;
+
+            for (int rings : ringCounts)
+            {
+                Scene scene(Color(0.0, 0.0, 0.0));
+
+                const boost::shared_ptr<TriangleMesh> mesh = MakeSphereMesh(center, radius, rings);
+                scene.AddSolidObject(mesh);
+                scene.AddLightSource(boost::shared_ptr<LightSource>(new LightSource(Vector(-45.0, +60.0, +50.0), Color(1.0, 1.0, 0.6, 1.0))));
+
+                const size_t triangleCount = mesh->GetNumTriangles();
+
+                std::ostringstream treeFilename;
+                treeFilename << "mesh_tree_" << triangleCount << ".png";
+
+                auto start = std::chrono::steady_clock::now();
+                scene.SaveImage(treeFilename.str().c_str(), 320, 240, 1.0, 1);
+                const double treeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                // Points inside and outside the sphere, away from its surface, where the answer does not depend on the facets.
+                TraceContext context;
+                std::mt19937 generator(2015);
+                std::uniform_real_distribution<double> coordinate(-1.5 * radius, +1.5 * radius);
+                const int containsQueries = 10000;
+                int wrongAnswers = 0;
+
+                start = std::chrono::steady_clock::now();
+                for (int query = 0; query < containsQueries; ++query)
+                {
+                    const Vector offset(coordinate(generator), coordinate(generator), coordinate(generator));
+                    const double distance = offset.Magnitude();
+                    const bool inside = mesh->Contains(center + offset, context);
+                    if ((distance < 0.9 * radius && !inside) || (distance > 1.1 * radius && inside))
+                    {
+                        ++wrongAnswers;
+                    }
+                }
+                const double containsMicroseconds = 1.0e6 * std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / containsQueries;
+
+                std::cout << triangleCount << " triangles: tree " << treeSeconds << " s, " << containsMicroseconds << " us per Contains()";
+
+                if (wrongAnswers > 0)
+                {
+                    throw ImagerException("TriangleMesh::Contains gave the wrong answer.");
+                }
+
+                if (triangleCount <= maxLinearTriangleCount)
+                {
+                    std::ostringstream linearFilename;
+                    linearFilename << "mesh_linear_" << triangleCount << ".png";
+
+                    mesh->SetUseTriangleTree(false);
+                    start = std::chrono::steady_clock::now();
+                    scene.SaveImage(linearFilename.str().c_str(), 320, 240, 1.0, 1);
+                    const double linearSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                    std::cout << ", linear " << linearSeconds << " s, speedup " << (linearSeconds / treeSeconds);
+
+                    if (ReadWholeFile(treeFilename.str()) != ReadWholeFile(linearFilename.str()))
+                    {
+                        std::cout << std::endl;
+                        throw ImagerException("Image rendered with the triangle tree differs from the linear scan.");
+                    }
+                    std::cout << ", images identical";
+                }
+                std::cout << std::endl;
+            }
+        }
+
+        // Checks that 'mesh' has the triangles of MakeSphereTriangles, with its points within 'tolerance'.
+        static void CheckSphereMesh(const RayTracer::TriangleMesh& mesh, const std::vector<RayTracer::Vector>& pointList, const std::vector<int>& triangleList, double tolerance)
+        {
+            using namespace RayTracer;
+
+            if (mesh.GetNumTriangles() * 3 != triangleList.size())
+            {
+                throw ImagerException("Imported mesh has the wrong number of triangles.");
+            }
+
+            for (size_t triangle = 0; triangle < mesh.GetNumTriangles(); ++triangle)
+            {
+                Vector corner[3];
+                mesh.GetTriangle(triangle, corner[0], corner[1], corner[2]);
+                for (int i = 0; i < 3; ++i)
+                {
+                    if ((corner[i] - pointList[triangleList[3 * triangle + i]]).Magnitude() > tolerance)
+                    {
+                        throw ImagerException("Imported mesh has a point in the wrong place.");
+                    }
+                }
+            }
+        }
+
+        static void PrintMeshImportReport(const std::string& filename, const RayTracer::MeshImportReport& report)
+        {
+            std::cout << filename << ": " << report.pointCount << " points, " << report.triangleCount << " triangles";
+            if (report.skippedTriangleCount > 0)
+            {
+                std::cout << " (" << report.skippedTriangleCount << " without area skipped)";
+            }
+            std::cout << ", " << (report.fileBytes / 1048576.0) << " MB file loaded in " << report.seconds << " s, "
+                << (report.meshMemoryBytes / 1048576.0) << " MB in memory, " << (report.peakMemoryBytes / 1048576.0) << " MB peak" << std::endl;
+        }
+
+        void MeshImportTest()
+        {
+            using namespace RayTracer;
+
+            /**
+             * Loads a small OBJ file that uses the less common parts of the format, then writes a sphere of about a million
+             * triangles as OBJ and as binary PLY, loads both back and compares them with the triangles that were written.
+             */
+            const Optics optics(Color(0.7, 0.8, 1.0));
+            MeshImportReport report;
+
+            {
+                std::ofstream outFile("small.obj", std::ios::binary);
+                outFile <<
+                    "# A unit square and a triangle above it\n"
+                    "mtllib small.mtl\n"
+                    "o square\n"
+                    "v 0 0 0\n"
+                    "v 1 0 0 1.0\n"
+                    "v 1 1 0\r\n"
+                    "v 0 1 0\n"
+                    "vt 0 0\n"
+                    "vn 0 0 1\n"
+                    "f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+                    "\n"
+                    "   v 0.5 0.5 2e0   # apex\n"
+                    "f -1 -5 -4\n"
+                    "f 1//1 1//1 2//1\n"
+                    "f 5 2 3";
+            }
+
+            const boost::shared_ptr<TriangleMesh> smallMesh = MeshImporter::Load("small.obj", optics, report);
+            PrintMeshImportReport("small.obj", report);
+
+            Vector a, b, c;
+            smallMesh->GetTriangle(2, a, b, c);
+            if ((report.pointCount != 5) || (report.triangleCount != 4) || (report.skippedTriangleCount != 1) ||
+                (a.x != 0.5) || (a.z != 2.0) || (b.x != 0.0) || (c.x != 1.0) || (c.y != 0.0))
+            {
+                throw ImagerException("Small OBJ file was not loaded as expected.");
+            }
+
+            std::vector<Vector> pointList;
+            std::vector<int> triangleList;
+            MakeSphereTriangles(Vector(0.0, 0.0, 0.0), 10.0, 512, pointList, triangleList);
+
+            {
+                std::ofstream outFile("sphere.obj", std::ios::binary);
+                outFile.precision(9);
+                for (const Vector& point : pointList)
+                {
+                    outFile << "v " << point.x << ' ' << point.y << ' ' << point.z << '\n';
+                }
+                for (size_t corner = 0; corner < triangleList.size(); corner += 3)
+                {
+                    outFile << "f " << (triangleList[corner] + 1) << ' ' << (triangleList[corner + 1] + 1) << ' ' << (triangleList[corner + 2] + 1) << '\n';
+                }
+            }
+
+            {
+                std::ofstream outFile("sphere.ply", std::ios::binary);
+                outFile <<
+                    "ply\n"
+                    "format binary_little_endian 1.0\n"
+                    "comment written by MeshImportTest\n"
+                    "element vertex " << pointList.size() << "\n"
+                    "property float x\n"
+                    "property float y\n"
+                    "property float z\n"
+                    "property uchar red\n"
+                    "element face " << triangleList.size() / 3 << "\n"
+                    "property list uchar int vertex_indices\n"
+                    "end_header\n";
+
+                // Assumes a little-endian host, like every platform this builds on.
+                for (const Vector& point : pointList)
+                {
+                    const float xyz[3] = { static_cast<float>(point.x), static_cast<float>(point.y), static_cast<float>(point.z) };
+                    const unsigned char red = 255;
+                    outFile.write(reinterpret_cast<const char*>(xyz), sizeof(xyz));
+                    outFile.write(reinterpret_cast<const char*>(&red), 1);
+                }
+                for (size_t corner = 0; corner < triangleList.size(); corner += 3)
+                {
+                    const unsigned char count = 3;
+                    outFile.write(reinterpret_cast<const char*>(&count), 1);
+                    outFile.write(reinterpret_cast<const char*>(&triangleList[corner]), 3 * sizeof(int));
+                }
+            }
+
+            const char* filenames[] = { "sphere.obj", "sphere.ply" };
+            for (const char* filename : filenames)
+            {
+                const boost::shared_ptr<TriangleMesh> mesh = MeshImporter::Load(filename, optics, report);
+                PrintMeshImportReport(filename, report);
+
+                // The PLY file holds floats.
+                CheckSphereMesh(*mesh, pointList, triangleList, 1.0e-5);
+
+                // All the triangles share one material, which the archive holds once.
+                if (mesh->GetNumMaterials() != 1)
+                {
+                    throw ImagerException("Imported mesh has more than one material.");
+                }
+                std::cout << "    " << (SaveArchive(*mesh).size() / 1048576.0) << " MB as an archive" << std::endl;
+
+                TraceContext context;
+                if (!mesh->Contains(Vector(1.0, 2.0, 3.0), context) || mesh->Contains(Vector(11.0, 2.0, 3.0), context))
+                {
+                    throw ImagerException("Imported sphere does not enclose its inside.");
+                }
+            }
+        }
+
+        // One of the solids InstancingTest repeats, made around 'center': a mesh, a CSG solid, a bigger mesh and a chess board.
+        static boost::shared_ptr<RayTracer::SolidObject> MakeInstancingSolid(int kind, const RayTracer::Vector& center)
+        {
+            using namespace RayTracer;
+
+            const Optics optics(Color(0.7, 0.8, 1.0));
+            boost::shared_ptr<SolidObject> solid;
+            switch (kind)
+            {
+            case 0:
+                solid.reset(new Dodecahedron(center, 8.0, optics));
+                break;
+            case 1:
+                solid.reset(new ConcreteBlock(center, optics));
+                break;
+            case 2:
+                solid = MakeSphereMesh(center, 10.0, 32);
+                break;
+            default:
+                // The squares are colored by where they are on the board, so they show whether instances find that place.
+                solid.reset(new ChessBoard(20.0, 2.0, 2.0, 1.0, Color(0.9, 0.9, 0.9), Color(0.36, 0.25, 0.20), Color(0.50, 0.30, 0.10)));
+                solid->Move(center);
+                solid->RotateZ(30.0);
+                break;
+            }
+            return solid;
+        }
+
+        void InstancingTest()
+        {
+            using namespace RayTracer;
+
+            /**
+             * Fills a grid with solids of four kinds, each turned its own way, once as a separate copy in every cell and once as
+             * instances of one shared solid per kind, and compares the two scenes: the time to set them up and render them,
+             * the size of their archives, and their pixels, which may only differ where rounding moves an edge.
+             * The shared chess board is itself an instance of a turned board, to check that instances nest.
+             */
+            const int gridSize = 15;
+            const int kindCount = 4;
+            const double spacing = 40.0;
+            const double depth = -650.0;
+            const size_t pixelsWide = 320;
+            const size_t pixelsHigh = 240;
+
+            std::vector<boost::shared_ptr<SolidObject>> geometryList;
+            for (int kind = 0; kind < kindCount; ++kind)
+            {
+                geometryList.push_back(MakeInstancingSolid(kind, Vector()));
+            }
+            geometryList[kindCount - 1].reset(new Instance(geometryList[kindCount - 1]));
+
+            const char* names[] = { "copies", "instances" };
+            Scene scenes[2] = { Scene(Color(0.0, 0.0, 0.0)), Scene(Color(0.0, 0.0, 0.0)) };
+            std::string archives[2];
+
+            for (int useInstances = 0; useInstances < 2; ++useInstances)
+            {
+                Scene& scene = scenes[useInstances];
+
+                auto start = std::chrono::steady_clock::now();
+                for (int row = 0; row < gridSize; ++row)
+                {
+                    for (int column = 0; column < gridSize; ++column)
+                    {
+                        const int kind = (row + column) % kindCount;
+                        const Vector center((column - gridSize / 2) * spacing, (row - gridSize / 2) * spacing, depth);
+
+                        boost::shared_ptr<SolidObject> solid;
+                        if (useInstances)
+                        {
+                            solid.reset(new Instance(geometryList[kind]));
+                            solid->Move(center);
+                        }
+                        else
+                        {
+                            solid = MakeInstancingSolid(kind, center);
+                        }
+                        solid->RotateX(7.0 * row - 40.0);
+                        solid->RotateY(11.0 * column + 5.0);
+                        scene.AddSolidObject(solid);
+                    }
+                }
+                scene.AddLightSource(boost::shared_ptr<LightSource>(new LightSource(Vector(-450.0, +600.0, +500.0), Color(1.0, 1.0, 0.6, 1.0))));
+                scene.AddLightSource(boost::shared_ptr<LightSource>(new LightSource(Vector(+400.0, +200.0, -200.0), Color(0.4, 0.4, 1.0, 0.5))));
+                scene.BuildBoundingVolumeHierarchy();
+                const double setupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                // Meshes build their triangle trees on the first rays that reach them.
+                std::ostringstream filename;
+                filename << "instancing_" << names[useInstances] << ".png";
+                start = std::chrono::steady_clock::now();
+                scene.SaveImage(filename.str().c_str(), pixelsWide, pixelsHigh, 1.0, 1);
+                const double renderSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                start = std::chrono::steady_clock::now();
+                archives[useInstances] = SaveArchive(scene);
+                const double archiveSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                std::cout << gridSize * gridSize << " " << names[useInstances] << ": set up in " << setupSeconds << " s, rendered in "
+                    << renderSeconds << " s, " << (archives[useInstances].size() / 1048576.0) << " MB archive in " << archiveSeconds << " s" << std::endl;
+            }
+
+            TraceContext context;
+            size_t differentPixels = 0;
+            for (size_t j = 0; j < pixelsHigh; ++j)
+            {
+                for (size_t i = 0; i < pixelsWide; ++i)
+                {
+                    const PixelData copyPixel = scenes[0].GetPixelAt(i, j, pixelsWide, pixelsHigh, 1.0, 1, context);
+                    const PixelData instancePixel = scenes[1].GetPixelAt(i, j, pixelsWide, pixelsHigh, 1.0, 1, context);
+                    if ((copyPixel.isAmbiguous != instancePixel.isAmbiguous) ||
+                        (fabs(copyPixel.color.red - instancePixel.color.red) > 1.0e-6) ||
+                        (fabs(copyPixel.color.green - instancePixel.color.green) > 1.0e-6) ||
+                        (fabs(copyPixel.color.blue - instancePixel.color.blue) > 1.0e-6))
+                    {
+                        ++differentPixels;
+                    }
+                }
+            }
+            std::cout << differentPixels << " of " << pixelsWide * pixelsHigh << " pixels differ" << std::endl;
+            if (differentPixels > pixelsWide * pixelsHigh / 100)
+            {
+                throw ImagerException("Instances do not look like the copies they replace.");
+            }
+
+            // Loaded instances must share their geometry again, or the archive would grow on the next save.
+            Scene loadedScene(Color(0.0, 0.0, 0.0));
+            LoadArchive(archives[1], loadedScene);
+            if (SaveArchive(loadedScene) != archives[1])
+            {
+                throw ImagerException("Scene of instances changed on its way through an archive.");
+            }
+            loadedScene.SaveImage("instancing_loaded.png", pixelsWide, pixelsHigh, 1.0, 1);
+            if (ReadWholeFile("instancing_loaded.png") != ReadWholeFile("instancing_instances.png"))
+            {
+                throw ImagerException("Loaded scene of instances renders differently.");
+            }
+        }
+
+        // Times 'iterations' round trips of 'object' through one archive format and checks that nothing is lost on the way.
+        template<class T>
+        static void MeasureArchiveFormat(const T& object, T& loaded, RayTracer::ArchiveFormat format, const char* formatName, size_t iterations)
+        {
+            using namespace RayTracer;
+
+            std::string archive;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                archive = SaveArchive(object, format);
+            }
+            const double saveSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < iterations; ++i)
+            {
+                LoadArchive(archive, loaded);
+            }
+            const double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            if (SaveArchive(loaded, format) != archive)
+            {
+                throw ImagerException("Archive round trip changed the serialized object.");
+            }
+
+            const double megabytes = static_cast<double>(archive.size() * iterations) / (1024.0 * 1024.0);
+            std::cout << "    " << formatName << ": " << archive.size() << " bytes, save " << (megabytes / saveSeconds) << " MB/s ("
+                << (1000.0 * saveSeconds / iterations) << " ms), load " << (megabytes / loadSeconds) << " MB/s ("
+                << (1000.0 * loadSeconds / iterations) << " ms)" << std::endl;
+        }
+
+        void SerializationBenchmark()
+        {
+            using namespace RayTracer;
+
+            /**
+             * Compares text and binary archives on the two kinds of data sent over the network:
+             * a scene of 2000 spheres and the computed pixels of one 15 line chunk at 1800 pixels per line,
+             * the latter both as a list of coordinates and pixels and as the PixelRect that workers send.
+             */
+            Scene scene(Color(0.0, 0.0, 0.0));
+
+            std::mt19937 generator(12345);
+            std::uniform_real_distribution<double> coordinate(-20.0, +20.0);
+            for (size_t i = 0; i < 2000; ++i)
+            {
+                const Vector center(coordinate(generator), coordinate(generator), coordinate(generator) - 80.0);
+                boost::shared_ptr<SolidObject> sphere = boost::shared_ptr<SolidObject>(new Sphere(center, 0.5));
+                sphere->SetMatteGlossBalance(0.3, Color(0.4, 0.5, 0.7), Color(0.8, 1.0, 0.7));
+                scene.AddSolidObject(sphere);
+            }
+            scene.AddLightSource(boost::shared_ptr<LightSource>(new LightSource(Vector(-45.0, +60.0, +50.0), Color(1.0, 1.0, 0.6, 1.0))));
+
+            std::vector<std::pair<PixelCoordinates, PixelData>> chunk;
+            std::uniform_real_distribution<double> intensity(0.0, 1.0);
+            for (size_t line = 0; line < 15; ++line)
+            {
+                for (size_t j = 0; j < 1800; ++j)
+                {
+                    PixelData pixel;
+                    pixel.color = Color(intensity(generator), intensity(generator), intensity(generator));
+                    pixel.isAmbiguous = (j % 97) == 0;
+                    chunk.push_back(std::make_pair(PixelCoordinates(line, j), pixel));
+                }
+            }
+
+            std::cout << "Scene of 2000 spheres:" << std::endl;
+            Scene loadedScene(Color(0.0, 0.0, 0.0));
+            MeasureArchiveFormat(scene, loadedScene, TEXT_ARCHIVE, "text", 5);
+            MeasureArchiveFormat(scene, loadedScene, BINARY_ARCHIVE, "binary", 5);
+
+            std::cout << "Chunk of " << chunk.size() << " pixels:" << std::endl;
+            std::vector<std::pair<PixelCoordinates, PixelData>> loadedChunk;
+            MeasureArchiveFormat(chunk, loadedChunk, TEXT_ARCHIVE, "text", 20);
+            MeasureArchiveFormat(chunk, loadedChunk, BINARY_ARCHIVE, "binary", 20);
+
+            // The same pixels as workers send them: the rectangle is named once and the coordinates are implied.
+            std::vector<PixelData> rectPixels(chunk.size());
+            for (const auto& computedPixel : chunk)
+            {
+                rectPixels[computedPixel.first.j * 15 + computedPixel.first.i] = computedPixel.second;
+            }
+
+            PixelRect loadedRect;
+            std::cout << "Same chunk as a PixelRect of doubles:" << std::endl;
+            MeasureArchiveFormat(PixelRect(0, 0, 15, 1800, rectPixels, false), loadedRect, BINARY_ARCHIVE, "binary", 20);
+            std::cout << "Same chunk as a PixelRect of floats:" << std::endl;
+            MeasureArchiveFormat(PixelRect(0, 0, 15, 1800, rectPixels, true), loadedRect, BINARY_ARCHIVE, "binary", 20);
+        }
+
         void UnitTests()
         {
 
@@ -888,6 +1782,15 @@ namespace RayTracer
             // TorusTest("torus1.png", 0.0);
             // TorusTest("torus2.png", 0.7);
             // CustomScene();
+            // BoundingVolumeHierarchyBenchmark();
+            // ParallelRenderTest();
+            // SerializationBenchmark();
+            // DownsampledRenderTest();
+            // TiledRenderTest();
+            // TriangleMeshIntersectionTest();
+            // TriangleMeshBenchmark();
+            // MeshImportTest();
+            // InstancingTest();
         }
     }
 }
\ No newline at end of file